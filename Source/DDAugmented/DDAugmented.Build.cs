@@ -48,6 +48,8 @@ public class DDAugmented : ModuleRules
 				"SlateCore",
                 "AugmentedReality",
                 "GrasshopperAR",
+                "RenderCore",
+                "RHI",
 				"depsDDAugmented"
 			}
 			);
@@ -0,0 +1,334 @@
+//
+// ARGeoDelta.cpp
+//
+
+#include "ARGeoDelta.h"
+#include "ARPlaneRenderer.h"
+#include "Engine/NetSerialization.h"
+
+namespace
+{
+    // gaps of unchanged vertices shorter than this are merged into one range,
+    // range header costs more than a couple of vertices
+    constexpr int32 kRangeMergeGap = 2;
+
+    // pose difference (cm / quat error) below which delta doesn't carry a pose
+    constexpr float kPoseTolerance = 0.05f;
+
+    // wraparound-safe "a is newer than b"
+    bool IsNewerSequence(uint16 a, uint16 b)
+    {
+        return (int16)(a - b) > 0;
+    }
+}
+
+int16 ARGeoQuantize::QuantizePosition(float v)
+{
+    return (int16)FMath::Clamp(FMath::RoundToInt(v / kPositionStep), (int32)MIN_int16, (int32)MAX_int16);
+}
+
+float ARGeoQuantize::DequantizePosition(int16 q)
+{
+    return (float)q * kPositionStep;
+}
+
+void ARGeoQuantize::SerializeQuat(FArchive& Ar, FQuat& q)
+{
+    static constexpr uint32 kComponentMax = (1 << 15) - 1;
+    // three smallest components of a unit quaternion are within +/- 1/sqrt(2)
+    static constexpr float kComponentRange = 0.70710678f;
+
+    uint32 largest = 0;
+    uint32 packed[3] = { 0, 0, 0 };
+
+    if (Ar.IsSaving())
+    {
+        FQuat n = q.GetNormalized();
+        float c[4] = { n.X, n.Y, n.Z, n.W };
+
+        for (uint32 i = 1; i < 4; ++i)
+            if (FMath::Abs(c[i]) > FMath::Abs(c[largest]))
+                largest = i;
+
+        // q and -q are the same rotation -- make largest component positive and drop it
+        float sign = c[largest] < 0.f ? -1.f : 1.f;
+
+        for (uint32 i = 0, j = 0; i < 4; ++i)
+        {
+            if (i == largest)
+                continue;
+
+            float v = FMath::Clamp(c[i] * sign / kComponentRange, -1.f, 1.f);
+            packed[j++] = (uint32)FMath::RoundToInt((v * 0.5f + 0.5f) * kComponentMax);
+        }
+    }
+
+    Ar.SerializeInt(largest, 4);
+    for (uint32 j = 0; j < 3; ++j)
+        Ar.SerializeInt(packed[j], kComponentMax + 1);
+
+    if (Ar.IsLoading())
+    {
+        float c[4];
+        float sumSq = 0.f;
+
+        for (uint32 i = 0, j = 0; i < 4; ++i)
+        {
+            if (i == largest)
+                continue;
+
+            c[i] = ((float)packed[j++] / kComponentMax * 2.f - 1.f) * kComponentRange;
+            sumSq += c[i] * c[i];
+        }
+
+        c[largest] = FMath::Sqrt(FMath::Max(0.f, 1.f - sumSq));
+        q = FQuat(c[0], c[1], c[2], c[3]);
+        q.Normalize();
+    }
+}
+
+void ARGeoQuantize::SerializeTransform(FArchive& Ar, FTransform& t)
+{
+    FVector translation = t.GetTranslation();
+    FQuat rotation = t.GetRotation();
+    FVector scale = t.GetScale3D();
+
+    SerializePackedVector<10, 24>(translation, Ar);
+    SerializeQuat(Ar, rotation);
+
+    uint8 hasScale = scale.Equals(FVector::OneVector) ? 0 : 1;
+    Ar.SerializeBits(&hasScale, 1);
+    if (hasScale)
+        Ar << scale;
+    else
+        scale = FVector::OneVector;
+
+    if (Ar.IsLoading())
+        t = FTransform(rotation, translation, scale);
+}
+
+bool FARGeoDelta::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+    Ar << id_;
+    Ar << sequence_;
+    Ar << keyframeSeq_;
+
+    uint8 flags = (isKeyframe_ ? 1 : 0) | (hasPose_ ? 2 : 0);
+    Ar.SerializeBits(&flags, 2);
+    isKeyframe_ = (flags & 1) != 0;
+    hasPose_ = (flags & 2) != 0;
+
+    uint32 vertexCount = vertexCount_;
+    uint32 nRanges = ranges_.Num();
+    Ar.SerializeIntPacked(vertexCount);
+    Ar.SerializeIntPacked(nRanges);
+
+    if (Ar.IsLoading())
+    {
+        if (vertexCount > (uint32)ARGeoQuantize::kMaxBoundaryVertices || nRanges > vertexCount)
+        {
+            Ar.SetError();
+            bOutSuccess = false;
+            return true;
+        }
+
+        vertexCount_ = vertexCount;
+        ranges_.SetNumUninitialized(nRanges);
+    }
+
+    // 64 bit so that no range from the wire can wrap around the checks
+    uint64 nRangeVerts = 0;
+    for (FARGeoVertexRange& range : ranges_)
+    {
+        uint32 start = range.start_;
+        uint32 count = range.count_;
+        Ar.SerializeIntPacked(start);
+        Ar.SerializeIntPacked(count);
+
+        nRangeVerts += count;
+
+        if ((uint64)start + count > vertexCount || nRangeVerts > vertexCount)
+        {
+            Ar.SetError();
+            bOutSuccess = false;
+            return true;
+        }
+
+        range.start_ = start;
+        range.count_ = count;
+    }
+
+    // keyframe carries the whole boundary
+    if (isKeyframe_ && nRangeVerts != vertexCount)
+    {
+        Ar.SetError();
+        bOutSuccess = false;
+        return true;
+    }
+
+    if (Ar.IsLoading())
+        verts_.SetNumUninitialized((int32)nRangeVerts * 3);
+
+    for (int16& v : verts_)
+        Ar << v;
+
+    if (hasPose_)
+    {
+        ARGeoQuantize::SerializeTransform(Ar, localToWorld_);
+        ARGeoQuantize::SerializeTransform(Ar, localToTracking_);
+    }
+
+    bOutSuccess = !Ar.IsError();
+    return true;
+}
+
+bool FARGeoDeltaEncoder::Encode(const FARTrackedGeoData& data, float timeSeconds, float keyframeInterval, FARGeoDelta& outDelta)
+{
+    const TArray<FVector>& boundary = data.boundaryVerts_;
+    int32 nVerts = FMath::Min(boundary.Num(), ARGeoQuantize::kMaxBoundaryVertices);
+
+    bool isKeyframe = !hasKeyframe_ ||
+        (timeSeconds - keyframeTime_) >= keyframeInterval ||
+        keyframeVerts_.Num() != nVerts * 3;
+
+    if (!isKeyframe && data.revision_ == lastRevision_)
+        return false;
+
+    currentVerts_.Reset(nVerts * 3);
+    for (int32 i = 0; i < nVerts; ++i)
+    {
+        currentVerts_.Add(ARGeoQuantize::QuantizePosition(boundary[i].X));
+        currentVerts_.Add(ARGeoQuantize::QuantizePosition(boundary[i].Y));
+        currentVerts_.Add(ARGeoQuantize::QuantizePosition(boundary[i].Z));
+    }
+
+    outDelta.ranges_.Reset();
+    outDelta.verts_.Reset();
+
+    if (!isKeyframe)
+    {
+        // collect ranges of vertices that differ from the keyframe
+        int32 nChanged = 0;
+        int32 lastChanged = -kRangeMergeGap - 2;
+
+        for (int32 i = 0; i < nVerts; ++i)
+        {
+            if (FMemory::Memcmp(&currentVerts_[i * 3], &keyframeVerts_[i * 3], 3 * sizeof(int16)) == 0)
+                continue;
+
+            if (i - lastChanged - 1 <= kRangeMergeGap && outDelta.ranges_.Num())
+            {
+                FARGeoVertexRange& range = outDelta.ranges_.Last();
+                nChanged += i - (range.start_ + range.count_) + 1;
+                range.count_ = i - range.start_ + 1;
+            }
+            else
+            {
+                outDelta.ranges_.Add({ i, 1 });
+                nChanged++;
+            }
+
+            lastChanged = i;
+        }
+
+        // delta would be as large as keyframe -- send a keyframe instead
+        if (nChanged * 2 > nVerts)
+            isKeyframe = true;
+    }
+
+    if (isKeyframe)
+    {
+        outDelta.ranges_.Reset();
+        if (nVerts)
+            outDelta.ranges_.Add({ 0, nVerts });
+    }
+
+    for (const FARGeoVertexRange& range : outDelta.ranges_)
+        outDelta.verts_.Append(&currentVerts_[range.start_ * 3], range.count_ * 3);
+
+    outDelta.id_ = data.id_;
+    outDelta.sequence_ = sequence_ + 1;
+    outDelta.keyframeSeq_ = isKeyframe ? keyframeSeq_ + 1 : keyframeSeq_;
+    outDelta.isKeyframe_ = isKeyframe;
+    outDelta.vertexCount_ = nVerts;
+    outDelta.hasPose_ = isKeyframe ||
+        !data.localToWorld_.Equals(keyframeLocalToWorld_, kPoseTolerance) ||
+        !data.localToTracking_.Equals(keyframeLocalToTracking_, kPoseTolerance);
+    outDelta.localToWorld_ = data.localToWorld_;
+    outDelta.localToTracking_ = data.localToTracking_;
+
+    return true;
+}
+
+void FARGeoDeltaEncoder::Commit(const FARGeoDelta& delta, const FARTrackedGeoData& data, float timeSeconds)
+{
+    sequence_ = delta.sequence_;
+    lastRevision_ = data.revision_;
+
+    if (delta.isKeyframe_)
+    {
+        // currentVerts_ still holds quantized boundary from Encode
+        keyframeSeq_ = delta.keyframeSeq_;
+        keyframeTime_ = timeSeconds;
+        keyframeVerts_ = currentVerts_;
+        keyframeLocalToWorld_ = data.localToWorld_;
+        keyframeLocalToTracking_ = data.localToTracking_;
+        hasKeyframe_ = true;
+    }
+}
+
+bool FARGeoDeltaDecoder::Apply(const FARGeoDelta& delta, FARTrackedGeoData& data)
+{
+    if (hasKeyframe_ && !IsNewerSequence(delta.sequence_, lastSequence_))
+        return false;
+
+    // reject before touching any state so a bad delta can't write past the boundary
+    int64 nRangeVerts = 0;
+    for (const FARGeoVertexRange& range : delta.ranges_)
+    {
+        if (range.start_ < 0 || range.count_ < 0 || (int64)range.start_ + range.count_ > delta.vertexCount_)
+            return false;
+        nRangeVerts += range.count_;
+    }
+
+    if (nRangeVerts * 3 != delta.verts_.Num())
+        return false;
+
+    if (delta.isKeyframe_)
+    {
+        if (delta.verts_.Num() != delta.vertexCount_ * 3)
+            return false;
+
+        keyframeVerts_.Reset(delta.vertexCount_);
+        for (int32 i = 0; i + 2 < delta.verts_.Num() && keyframeVerts_.Num() < delta.vertexCount_; i += 3)
+            keyframeVerts_.Add(FVector(ARGeoQuantize::DequantizePosition(delta.verts_[i]),
+                                       ARGeoQuantize::DequantizePosition(delta.verts_[i + 1]),
+                                       ARGeoQuantize::DequantizePosition(delta.verts_[i + 2])));
+
+        keyframeLocalToWorld_ = delta.localToWorld_;
+        keyframeLocalToTracking_ = delta.localToTracking_;
+        keyframeSeq_ = delta.keyframeSeq_;
+        hasKeyframe_ = true;
+    }
+    else if (!hasKeyframe_ || delta.keyframeSeq_ != keyframeSeq_ || delta.vertexCount_ != keyframeVerts_.Num())
+    {
+        return false;
+    }
+
+    lastSequence_ = delta.sequence_;
+
+    data.boundaryVerts_ = keyframeVerts_;
+
+    int32 v = 0;
+    for (const FARGeoVertexRange& range : delta.ranges_)
+        for (int32 i = range.start_; i < range.start_ + range.count_ && i < data.boundaryVerts_.Num() && v + 2 < delta.verts_.Num(); ++i, v += 3)
+            data.boundaryVerts_[i] = FVector(ARGeoQuantize::DequantizePosition(delta.verts_[v]),
+                                              ARGeoQuantize::DequantizePosition(delta.verts_[v + 1]),
+                                              ARGeoQuantize::DequantizePosition(delta.verts_[v + 2]));
+
+    data.localToWorld_ = delta.hasPose_ ? delta.localToWorld_ : keyframeLocalToWorld_;
+    data.localToTracking_ = delta.hasPose_ ? delta.localToTracking_ : keyframeLocalToTracking_;
+    data.UpdateRevision();
+
+    return true;
+}
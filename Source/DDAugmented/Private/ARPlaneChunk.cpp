@@ -0,0 +1,87 @@
+//
+// ARPlaneChunk.cpp
+//
+
+#include "ARPlaneChunk.h"
+#include "Components/SceneComponent.h"
+#include <Net/UnrealNetwork.h>
+
+AARPlaneChunk::AARPlaneChunk()
+{
+    PrimaryActorTick.bCanEverTick = false;
+
+    RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
+
+    Renderer = nullptr;
+    GeoDataArray.Chunk = this;
+    GeoDataArray.Headers = &GeoHeaderArray;
+    GeoHeaderArray.Geo = &GeoDataArray;
+    bReplicates = true;
+    SetReplicatingMovement(false);
+}
+
+void AARPlaneChunk::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const { Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+    DOREPLIFETIME(AARPlaneChunk, Renderer);
+    DOREPLIFETIME(AARPlaneChunk, GeoHeaderArray);
+    DOREPLIFETIME(AARPlaneChunk, GeoDataArray);
+}
+
+void AARPlaneChunk::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    // client: chunk left relevancy (or server destroyed it) -- its planes go too
+    if (!HasAuthority() && IsValid(Renderer))
+    {
+        for (const FARTrackedGeoItem& item : GeoDataArray.Items)
+            if (item.data_.id_.IsValid())
+                Renderer->OnChunkGeoDataRemoved(this, item.data_.id_);
+    }
+
+    Super::EndPlay(EndPlayReason);
+}
+
+bool AARPlaneChunk::IsNetRelevantFor(const AActor* RealViewer, const AActor* ViewTarget, const FVector& SrcLocation) const
+{
+    if (IsOwnedBy(RealViewer) || IsOwnedBy(ViewTarget))
+        return false;
+
+    return FVector::DistSquared(GetActorLocation(), SrcLocation) < NetCullDistanceSquared;
+}
+
+float AARPlaneChunk::GetNetPriority(const FVector& ViewPos, const FVector& ViewDir, AActor* Viewer, AActor* ViewTarget,
+                                    UActorChannel* InChannel, float Time, bool bLowBandwidth)
+{
+    // 2x at the viewer down to 0.5x at the relevancy edge
+    float closeness = NetCullDistanceSquared > 0.f ? 1.f - FMath::Clamp(FVector::DistSquared(GetActorLocation(), ViewPos) / NetCullDistanceSquared, 0.f, 1.f) : 1.f;
+
+    return NetPriority * Time * FMath::Lerp(0.5f, 2.f, closeness);
+}
+
+void AARPlaneChunk::OnGeoDataAdded(const FARTrackedGeoData& data)
+{
+    if (IsValid(Renderer))
+        Renderer->OnChunkGeoDataChanged(this, data);
+}
+
+void AARPlaneChunk::OnGeoDataChanged(const FARTrackedGeoData& data)
+{
+    if (IsValid(Renderer))
+        Renderer->OnChunkGeoDataChanged(this, data);
+}
+
+void AARPlaneChunk::OnGeoDataRemoved(const FARTrackedGeoData& data)
+{
+    if (IsValid(Renderer))
+        Renderer->OnChunkGeoDataRemoved(this, data.id_);
+}
+
+void AARPlaneChunk::OnRep_Renderer()
+{
+    if (!IsValid(Renderer))
+        return;
+
+    // items still waiting for their header are announced when it arrives
+    for (const FARTrackedGeoItem& item : GeoDataArray.Items)
+        if (item.data_.id_.IsValid())
+            Renderer->OnChunkGeoDataChanged(this, item.data_);
+}
@@ -0,0 +1,285 @@
+//
+// ARPlaneConsolidator.cpp
+//
+
+#include "ARPlaneConsolidator.h"
+#include "ARPolygonUtils.h"
+#include "EngineUtils.h"
+#include "Algo/Reverse.h"
+#include "Misc/Crc.h"
+#include "DDLog.h"
+
+AARPlaneConsolidator::AARPlaneConsolidator()
+{
+    ConsolidationInterval = 0.5f;
+    MergeMaxAngle = 5.f;
+    MergeMaxHeight = 5.f;
+    MergeOverlapMargin = 10.f;
+    SourcePlaneCount = 0;
+    ConsolidatedPlaneCount = 0;
+    LastSourceSignature = 0;
+    LastConsolidationTime = 0.f;
+    bTracksARPlanes = false;
+    bConsolidatePlanes = false;
+}
+
+void AARPlaneConsolidator::Tick(float DeltaTime)
+{
+    // canonical planes are queued before renderer tick builds their meshes and chunks
+    if (HasAuthority() && GetWorld()->GetTimeSeconds() - LastConsolidationTime >= ConsolidationInterval)
+        Consolidate();
+
+    Super::Tick(DeltaTime);
+}
+
+void AARPlaneConsolidator::Consolidate()
+{
+    LastConsolidationTime = GetWorld()->GetTimeSeconds();
+
+    TArray<FSourcePlane> sources;
+    uint32 signature = 0;
+
+    for (TActorIterator<AARPlaneRenderer> it(GetWorld()); it; ++it)
+    {
+        if (*it == this || !it->IsConsolidationSource())
+            continue;
+
+        for (const FARTrackedGeoItem& item : it->GeoDataArray.Items)
+        {
+            const FARTrackedGeoData& data = item.data_;
+            if (data.boundaryVerts_.Num() < 3)
+                continue;
+
+            signature = FCrc::MemCrc32(&data.id_, sizeof(data.id_), signature);
+            signature = FCrc::MemCrc32(&data.revision_, sizeof(data.revision_), signature);
+
+            FSourcePlane& source = sources.AddDefaulted_GetRef();
+            source.data_ = &data;
+            source.normal_ = data.localToWorld_.TransformVectorNoScale(FVector::UpVector);
+            source.worldBox_ = FBox(ForceInit);
+            source.localBox_ = FBox2D(ForceInit);
+
+            TArray<FVector2D> boundary2D;
+            for (const FVector& v : data.boundaryVerts_)
+            {
+                source.worldBox_ += data.localToWorld_.TransformPosition(v);
+                source.localBox_ += FVector2D(v.X, v.Y);
+                boundary2D.Add(FVector2D(v.X, v.Y));
+            }
+
+            FVector2D localCenter = source.localBox_.GetCenter();
+            source.center_ = data.localToWorld_.TransformPosition(FVector(localCenter.X, localCenter.Y, 0.f));
+            source.area_ = FMath::Abs(ARPolygonUtils::SignedArea(boundary2D));
+        }
+    }
+
+    // no source plane was added, removed or changed since last pass
+    if (signature == LastSourceSignature && sources.Num() == SourcePlaneCount)
+        return;
+
+    LastSourceSignature = signature;
+    SourcePlaneCount = sources.Num();
+
+    // merge candidates come from the spatial index, exact tests from CanMerge
+    FARPlaneSpatialIndex index(PlaneIndexCellSize);
+    TMap<FGuid, int32> sourceById;
+    for (int32 i = 0; i < sources.Num(); ++i)
+    {
+        index.Update(*sources[i].data_);
+        sourceById.Add(sources[i].data_->id_, i);
+    }
+
+    TArray<int32> parent;
+    parent.SetNumUninitialized(sources.Num());
+    for (int32 i = 0; i < parent.Num(); ++i)
+        parent[i] = i;
+
+    auto findRoot = [&parent](int32 i)
+    {
+        while (parent[i] != i)
+            i = parent[i] = parent[parent[i]];
+        return i;
+    };
+
+    float minNormalDot = FMath::Cos(FMath::DegreesToRadians(MergeMaxAngle));
+    TArray<FGuid> candidates;
+
+    for (int32 i = 0; i < sources.Num(); ++i)
+    {
+        candidates.Reset();
+        index.Overlap(sources[i].worldBox_.ExpandBy(MergeOverlapMargin + MergeMaxHeight), candidates);
+
+        for (const FGuid& id : candidates)
+        {
+            int32 j = sourceById.FindChecked(id);
+
+            if (j > i && findRoot(i) != findRoot(j) && CanMerge(sources[i], sources[j], minNormalDot))
+                parent[findRoot(j)] = findRoot(i);
+        }
+    }
+
+    TMap<int32, TArray<const FSourcePlane*>> clusterByRoot;
+    for (int32 i = 0; i < sources.Num(); ++i)
+        clusterByRoot.FindOrAdd(findRoot(i)).Add(&sources[i]);
+
+    TArray<TArray<const FSourcePlane*>> clusters;
+    clusterByRoot.GenerateValueArray(clusters);
+
+    // larger clusters pick ids first, so a split keeps the id on its larger part
+    clusters.Sort([](const TArray<const FSourcePlane*>& a, const TArray<const FSourcePlane*>& b) { return a.Num() > b.Num(); });
+
+    TArray<FARTrackedGeoData> canonical;
+    TMap<FGuid, FGuid> sourceToCanonical;
+    TSet<FGuid> claimed;
+
+    for (const TArray<const FSourcePlane*>& cluster : clusters)
+    {
+        FARTrackedGeoData& data = canonical.AddDefaulted_GetRef();
+        MergeCluster(cluster, data);
+
+        // id of the canonical plane members went into last time, or a member's own id
+        for (const FSourcePlane* source : cluster)
+        {
+            const FGuid* previous = SourceToCanonical.Find(source->data_->id_);
+            if (previous && !claimed.Contains(*previous))
+            {
+                data.id_ = *previous;
+                break;
+            }
+        }
+
+        for (int32 i = 0; i < cluster.Num() && !data.id_.IsValid(); ++i)
+            if (!claimed.Contains(cluster[i]->data_->id_))
+                data.id_ = cluster[i]->data_->id_;
+
+        if (!data.id_.IsValid())
+            data.id_ = FGuid::NewGuid();
+
+        claimed.Add(data.id_);
+
+        for (const FSourcePlane* source : cluster)
+            sourceToCanonical.Add(source->data_->id_, data.id_);
+    }
+
+    SourceToCanonical = MoveTemp(sourceToCanonical);
+    ConsolidatedPlaneCount = canonical.Num();
+
+    DLOG_MODULE_DEBUG(DDAugmented, "Consolidated {} planes into {}", SourcePlaneCount, ConsolidatedPlaneCount);
+
+    ApplyCanonicalPlanes(canonical);
+}
+
+bool AARPlaneConsolidator::CanMerge(const FSourcePlane& a, const FSourcePlane& b, float minNormalDot) const
+{
+    // opposite normals (floor and the table top seen from below) never merge
+    if (FVector::DotProduct(a.normal_, b.normal_) < minNormalDot)
+        return false;
+
+    const FTransform& aToWorld = a.data_->localToWorld_;
+    if (FMath::Abs(FVector::DotProduct(b.center_ - aToWorld.GetLocation(), a.normal_)) > MergeMaxHeight)
+        return false;
+
+    // b's boundary bounds in a's plane
+    FBox2D bBox(ForceInit);
+    for (const FVector& v : b.data_->boundaryVerts_)
+    {
+        FVector p = aToWorld.InverseTransformPosition(b.data_->localToWorld_.TransformPosition(v));
+        bBox += FVector2D(p.X, p.Y);
+    }
+
+    return a.localBox_.ExpandBy(MergeOverlapMargin).Intersect(bBox);
+}
+
+void AARPlaneConsolidator::MergeCluster(const TArray<const FSourcePlane*>& cluster, FARTrackedGeoData& outData) const
+{
+    const FSourcePlane* anchor = cluster[0];
+    for (const FSourcePlane* source : cluster)
+        if (source->area_ > anchor->area_)
+            anchor = source;
+
+    const FARTrackedGeoData& anchorData = *anchor->data_;
+    outData.localToWorld_ = anchorData.localToWorld_;
+    outData.localToTracking_ = anchorData.localToTracking_;
+    outData.debugName_ = anchorData.debugName_;
+    outData.color_ = anchorData.color_;
+
+    if (cluster.Num() == 1)
+    {
+        outData.boundaryVerts_ = anchorData.boundaryVerts_;
+        return;
+    }
+
+    // concave union is approximated by the convex hull of all boundaries in the anchor's plane
+    TArray<FVector2D> points;
+    for (const FSourcePlane* source : cluster)
+    {
+        for (const FVector& v : source->data_->boundaryVerts_)
+        {
+            FVector p = anchorData.localToWorld_.InverseTransformPosition(source->data_->localToWorld_.TransformPosition(v));
+            points.Add(FVector2D(p.X, p.Y));
+        }
+    }
+
+    TArray<FVector2D> hull;
+    ARPolygonUtils::ConvexHull(points, hull);
+
+    // keep the winding AR boundaries come with
+    TArray<FVector2D> anchorBoundary;
+    for (const FVector& v : anchorData.boundaryVerts_)
+        anchorBoundary.Add(FVector2D(v.X, v.Y));
+
+    if (ARPolygonUtils::SignedArea(anchorBoundary) < 0.f)
+        Algo::Reverse(hull);
+
+    TArray<FVector> hull3D;
+    hull3D.Reserve(hull.Num());
+    for (const FVector2D& p : hull)
+        hull3D.Add(FVector(p.X, p.Y, 0.f));
+
+    ARPolygonUtils::SimplifyClosed(hull3D, BoundarySimplifyTolerance, MaxBoundaryVertices, outData.boundaryVerts_);
+}
+
+void AARPlaneConsolidator::ApplyCanonicalPlanes(TArray<FARTrackedGeoData>& canonical)
+{
+    TSet<FGuid> live;
+
+    for (FARTrackedGeoData& data : canonical)
+    {
+        live.Add(data.id_);
+
+        FARTrackedGeoItem* item = GeoDataArray.Find(data.id_);
+
+        if (!item)
+        {
+            data.netId_ = AllocateGeoNetId();
+            FARTrackedGeoItem& added = GeoDataArray.Add(data);
+            added.data_.UpdateRevision();
+            OnGeoDataAdded(added.data_);
+            continue;
+        }
+
+        // name and color stay as first assigned, so canonical planes don't flicker when their anchor changes
+        FARTrackedGeoData& current = item->data_;
+        current.boundaryVerts_ = MoveTemp(data.boundaryVerts_);
+        current.localToWorld_ = data.localToWorld_;
+        current.localToTracking_ = data.localToTracking_;
+
+        if (current.UpdateRevision())
+        {
+            GeoDataArray.MarkItemDirty(*item);
+            OnGeoDataChanged(current);
+        }
+    }
+
+    TArray<FGuid> stale;
+    for (const FARTrackedGeoItem& item : GeoDataArray.Items)
+        if (!live.Contains(item.data_.id_))
+            stale.Add(item.data_.id_);
+
+    for (const FGuid& id : stale)
+    {
+        FARTrackedGeoItem* item = GeoDataArray.Find(id);
+        OnGeoDataRemoved(item->data_);
+        GeoDataArray.Remove(id);
+    }
+}
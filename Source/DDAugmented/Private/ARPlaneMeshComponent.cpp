@@ -0,0 +1,442 @@
+//
+// ARPlaneMeshComponent.cpp
+//
+
+#include "ARPlaneMeshComponent.h"
+#include "PrimitiveSceneProxy.h"
+#include "DynamicMeshBuilder.h"
+#include "LocalVertexFactory.h"
+#include "Rendering/StaticMeshVertexBuffer.h"
+#include "Rendering/PositionVertexBuffer.h"
+#include "Rendering/ColorVertexBuffer.h"
+#include "StaticMeshResources.h"
+#include "Materials/Material.h"
+#include "SceneManagement.h"
+#include "RenderingThread.h"
+#include "RHI.h"
+
+namespace
+{
+    // plane geometry as sent to the render thread
+    struct FARPlaneRenderUpdate {
+        FGuid id_;
+        FMatrix localToComponent_;
+        FBoxSphereBounds localBounds_;
+        FARPlaneMeshData data_;
+    };
+
+    FBox CalcPlaneBox(const FARPlaneMeshData& data)
+    {
+        return data.positions_.Num() ? FBox(data.positions_) : FBox(ForceInit);
+    }
+
+    void UploadBuffer(FRHIVertexBuffer* buffer, const void* data, uint32 size)
+    {
+        void* dst = RHILockVertexBuffer(buffer, 0, size, RLM_WriteOnly);
+        FMemory::Memcpy(dst, data, size);
+        RHIUnlockVertexBuffer(buffer);
+    }
+}
+
+/**
+ * Render thread state of one plane: own vertex/index buffers and vertex factory.
+ */
+class FARPlaneRenderData
+{
+public:
+    FARPlaneRenderData(ERHIFeatureLevel::Type featureLevel)
+    : VertexFactory(featureLevel, "FARPlaneRenderData")
+    {}
+
+    ~FARPlaneRenderData()
+    {
+        VertexBuffers.PositionVertexBuffer.ReleaseResource();
+        VertexBuffers.StaticMeshVertexBuffer.ReleaseResource();
+        VertexBuffers.ColorVertexBuffer.ReleaseResource();
+        IndexBuffer.ReleaseResource();
+        VertexFactory.ReleaseResource();
+    }
+
+    // allocates GPU buffers sized for the plane
+    void Init(const FARPlaneMeshData& data)
+    {
+        TArray<FDynamicMeshVertex> vertices;
+        vertices.Reserve(data.positions_.Num());
+
+        for (int32 i = 0; i < data.positions_.Num(); ++i)
+            vertices.Add(FDynamicMeshVertex(data.positions_[i], FVector::ForwardVector, FVector::UpVector,
+                                            data.uvs_[i], data.colors_[i]));
+
+        // inits vertex buffers and binds vertex factory
+        VertexBuffers.InitFromDynamicVertex(&VertexFactory, vertices);
+
+        IndexBuffer.Indices = data.indices_;
+        // proxy constructor runs on game thread, updates -- on render thread
+        if (IsInRenderingThread())
+            IndexBuffer.InitResource();
+        else
+            BeginInitResource(&IndexBuffer);
+
+        NumVertices = data.positions_.Num();
+        NumIndices = data.indices_.Num();
+    }
+
+    bool CanUpdateInPlace(const FARPlaneMeshData& data) const
+    {
+        return NumVertices == data.positions_.Num() && NumIndices == data.indices_.Num();
+    }
+
+    // rewrites existing GPU buffers, no reallocation
+    void UpdateInPlace(const FARPlaneMeshData& data)
+    {
+        FPositionVertexBuffer& positions = VertexBuffers.PositionVertexBuffer;
+        FStaticMeshVertexBuffer& uvs = VertexBuffers.StaticMeshVertexBuffer;
+        FColorVertexBuffer& colors = VertexBuffers.ColorVertexBuffer;
+
+        for (int32 i = 0; i < NumVertices; ++i)
+        {
+            positions.VertexPosition(i) = data.positions_[i];
+            uvs.SetVertexUV(i, 0, data.uvs_[i]);
+            colors.VertexColor(i) = data.colors_[i];
+        }
+
+        UploadBuffer(positions.VertexBufferRHI, positions.GetVertexData(), positions.GetNumVertices() * positions.GetStride());
+        UploadBuffer(uvs.TexCoordVertexBuffer.VertexBufferRHI, uvs.GetTexCoordData(), uvs.GetTexCoordSize());
+        UploadBuffer(colors.VertexBufferRHI, colors.GetVertexData(), colors.GetNumVertices() * colors.GetStride());
+
+        // triangulation may change with the same vertex count
+        if (FMemory::Memcmp(IndexBuffer.Indices.GetData(), data.indices_.GetData(), NumIndices * sizeof(uint32)) != 0)
+        {
+            IndexBuffer.Indices = data.indices_;
+
+            void* dst = RHILockIndexBuffer(IndexBuffer.IndexBufferRHI, 0, NumIndices * sizeof(uint32), RLM_WriteOnly);
+            FMemory::Memcpy(dst, IndexBuffer.Indices.GetData(), NumIndices * sizeof(uint32));
+            RHIUnlockIndexBuffer(IndexBuffer.IndexBufferRHI);
+        }
+    }
+
+    FStaticMeshVertexBuffers VertexBuffers;
+    FDynamicMeshIndexBuffer32 IndexBuffer;
+    FLocalVertexFactory VertexFactory;
+
+    FMatrix LocalToComponent;
+    FBoxSphereBounds LocalBounds;
+
+    int32 NumVertices = 0;
+    int32 NumIndices = 0;
+
+    bool Visible = true;
+};
+
+/**
+ * Draws every plane with its own mesh batch and per-plane primitive uniform buffer,
+ * so pose changes never touch vertex data.
+ */
+class FARPlaneSceneProxy final : public FPrimitiveSceneProxy
+{
+public:
+    FARPlaneSceneProxy(UARPlaneMeshComponent* component)
+    : FPrimitiveSceneProxy(component)
+    , MaterialRelevance(component->GetMaterialRelevance(GetScene().GetFeatureLevel()))
+    {
+        UMaterialInterface* material = component->GetMaterial(0);
+        if (!material)
+            material = UMaterial::GetDefaultMaterial(MD_Surface);
+
+        MaterialProxy = material->GetRenderProxy();
+
+        for (const auto& it : component->Planes)
+        {
+            FARPlaneRenderData* plane = new FARPlaneRenderData(GetScene().GetFeatureLevel());
+            plane->Init(it.Value.data_);
+            plane->LocalToComponent = it.Value.localToComponent_.ToMatrixWithScale();
+            plane->LocalBounds = FBoxSphereBounds(it.Value.localBox_);
+            plane->Visible = it.Value.visible_;
+            Planes.Add(it.Key, plane);
+        }
+    }
+
+    virtual ~FARPlaneSceneProxy()
+    {
+        for (auto& it : Planes)
+            delete it.Value;
+    }
+
+    void UpdatePlane_RenderThread(FARPlaneRenderUpdate& update)
+    {
+        check(IsInRenderingThread());
+
+        FARPlaneRenderData** existing = Planes.Find(update.id_);
+        FARPlaneRenderData* plane = existing ? *existing : nullptr;
+
+        if (plane && plane->CanUpdateInPlace(update.data_))
+        {
+            plane->UpdateInPlace(update.data_);
+        }
+        else
+        {
+            bool visible = plane ? plane->Visible : true;
+
+            delete plane;
+            plane = new FARPlaneRenderData(GetScene().GetFeatureLevel());
+            plane->Init(update.data_);
+            plane->Visible = visible;
+            Planes.Add(update.id_, plane);
+        }
+
+        plane->LocalToComponent = update.localToComponent_;
+        plane->LocalBounds = update.localBounds_;
+    }
+
+    void UpdatePlaneTransform_RenderThread(const FGuid& id, const FMatrix& localToComponent)
+    {
+        check(IsInRenderingThread());
+
+        FARPlaneRenderData** plane = Planes.Find(id);
+        if (plane)
+            (*plane)->LocalToComponent = localToComponent;
+    }
+
+    void SetPlaneVisible_RenderThread(const FGuid& id, bool visible)
+    {
+        check(IsInRenderingThread());
+
+        FARPlaneRenderData** plane = Planes.Find(id);
+        if (plane)
+            (*plane)->Visible = visible;
+    }
+
+    void RemovePlane_RenderThread(const FGuid& id)
+    {
+        check(IsInRenderingThread());
+
+        FARPlaneRenderData* plane = nullptr;
+        if (Planes.RemoveAndCopyValue(id, plane))
+            delete plane;
+    }
+
+    virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap, FMeshElementCollector& Collector) const override
+    {
+        bool bHasPrecomputedVolumetricLightmap;
+        FMatrix PreviousLocalToWorld;
+        int32 SingleCaptureIndex;
+        bool bOutputVelocity;
+        GetScene().GetPrimitiveUniformShaderParameters_RenderThread(GetPrimitiveSceneInfo(), bHasPrecomputedVolumetricLightmap, PreviousLocalToWorld, SingleCaptureIndex, bOutputVelocity);
+
+        for (const auto& it : Planes)
+        {
+            const FARPlaneRenderData* plane = it.Value;
+
+            if (plane->NumIndices == 0 || !plane->Visible)
+                continue;
+
+            FMatrix localToWorld = plane->LocalToComponent * GetLocalToWorld();
+            FBoxSphereBounds worldBounds = plane->LocalBounds.TransformBy(localToWorld);
+
+            for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+            {
+                if (!(VisibilityMap & (1 << ViewIndex)))
+                    continue;
+
+                FMeshBatch& Mesh = Collector.AllocateMesh();
+                FMeshBatchElement& BatchElement = Mesh.Elements[0];
+                BatchElement.IndexBuffer = &plane->IndexBuffer;
+                Mesh.bWireframe = false;
+                Mesh.VertexFactory = &plane->VertexFactory;
+                Mesh.MaterialRenderProxy = MaterialProxy;
+
+                FDynamicPrimitiveUniformBuffer& DynamicPrimitiveUniformBuffer = Collector.AllocateOneFrameResource<FDynamicPrimitiveUniformBuffer>();
+                DynamicPrimitiveUniformBuffer.Set(localToWorld, plane->LocalToComponent * PreviousLocalToWorld, worldBounds, plane->LocalBounds, true, bHasPrecomputedVolumetricLightmap, DrawsVelocity(), bOutputVelocity);
+                BatchElement.PrimitiveUniformBufferResource = &DynamicPrimitiveUniformBuffer.UniformBuffer;
+
+                BatchElement.FirstIndex = 0;
+                BatchElement.NumPrimitives = plane->NumIndices / 3;
+                BatchElement.MinVertexIndex = 0;
+                BatchElement.MaxVertexIndex = plane->NumVertices - 1;
+                Mesh.ReverseCulling = localToWorld.Determinant() < 0.f;
+                Mesh.Type = PT_TriangleList;
+                Mesh.DepthPriorityGroup = SDPG_World;
+                Mesh.bCanApplyViewModeOverrides = false;
+                Collector.AddMesh(ViewIndex, Mesh);
+            }
+        }
+    }
+
+    virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const override
+    {
+        FPrimitiveViewRelevance Result;
+        Result.bDrawRelevance = IsShown(View);
+        Result.bShadowRelevance = IsShadowCast(View);
+        Result.bDynamicRelevance = true;
+        Result.bRenderInMainPass = ShouldRenderInMainPass();
+        Result.bUsesLightingChannels = GetLightingChannelMask() != GetDefaultLightingChannelMask();
+        Result.bRenderCustomDepth = ShouldRenderCustomDepth();
+        Result.bTranslucentSelfShadow = bCastVolumetricTranslucentShadow;
+        MaterialRelevance.SetPrimitiveViewRelevance(Result);
+        Result.bVelocityRelevance = IsMovable() && Result.bOpaque && Result.bRenderInMainPass;
+        return Result;
+    }
+
+    virtual bool CanBeOccluded() const override
+    {
+        return !MaterialRelevance.bDisableDepthTest;
+    }
+
+    virtual uint32 GetMemoryFootprint() const override
+    {
+        return sizeof(*this) + GetAllocatedSize();
+    }
+
+    uint32 GetAllocatedSize() const
+    {
+        return FPrimitiveSceneProxy::GetAllocatedSize() + Planes.GetAllocatedSize();
+    }
+
+    virtual SIZE_T GetTypeHash() const override
+    {
+        static size_t UniquePointer;
+        return reinterpret_cast<size_t>(&UniquePointer);
+    }
+
+private:
+    TMap<FGuid, FARPlaneRenderData*> Planes;
+    FMaterialRenderProxy* MaterialProxy = nullptr;
+    FMaterialRelevance MaterialRelevance;
+};
+
+UARPlaneMeshComponent::UARPlaneMeshComponent(const FObjectInitializer& ObjectInitializer)
+: Super(ObjectInitializer)
+, LocalBounds(ForceInit)
+{
+    SetCollisionEnabled(ECollisionEnabled::NoCollision);
+    CastShadow = false;
+}
+
+void UARPlaneMeshComponent::UpdatePlane(const FGuid& id, const FTransform& localToComponent, FARPlaneMeshData&& data)
+{
+    check(data.positions_.Num() == data.uvs_.Num() && data.positions_.Num() == data.colors_.Num());
+
+    // GPU buffers can't be empty
+    if (data.indices_.Num() == 0)
+    {
+        RemovePlane(id);
+        return;
+    }
+
+    FPlaneEntry& plane = Planes.FindOrAdd(id);
+    plane.data_ = MoveTemp(data);
+    plane.localToComponent_ = localToComponent;
+    plane.localBox_ = CalcPlaneBox(plane.data_);
+
+    FARPlaneSceneProxy* proxy = (FARPlaneSceneProxy*)SceneProxy;
+    if (proxy)
+    {
+        // proxy gets its own copy, game thread copy is kept for proxy recreation
+        FARPlaneRenderUpdate update{ id, localToComponent.ToMatrixWithScale(), FBoxSphereBounds(plane.localBox_), plane.data_ };
+
+        ENQUEUE_RENDER_COMMAND(FARPlaneMeshUpdate)(
+            [proxy, update = MoveTemp(update)](FRHICommandListImmediate& RHICmdList) mutable
+            {
+                proxy->UpdatePlane_RenderThread(update);
+            });
+    }
+
+    PlaneBoundsChanged();
+}
+
+void UARPlaneMeshComponent::UpdatePlaneTransform(const FGuid& id, const FTransform& localToComponent)
+{
+    FPlaneEntry* plane = Planes.Find(id);
+    if (!plane)
+        return;
+
+    plane->localToComponent_ = localToComponent;
+
+    FARPlaneSceneProxy* proxy = (FARPlaneSceneProxy*)SceneProxy;
+    if (proxy)
+    {
+        FMatrix matrix = localToComponent.ToMatrixWithScale();
+
+        ENQUEUE_RENDER_COMMAND(FARPlaneMeshTransform)(
+            [proxy, id, matrix](FRHICommandListImmediate& RHICmdList)
+            {
+                proxy->UpdatePlaneTransform_RenderThread(id, matrix);
+            });
+    }
+
+    PlaneBoundsChanged();
+}
+
+void UARPlaneMeshComponent::SetPlaneVisible(const FGuid& id, bool visible)
+{
+    FPlaneEntry* plane = Planes.Find(id);
+    if (!plane || plane->visible_ == visible)
+        return;
+
+    plane->visible_ = visible;
+
+    FARPlaneSceneProxy* proxy = (FARPlaneSceneProxy*)SceneProxy;
+    if (proxy)
+    {
+        ENQUEUE_RENDER_COMMAND(FARPlaneMeshVisibility)(
+            [proxy, id, visible](FRHICommandListImmediate& RHICmdList)
+            {
+                proxy->SetPlaneVisible_RenderThread(id, visible);
+            });
+    }
+}
+
+void UARPlaneMeshComponent::RemovePlane(const FGuid& id)
+{
+    if (!Planes.Remove(id))
+        return;
+
+    FARPlaneSceneProxy* proxy = (FARPlaneSceneProxy*)SceneProxy;
+    if (proxy)
+    {
+        ENQUEUE_RENDER_COMMAND(FARPlaneMeshRemove)(
+            [proxy, id](FRHICommandListImmediate& RHICmdList)
+            {
+                proxy->RemovePlane_RenderThread(id);
+            });
+    }
+
+    PlaneBoundsChanged();
+}
+
+void UARPlaneMeshComponent::RemoveAllPlanes()
+{
+    Planes.Reset();
+    LocalBounds = FBox(ForceInit);
+    MarkRenderStateDirty();
+    UpdateBounds();
+}
+
+FPrimitiveSceneProxy* UARPlaneMeshComponent::CreateSceneProxy()
+{
+    return new FARPlaneSceneProxy(this);
+}
+
+FBoxSphereBounds UARPlaneMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+    if (!LocalBounds.IsValid)
+        return FBoxSphereBounds(LocalToWorld.GetLocation(), FVector::ZeroVector, 0.f);
+
+    return FBoxSphereBounds(LocalBounds).TransformBy(LocalToWorld);
+}
+
+void UARPlaneMeshComponent::PlaneBoundsChanged()
+{
+    FBox bounds(ForceInit);
+    for (const auto& it : Planes)
+        if (it.Value.localBox_.IsValid)
+            bounds += it.Value.localBox_.TransformBy(it.Value.localToComponent_);
+
+    // proxy bounds only need an update when the union actually moved
+    if (bounds == LocalBounds)
+        return;
+
+    LocalBounds = bounds;
+    UpdateBounds();
+    MarkRenderTransformDirty();
+}
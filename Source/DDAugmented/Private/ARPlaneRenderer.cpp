@@ -13,10 +13,309 @@
 // limitations under the License.
 
 #include "ARPlaneRenderer.h"
+#include "ARPlaneMeshComponent.h"
+#include "ARPlaneChunk.h"
 #include "Materials/MaterialInstanceDynamic.h"
 #include "ARBlueprintLibrary.h"
 #include <Net/UnrealNetwork.h>
 #include "DDLog.h"
+#include "Misc/Crc.h"
+#include "Serialization/BitWriter.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "ARPolygonUtils.h"
+#include "GameFramework/PlayerController.h"
+#include "Camera/PlayerCameraManager.h"
+
+bool FARTrackedGeoData::UpdateRevision()
+{
+    uint32 boundaryHash = FCrc::MemCrc32(boundaryVerts_.GetData(), boundaryVerts_.Num() * sizeof(FVector));
+    
+    // hash components separately -- FTransform may carry SIMD padding
+    FVector translation = localToWorld_.GetTranslation();
+    FQuat rotation = localToWorld_.GetRotation();
+    FVector scale = localToWorld_.GetScale3D();
+    uint32 poseHash = FCrc::MemCrc32(&translation, sizeof(translation));
+    poseHash = FCrc::MemCrc32(&rotation, sizeof(rotation), poseHash);
+    poseHash = FCrc::MemCrc32(&scale, sizeof(scale), poseHash);
+    
+    if (boundaryHash == boundaryHash_ && poseHash == poseHash_)
+        return false;
+    
+    boundaryHash_ = boundaryHash;
+    poseHash_ = poseHash;
+    revision_++;
+    
+    return true;
+}
+
+bool FARTrackedGeoData::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+    uint32 netId = netId_;
+    Ar.SerializeIntPacked(netId);
+    
+    if (netId > MAX_uint16)
+    {
+        Ar.SetError();
+        bOutSuccess = false;
+        return true;
+    }
+    
+    netId_ = (uint16)netId;
+    
+    // mapped planes get identity from their header
+    if (netId_ == 0)
+    {
+        Ar << id_;
+        Ar << debugName_;
+    }
+    
+    Ar << color_;
+    
+    ARGeoQuantize::SerializeTransform(Ar, localToWorld_);
+    ARGeoQuantize::SerializeTransform(Ar, localToTracking_);
+    
+    uint32 nVerts = boundaryVerts_.Num();
+    Ar.SerializeIntPacked(nVerts);
+    
+    if (Ar.IsLoading())
+    {
+        if (nVerts > (uint32)ARGeoQuantize::kMaxBoundaryVertices)
+        {
+            Ar.SetError();
+            bOutSuccess = false;
+            return true;
+        }
+        
+        boundaryVerts_.SetNumUninitialized(nVerts);
+    }
+    
+    // boundary is planar in plane local space -- z is not sent
+    for (FVector& v : boundaryVerts_)
+    {
+        int16 x = ARGeoQuantize::QuantizePosition(v.X);
+        int16 y = ARGeoQuantize::QuantizePosition(v.Y);
+        Ar << x;
+        Ar << y;
+        
+        if (Ar.IsLoading())
+            v = FVector(ARGeoQuantize::DequantizePosition(x), ARGeoQuantize::DequantizePosition(y), 0.f);
+    }
+    
+    bOutSuccess = !Ar.IsError();
+    return true;
+}
+
+void FARTrackedGeoItem::PreReplicatedRemove(const FARTrackedGeoArray& InArraySerializer)
+{
+    InArraySerializer.MarkIndexDirty();
+    
+    if (data_.id_.IsValid())
+        InArraySerializer.NotifyRemoved(data_);
+    else
+        InArraySerializer.NumUnresolved--;
+}
+
+void FARTrackedGeoItem::PostReplicatedAdd(const FARTrackedGeoArray& InArraySerializer)
+{
+    InArraySerializer.MarkIndexDirty();
+    
+    if (InArraySerializer.ResolveHeader(data_))
+        InArraySerializer.NotifyAdded(data_);
+}
+
+void FARTrackedGeoItem::PostReplicatedChange(const FARTrackedGeoArray& InArraySerializer)
+{
+    // changes to items still waiting for their header are picked up on add
+    if (data_.id_.IsValid())
+        InArraySerializer.NotifyChanged(data_);
+}
+
+void FARTrackedGeoHeader::PostReplicatedAdd(const FARTrackedGeoHeaderArray& InArraySerializer)
+{
+    InArraySerializer.MarkIndexDirty();
+    
+    if (InArraySerializer.Geo)
+        InArraySerializer.Geo->OnHeaderAdded(*this);
+}
+
+const FARTrackedGeoHeader* FARTrackedGeoHeaderArray::Find(uint16 netId) const
+{
+    if (bIndexDirty)
+        RebuildIndex();
+    
+    const int32* idx = IndexByNetId.Find(netId);
+    
+    return idx && Items.IsValidIndex(*idx) && Items[*idx].netId_ == netId ? &Items[*idx] : nullptr;
+}
+
+void FARTrackedGeoHeaderArray::Add(const FARTrackedGeoData& data)
+{
+    if (bIndexDirty)
+        RebuildIndex();
+    
+    int32 idx = Items.AddDefaulted();
+    FARTrackedGeoHeader& header = Items[idx];
+    header.netId_ = data.netId_;
+    header.id_ = data.id_;
+    header.debugName_ = data.debugName_;
+    IndexByNetId.Add(data.netId_, idx);
+    MarkItemDirty(header);
+}
+
+void FARTrackedGeoHeaderArray::Remove(uint16 netId)
+{
+    if (!Find(netId))
+        return;
+    
+    int32 idx = IndexByNetId.FindAndRemoveChecked(netId);
+    
+    Items.RemoveAtSwap(idx);
+    if (Items.IsValidIndex(idx))
+        IndexByNetId.Add(Items[idx].netId_, idx);
+    
+    MarkArrayDirty();
+}
+
+void FARTrackedGeoHeaderArray::RebuildIndex() const
+{
+    IndexByNetId.Reset();
+    
+    for (int32 i = 0; i < Items.Num(); ++i)
+        IndexByNetId.Add(Items[i].netId_, i);
+    
+    bIndexDirty = false;
+}
+
+bool FARTrackedGeoArray::ResolveHeader(FARTrackedGeoData& data) const
+{
+    if (data.netId_ == 0)
+        return true;
+    
+    const FARTrackedGeoHeader* header = Headers ? Headers->Find(data.netId_) : nullptr;
+    
+    if (!header)
+    {
+        NumUnresolved++;
+        return false;
+    }
+    
+    data.id_ = header->id_;
+    data.debugName_ = header->debugName_;
+    
+    return true;
+}
+
+void FARTrackedGeoArray::OnHeaderAdded(const FARTrackedGeoHeader& header)
+{
+    // headers normally arrive ahead of their planes
+    if (NumUnresolved == 0)
+        return;
+    
+    for (FARTrackedGeoItem& item : Items)
+    {
+        FARTrackedGeoData& data = item.data_;
+        
+        if (data.netId_ == header.netId_ && !data.id_.IsValid())
+        {
+            data.id_ = header.id_;
+            data.debugName_ = header.debugName_;
+            NumUnresolved--;
+            MarkIndexDirty();
+            NotifyAdded(data);
+        }
+    }
+}
+
+void FARTrackedGeoArray::NotifyAdded(const FARTrackedGeoData& data) const
+{
+    if (Owner)
+        Owner->OnGeoDataAdded(data);
+    else if (Chunk)
+        Chunk->OnGeoDataAdded(data);
+}
+
+void FARTrackedGeoArray::NotifyChanged(const FARTrackedGeoData& data) const
+{
+    if (Owner)
+        Owner->OnGeoDataChanged(data);
+    else if (Chunk)
+        Chunk->OnGeoDataChanged(data);
+}
+
+void FARTrackedGeoArray::NotifyRemoved(const FARTrackedGeoData& data) const
+{
+    if (Owner)
+        Owner->OnGeoDataRemoved(data);
+    else if (Chunk)
+        Chunk->OnGeoDataRemoved(data);
+}
+
+FARTrackedGeoItem* FARTrackedGeoArray::Find(const FGuid& id)
+{
+    if (bIndexDirty)
+        RebuildIndex();
+    
+    const int32* idx = IndexById.Find(id);
+    
+    if (idx && !(Items.IsValidIndex(*idx) && Items[*idx].data_.id_ == id))
+    {
+        // stale entry -- items were changed bypassing Add/Remove
+        RebuildIndex();
+        idx = IndexById.Find(id);
+    }
+    
+    return idx ? &Items[*idx] : nullptr;
+}
+
+FARTrackedGeoItem& FARTrackedGeoArray::Add(const FARTrackedGeoData& data)
+{
+    if (bIndexDirty)
+        RebuildIndex();
+    
+    int32 idx = Items.AddDefaulted();
+    FARTrackedGeoItem& item = Items[idx];
+    item.data_ = data;
+    IndexById.Add(data.id_, idx);
+    MarkItemDirty(item);
+    
+    if (Headers && data.netId_)
+        Headers->Add(data);
+    
+    return item;
+}
+
+bool FARTrackedGeoArray::Remove(const FGuid& id)
+{
+    if (!Find(id))
+        return false;
+    
+    int32 idx = IndexById.FindAndRemoveChecked(id);
+    
+    if (Headers && Items[idx].data_.netId_)
+        Headers->Remove(Items[idx].data_.netId_);
+    
+    // swap keeps removal O(1) -- only the moved item needs its index patched
+    Items.RemoveAtSwap(idx);
+    if (Items.IsValidIndex(idx))
+        IndexById.Add(Items[idx].data_.id_, idx);
+    
+    MarkArrayDirty();
+    
+    return true;
+}
+
+void FARTrackedGeoArray::RebuildIndex()
+{
+    IndexById.Reset();
+    
+    // items waiting for their header have no id yet
+    for (int32 i = 0; i < Items.Num(); ++i)
+        if (Items[i].data_.id_.IsValid())
+            IndexById.Add(Items[i].data_.id_, i);
+    
+    bIndexDirty = false;
+}
 
 // Sets default values
 AARPlaneRenderer::AARPlaneRenderer()
@@ -26,20 +325,134 @@ AARPlaneRenderer::AARPlaneRenderer()
 	PrimaryActorTick.bCanEverTick = true;
 	EdgeFeatheringDistance = 10.0f;
 	NewPlaneIndex = 0.0f;
+    bSkipUnchangedGeometry = true;
+    MeshRebuildCount = 0;
+    MeshRebuildSkippedCount = 0;
+    PoseOnlyUpdateCount = 0;
+    GeoKeyframeInterval = 1.0f;
+    PlaneRenderMode = EARPlaneRenderMode::PerPlaneComponent;
+    ActiveRenderMode = EARPlaneRenderMode::PerPlaneComponent;
+    MergedPlaneMaterial = nullptr;
+    MergedMeshComponent = nullptr;
+    MergedIndicesHash = 0;
+    bMergedMeshDirty = false;
+    PlaneBuffersComponent = nullptr;
+    MaxPooledPlaneComponents = 32;
+    PrewarmPlaneComponents = 8;
+    PlaneComponentPoolHits = 0;
+    PlaneComponentPoolMisses = 0;
+    GeoReconcileInterval = 2.0f;
+    LastGeoReconcileTime = 0.f;
+    MaxGeoUpdateRate = 15.0f;
+    GeoUpdateByteBudget = 1000;
+    GeoUpdateBatchCount = 0;
+    GeoUpdateBytesSent = 0;
+    LastGeoFlushTime = 0.f;
+    GeoSendCursor = 0;
+    bAsyncGeoMeshBuild = true;
+    GeoBuildSerial = 0;
+    TriangulationCacheHits = 0;
+    BoundarySimplifyTolerance = 2.0f;
+    MaxBoundaryVertices = 64;
+    BoundaryVerticesRaw = 0;
+    BoundaryVerticesSimplified = 0;
+    PlanePollInterval = 0.1f;
+    PlaneUpdateMinTranslation = 0.5f;
+    PlaneUpdateMinRotation = 0.5f;
+    PlaneUpdateMinExtentChange = 1.0f;
+    PlaneUpdateMinAreaChange = 0.05f;
+    PlaneUpdatesSuppressed = 0;
+    LastPlanePollTime = 0.f;
+    PlaneIndexCellSize = 200.f;
+    PlaneCullDistance = 3000.f;
+    bFrustumCullPlanes = true;
+    PlaneLODDistance = 1000.f;
+    PlaneLODSimplifyTolerance = 10.f;
+    PlaneVisibilityUpdateInterval = 0.2f;
+    CulledPlaneCount = 0;
+    LowDetailPlaneCount = 0;
+    LastPlaneVisibilityTime = 0.f;
+    bUsePlaneRelevancy = true;
+    PlaneRelevancyRadius = 5000.f;
+    PlaneRelevancyCellSize = 1000.f;
+    bPlaneRelevancyActive = false;
+    bConsolidatePlanes = false;
+    bPlanesConsolidatedActive = false;
+    bTracksARPlanes = true;
+    ActivePlaneRelevancyCellSize = 1000.f;
+    bUseTrackableEvents = true;
+    bTrackableEventsBound = false;
+    bTrackableEventsUnavailable = false;
+    bFullPlanePollRequested = false;
+    GeoDataArray.Owner = this;
+    GeoDataArray.Headers = &GeoHeaderArray;
+    GeoHeaderArray.Geo = &GeoDataArray;
+    NextGeoNetId = 0;
     bReplicates = true;
 }
 
 void AARPlaneRenderer::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const { Super::GetLifetimeReplicatedProps(OutLifetimeProps);
     
+    DOREPLIFETIME_CONDITION(AARPlaneRenderer, GeoHeaderArray, COND_SkipOwner);
     DOREPLIFETIME_CONDITION(AARPlaneRenderer, GeoDataArray, COND_SkipOwner);
 }
 
+void AARPlaneRenderer::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+    Super::PreReplication(ChangedPropertyTracker);
+    
+    // planes reach other clients through chunks or consolidator instead
+    bool replicatePlanes = !bPlaneRelevancyActive && !bPlanesConsolidatedActive;
+    DOREPLIFETIME_ACTIVE_OVERRIDE(AARPlaneRenderer, GeoHeaderArray, replicatePlanes);
+    DOREPLIFETIME_ACTIVE_OVERRIDE(AARPlaneRenderer, GeoDataArray, replicatePlanes);
+}
+
 // Called when the game starts or when spawned
 void AARPlaneRenderer::BeginPlay()
 {
     DLOG_MODULE_TRACE(DDAugmented, "AARPlaneRenderer");
     
 	Super::BeginPlay();
+    
+    // replication mode and chunk cell size are fixed for the lifetime of the actor
+    if (HasAuthority() && bConsolidatePlanes)
+        bPlanesConsolidatedActive = true;
+    
+    if (HasAuthority() && bUsePlaneRelevancy && !bPlanesConsolidatedActive)
+    {
+        bPlaneRelevancyActive = true;
+        ActivePlaneRelevancyCellSize = FMath::Max(PlaneRelevancyCellSize, 1.f);
+    }
+    
+    if (GetNetMode() != NM_DedicatedServer)
+    {
+        int32 nPrewarm = FMath::Min(PrewarmPlaneComponents, MaxPooledPlaneComponents);
+        
+        for (int32 i = PlaneComponentPool.Num(); i < nPrewarm; ++i)
+        {
+            UProceduralMeshComponent* PlanePolygonMeshComponent = CreatePlaneComponent();
+            PlanePolygonMeshComponent->SetVisibility(false, true);
+            PlaneComponentPool.Push(PlanePolygonMeshComponent);
+        }
+    }
+}
+
+void AARPlaneRenderer::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    UnbindTrackableEvents();
+    
+    for (const auto& it : PlaneChunks)
+        if (IsValid(it.Value))
+            it.Value->Destroy();
+    
+    PlaneChunks.Reset();
+    PlaneChunkCells.Reset();
+    
+    // worker threads write into GeoBuildsInFlight
+    if (GeoBuildTask.IsValid())
+        GeoBuildTask.Wait();
+    
+    Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
@@ -49,69 +462,248 @@ void AARPlaneRenderer::Tick(float DeltaTime)
     
     // process current AR planes on mobile only
 #if PLATFORM_ANDROID || PLATFORM_IOS
-    if (GetLocalRole() >= ROLE_AutonomousProxy)
+    if (bTracksARPlanes && GetLocalRole() >= ROLE_AutonomousProxy)
     {
-        if (UARBlueprintLibrary::GetTrackingQuality() == EARTrackingQuality::OrientationAndPosition)
+        if (bUseTrackableEvents && !bTrackableEventsBound && !bTrackableEventsUnavailable)
+            BindTrackableEvents();
+        
+        float now = GetWorld()->GetTimeSeconds();
+        
+        // with AR events only planes reported changed are visited; full polls happen
+        // right after subscribing and where AR system has no events
+        bool pollDue = bTrackableEventsBound ? bFullPlanePollRequested : now - LastPlanePollTime >= PlanePollInterval;
+        bool eventsPending = bTrackableEventsBound && ChangedPlanes.Num() > 0;
+        
+        if ((pollDue || eventsPending) &&
+            UARBlueprintLibrary::GetTrackingQuality() == EARTrackingQuality::OrientationAndPosition)
         {
-            TArray<UARTrackedGeometry*> AllGeometries = UARBlueprintLibrary::GetAllGeometries();
-            for (UARTrackedGeometry* Geometry : AllGeometries)
+            if (pollDue)
+            {
+                LastPlanePollTime = now;
+                bFullPlanePollRequested = false;
+                ChangedPlanes.Reset();
+                
+                TArray<UARTrackedGeometry*> AllGeometries = UARBlueprintLibrary::GetAllGeometries();
+                
+                for (UARTrackedGeometry* Geometry : AllGeometries)
+                {
+                    if (Geometry->IsA(UARPlaneGeometry::StaticClass()))
+                    {
+                        UARPlaneGeometry* PlaneGeometry = Cast<UARPlaneGeometry>(Geometry);
+                        PlaneSample.FromGeometry(PlaneGeometry);
+                        UpdatePlaneData(PlaneSample);
+                    }
+                }
+            }
+            else
             {
-                if (Geometry->IsA(UARPlaneGeometry::StaticClass()))
+                for (const TWeakObjectPtr<UARPlaneGeometry>& PlaneGeometry : ChangedPlanes)
                 {
-                    UARPlaneGeometry* PlaneGeometry = Cast<UARPlaneGeometry>(Geometry);
-                    UpdatePlaneData(PlaneGeometry);
+                    if (PlaneGeometry.IsValid())
+                    {
+                        PlaneSample.FromGeometry(PlaneGeometry.Get());
+                        UpdatePlaneData(PlaneSample);
+                    }
                 }
+                
+                ChangedPlanes.Reset();
             }
         }
     }
 #endif
     
-    TArray<UARTrackedGeoData*> oldGeoData;
-    GeoMeshMap.GetKeys(oldGeoData);
+    if (GetLocalRole() == ROLE_AutonomousProxy)
+        FlushGeoUpdates();
+    
+    if (GeoReconcileInterval > 0.f && GetWorld()->GetTimeSeconds() - LastGeoReconcileTime >= GeoReconcileInterval)
+        ReconcileGeoMeshes();
     
-    // process plane data and create meshes if needed
-    if (GeoDataArray.Num())
+    // render mode switch -- rebuild everything with the new mode
+    if (ActiveRenderMode != PlaneRenderMode)
     {
-//        DLOG_MODULE_DEBUG(DDAugmented, "GeoDataArray length {}", GeoDataArray.Num());
-        for (auto& data : GeoDataArray)
-        {
-            oldGeoData.Remove(data);
-            UpdateGeo(data);
-        }
+        ResetGeoMeshes();
+        ActiveRenderMode = PlaneRenderMode;
     }
     
+    // meshes built since last tick
+    CommitGeoMeshBuilds();
+    
     // remove old planes
-    if (oldGeoData.Num())
+    if (RemovedGeo.Num())
     {
-        DLOG_MODULE_DEBUG(DDAugmented, "Remove {} old planes", oldGeoData.Num());
+        DLOG_MODULE_DEBUG(DDAugmented, "Remove {} old planes", RemovedGeo.Num());
         
-        for (auto& data : oldGeoData)
+        for (const FGuid& id : RemovedGeo)
         {
-            UProceduralMeshComponent* PlanePolygonMeshComponent = *GeoMeshMap.Find(data);
+            RemoveGeoMesh(id);
+            PlaneIndex.Remove(id);
+            
+            if (bPlaneRelevancyActive)
+                RemovePlaneChunk(id);
+        }
         
-            if (PlanePolygonMeshComponent)
+        RemovedGeo.Reset();
+    }
+    
+    PlaneIndex.SetCellSize(PlaneIndexCellSize);
+    
+    // may queue planes whose detail level changed, or that were updated while culled
+    if (GetNetMode() != NM_DedicatedServer && GetWorld()->GetTimeSeconds() - LastPlaneVisibilityTime >= PlaneVisibilityUpdateInterval)
+        UpdatePlaneVisibility();
+    
+    // create or update meshes only for planes that changed since last tick
+    if (DirtyGeo.Num())
+    {
+        for (const FGuid& id : DirtyGeo)
+        {
+            FARTrackedGeoItem* item = GeoDataArray.Find(id);
+            if (item)
             {
-                PlanePolygonMeshComponent->DestroyComponent();
-                GeoMeshMap.Remove(data);
+                UpdateGeo(item->data_);
+                PlaneIndex.Update(item->data_);
+                
+                if (bPlaneRelevancyActive)
+                    UpdatePlaneChunk(item->data_);
             }
         }
+        
+        DirtyGeo.Reset();
+    }
+    
+    LaunchGeoMeshBuilds();
+    
+    if (bMergedMeshDirty)
+    {
+        if (ActiveRenderMode == EARPlaneRenderMode::Merged)
+            UpdateMergedGeoMesh();
+        
+        bMergedMeshDirty = false;
+    }
+}
+
+void AARPlaneRenderer::ResetMeshStats()
+{
+    MeshRebuildCount = 0;
+    MeshRebuildSkippedCount = 0;
+    PoseOnlyUpdateCount = 0;
+    GeoUpdateBatchCount = 0;
+    GeoUpdateBytesSent = 0;
+    PlaneComponentPoolHits = 0;
+    PlaneComponentPoolMisses = 0;
+    TriangulationCacheHits = 0;
+    PlaneUpdatesSuppressed = 0;
+}
+
+void AARPlaneRenderer::ReconcileGeoMeshes()
+{
+    LastGeoReconcileTime = GetWorld()->GetTimeSeconds();
+    
+    GeoMeshTracker.BeginPass();
+    
+    for (const FARTrackedGeoItem& item : GeoDataArray.Items)
+    {
+        // plane without a mesh -- creation callback was missed
+        if (GeoMeshTracker.Touch(item.data_.id_))
+        {
+            GeoMeshTracker.Remove(item.data_.id_);
+            DirtyGeo.Add(item.data_.id_);
+        }
+    }
+    
+    TArray<FGuid> staleGeo;
+    GeoMeshTracker.EndPass(staleGeo);
+    
+    if (staleGeo.Num())
+    {
+        DLOG_MODULE_DEBUG(DDAugmented, "Reconcile: {} stale plane meshes", staleGeo.Num());
+        RemovedGeo.Append(staleGeo);
+        
+        // tracker has dropped these already, RemoveGeoMesh won't report them
+        for (const FGuid& id : staleGeo)
+            OnPlaneRemoved.Broadcast(id);
     }
 }
 
-void AARPlaneRenderer::UpdatePlaneData(UARPlaneGeometry* ARCorePlaneObject)
+bool AARPlaneRenderer::RaycastPlanes(FVector Start, FVector End, FARPlaneQueryHit& OutHit) const
+{
+    return PlaneIndex.Raycast(Start, End, OutHit);
+}
+
+bool AARPlaneRenderer::FindNearestPlane(FVector Point, float MaxDistance, FARPlaneQueryHit& OutHit) const
+{
+    return PlaneIndex.FindNearest(Point, MaxDistance, OutHit);
+}
+
+TArray<FGuid> AARPlaneRenderer::OverlapPlanes(FVector Center, FVector HalfExtent) const
+{
+    TArray<FGuid> ids;
+    PlaneIndex.Overlap(FBox(Center - HalfExtent, Center + HalfExtent), ids);
+    return ids;
+}
+
+bool AARPlaneRenderer::IsPointOnPlane(FGuid PlaneId, FVector Point, float MaxHeight) const
+{
+    return PlaneIndex.IsPointOnPlane(PlaneId, Point, MaxHeight);
+}
+
+void AARPlaneRenderer::OnGeoDataAdded(const FARTrackedGeoData& data)
+{
+    RemovedGeo.Remove(data.id_);
+    DirtyGeo.Add(data.id_);
+}
+
+void AARPlaneRenderer::OnGeoDataChanged(const FARTrackedGeoData& data)
+{
+    DirtyGeo.Add(data.id_);
+}
+
+void AARPlaneRenderer::OnGeoDataRemoved(const FARTrackedGeoData& data)
+{
+    DirtyGeo.Remove(data.id_);
+    RemovedGeo.Add(data.id_);
+}
+
+void FARPlaneSample::FromGeometry(const UARPlaneGeometry* geometry)
+{
+    sourceId_ = geometry->GetUniqueId();
+    debugName_ = geometry->GetDebugName();
+    trackingState_ = geometry->GetTrackingState();
+    subsumed_ = geometry->GetSubsumedBy() != nullptr;
+    lastUpdateFrame_ = geometry->GetLastUpdateFrameNumber();
+    localToWorld_ = geometry->GetLocalToWorldTransform();
+    localToTracking_ = geometry->GetLocalToTrackingTransform();
+    extent_ = geometry->GetExtent();
+    boundary_ = geometry->GetBoundaryPolygonInLocalSpace();
+}
+
+bool AARPlaneRenderer::FeedPlaneSamples(const TArray<FARPlaneSample>& samples)
+{
+    if (!bTracksARPlanes || GetLocalRole() < ROLE_AutonomousProxy)
+        return false;
+    
+    for (const FARPlaneSample& sample : samples)
+        UpdatePlaneData(sample);
+    
+    return true;
+}
+
+void AARPlaneRenderer::UpdatePlaneData(const FARPlaneSample& sample)
 {
-    UARTrackedGeoData *TrackedGeoData = nullptr;
+    OnPlaneSample.Broadcast(sample);
+    
+    FGuid* TrackedGeoId = PlanesDataMap.Find(sample.sourceId_);
     
 //    UProceduralMeshComponent* PlanePolygonMeshComponent = nullptr;
     
-    if (!PlanesDataMap.Contains(ARCorePlaneObject))
+    if (!TrackedGeoId)
     {
-        if (ARCorePlaneObject->GetSubsumedBy() != nullptr || ARCorePlaneObject->GetTrackingState() == EARTrackingState::StoppedTracking)
+        if (sample.subsumed_ || sample.trackingState_ == EARTrackingState::StoppedTracking)
         {
             return;
         }
 
-        TrackedGeoData = NewObject<UARTrackedGeoData>();
+        FARTrackedGeoData TrackedGeoData;
+        TrackedGeoData.id_ = FGuid::NewGuid();
         
 //        PlanePolygonMeshComponent = NewObject<UProceduralMeshComponent>(this);
 //        PlanePolygonMeshComponent->RegisterComponent();
@@ -137,271 +729,1153 @@ void AARPlaneRenderer::UpdatePlaneData(UARPlaneGeometry* ARCorePlaneObject)
             Color = PlaneColors[ColorIndex];
         }
         
-        TrackedGeoData->color_ = Color;
-        TrackedGeoData->debugName_ = ARCorePlaneObject->GetDebugName();
+        TrackedGeoData.color_ = Color;
+        TrackedGeoData.debugName_ = sample.debugName_;
         
         NewPlaneIndex++;
         
-        AddNewGeoData(ARCorePlaneObject, TrackedGeoData);
+        AddNewGeoData(sample.sourceId_, TrackedGeoData);
+        TrackedGeoId = PlanesDataMap.Find(sample.sourceId_);
     }
-    else
+    
+    FARTrackedGeoItem* TrackedGeoItem = GeoDataArray.Find(*TrackedGeoId);
+    
+    if (!TrackedGeoItem)
     {
-        TrackedGeoData = *PlanesDataMap.Find(ARCorePlaneObject);
-//        PlanePolygonMeshComponent = *PlaneMeshMap.Find(ARCorePlaneObject);
+        DLOG_MODULE_WARN(DDAugmented, "Plane {} has no geo data", TCHAR_TO_ANSI(*TrackedGeoId->ToString()));
+        PlanePollStates.Remove(*TrackedGeoId);
+        PlanesDataMap.Remove(sample.sourceId_);
+        // geo data went away behind our back, its counts can't be taken off
+        UpdateBoundaryStats();
+        return;
     }
 
     // update geo data here
-    if(ARCorePlaneObject->GetTrackingState() == EARTrackingState::Tracking &&
-       ARCorePlaneObject->GetSubsumedBy() == nullptr)
+    if(sample.trackingState_ == EARTrackingState::Tracking &&
+       !sample.subsumed_)
     {
 //        if (!PlanePolygonMeshComponent->bVisible)
 //        {
 //            PlanePolygonMeshComponent->SetVisibility(true, true);
 //        }
 //        UpdatePlaneMesh(ARCorePlaneObject, PlanePolygonMeshComponent);
-        UpdateGeoData(ARCorePlaneObject, TrackedGeoData);
+        if (PlaneChangedEnough(sample, TrackedGeoItem->data_.id_))
+            UpdateGeoData(sample, *TrackedGeoItem);
+        else
+            PlaneUpdatesSuppressed++;
     }
 //    else if (PlanePolygonMeshComponent->bVisible)
 //    {
 //        PlanePolygonMeshComponent->SetVisibility(false, true);
 //    }
     
-    if(ARCorePlaneObject->GetSubsumedBy() != nullptr || ARCorePlaneObject->GetTrackingState() == EARTrackingState::StoppedTracking)
+    if(sample.subsumed_ || sample.trackingState_ == EARTrackingState::StoppedTracking)
     {
-        TrackedGeoData = *PlanesDataMap.Find(ARCorePlaneObject);
-//        PlanePolygonMeshComponent = *PlaneMeshMap.Find(ARCorePlaneObject);
-        if(TrackedGeoData != nullptr)
-        {
-            RemoveGeoData(ARCorePlaneObject, TrackedGeoData);
-        }
+        RemoveGeoData(sample.sourceId_, TrackedGeoItem->data_.id_);
     }
 }
 
-void AARPlaneRenderer::AddNewGeoData(UARPlaneGeometry* ARCorePlaneObject, UARTrackedGeoData *data)
+void AARPlaneRenderer::BindTrackableEvents()
 {
-    PlanesDataMap.Add(ARCorePlaneObject, data);
-    GeoDataArray.Add(data);
+    OnTrackableAddedHandle = UARBlueprintLibrary::AddOnTrackableAddedDelegate_Handle(
+        FOnTrackableAddedDelegate::CreateUObject(this, &AARPlaneRenderer::OnTrackableChanged));
+    OnTrackableUpdatedHandle = UARBlueprintLibrary::AddOnTrackableUpdatedDelegate_Handle(
+        FOnTrackableUpdatedDelegate::CreateUObject(this, &AARPlaneRenderer::OnTrackableChanged));
+    OnTrackableRemovedHandle = UARBlueprintLibrary::AddOnTrackableRemovedDelegate_Handle(
+        FOnTrackableRemovedDelegate::CreateUObject(this, &AARPlaneRenderer::OnTrackableRemoved));
     
-    // call RPC here
-    if (GetLocalRole() == ROLE_AutonomousProxy)
+    bTrackableEventsBound = OnTrackableAddedHandle.IsValid() &&
+        OnTrackableUpdatedHandle.IsValid() &&
+        OnTrackableRemovedHandle.IsValid();
+    
+    if (!bTrackableEventsBound)
     {
-        RPC_GeoDataAddOrRemove(true, data);
+        DLOG_MODULE_WARN(DDAugmented, "AR system has no trackable events, polling planes every {} sec", PlanePollInterval);
+        UnbindTrackableEvents();
+        bTrackableEventsUnavailable = true;
+        return;
     }
+    
+    // planes tracked before subscription never fire "added"
+    bFullPlanePollRequested = true;
 }
 
-void AARPlaneRenderer::RemoveGeoData(UARPlaneGeometry* ARCorePlaneObject, UARTrackedGeoData *data)
+void AARPlaneRenderer::UnbindTrackableEvents()
 {
-    // call RPC here
-    if (GetLocalRole() == ROLE_AutonomousProxy)
-    {
-        RPC_GeoDataAddOrRemove(false, data);
-    }
+    UARBlueprintLibrary::ClearOnTrackableAddedDelegate_Handle(OnTrackableAddedHandle);
+    UARBlueprintLibrary::ClearOnTrackableUpdatedDelegate_Handle(OnTrackableUpdatedHandle);
+    UARBlueprintLibrary::ClearOnTrackableRemovedDelegate_Handle(OnTrackableRemovedHandle);
     
-    GeoDataArray.Remove(data);
-    PlanesDataMap.Remove(ARCorePlaneObject);
+    bTrackableEventsBound = false;
+    ChangedPlanes.Reset();
 }
 
-void AARPlaneRenderer::UpdateGeoData(UARPlaneGeometry* ARCorePlaneObject, UARTrackedGeoData *data)
+void AARPlaneRenderer::OnTrackableChanged(UARTrackedGeometry* Geometry)
 {
-    data->boundaryVerts_ = ARCorePlaneObject->GetBoundaryPolygonInLocalSpace();
-    data->localToWorld_ = ARCorePlaneObject->GetLocalToWorldTransform();
-    data->localToTracking_ = ARCorePlaneObject->GetLocalToTrackingTransform();
+    UARPlaneGeometry* PlaneGeometry = Cast<UARPlaneGeometry>(Geometry);
     
-    // call RPC here
-    if (GetLocalRole() == ROLE_AutonomousProxy)
-    {
-        RPC_GeoDataUpdate(data);
-    }
+    if (PlaneGeometry)
+        ChangedPlanes.Add(PlaneGeometry);
 }
 
-void AARPlaneRenderer::RPC_GeoDataAddOrRemove_Implementation(bool isAdd, UARTrackedGeoData *data)
+void AARPlaneRenderer::OnTrackableRemoved(UARTrackedGeometry* Geometry)
 {
-//    if (HasAuthority())
+    UARPlaneGeometry* PlaneGeometry = Cast<UARPlaneGeometry>(Geometry);
+    
+    if (!PlaneGeometry)
+        return;
+    
+    ChangedPlanes.Remove(PlaneGeometry);
+    
+    // goes through ingestion as a stopped plane, so recordings see the removal too
+    if (PlanesDataMap.Contains(PlaneGeometry->GetUniqueId()))
     {
-        if (isAdd)
-        {
-            DLOG_MODULE_DEBUG(DDAugmented, "SERVER ADD GEO TRACKED DATA");
-            GeoDataArray.Add(data);
-        }
-        else
-        {
-            UARTrackedGeoData *dataToRemove = nullptr;
-            for (auto& d : GeoDataArray)
-                if (data->id_ == d->id_)
-                {
-                    dataToRemove = d;
-                    break;
-                }
-            
-            if (dataToRemove)
-            {
-                DLOG_MODULE_DEBUG(DDAugmented, "SERVER REMOVE GEO TRACKED DATA");
-                GeoDataArray.Remove(dataToRemove);
-            }
-            else
-            {
-                DLOG_MODULE_ERROR(DDAugmented, "SERVER REMOVE FAILED -- CAN'T FIND DATA WITH ID {}", TCHAR_TO_ANSI(*data->id_.ToString()));
-            }
-        }
+        PlaneSample.FromGeometry(PlaneGeometry);
+        PlaneSample.trackingState_ = EARTrackingState::StoppedTracking;
+        UpdatePlaneData(PlaneSample);
     }
 }
 
-void AARPlaneRenderer::RPC_GeoDataUpdate_Implementation(UARTrackedGeoData *data)
+void AARPlaneRenderer::OnChunkGeoDataChanged(AARPlaneChunk* chunk, const FARTrackedGeoData& data)
 {
-//    if (HasAuthority())
-    {
-        UARTrackedGeoData *dataToUpdate = nullptr;
+    PlaneChunkOwners.Add(data.id_, chunk);
+    
+    FARTrackedGeoItem* item = GeoDataArray.Find(data.id_);
+    
+    if (item)
+    {
+        // replicated fields only, hashes and revision are local
+        item->data_.boundaryVerts_ = data.boundaryVerts_;
+        item->data_.localToWorld_ = data.localToWorld_;
+        item->data_.localToTracking_ = data.localToTracking_;
+        item->data_.debugName_ = data.debugName_;
+        item->data_.color_ = data.color_;
+        OnGeoDataChanged(item->data_);
+    }
+    else
+    {
+        // netId_ is the chunk's wire detail, local copy needs no header
+        FARTrackedGeoData local = data;
+        local.netId_ = 0;
+        FARTrackedGeoItem& added = GeoDataArray.Add(local);
+        OnGeoDataAdded(added.data_);
+    }
+}
+
+uint16 AARPlaneRenderer::AllocateGeoNetId()
+{
+    // 0 marks planes with inline identity; ids wrap after 65535 planes
+    do
+    {
+        NextGeoNetId++;
+    }
+    while (NextGeoNetId == 0 || GeoHeaderArray.Find(NextGeoNetId));
+    
+    return NextGeoNetId;
+}
+
+void AARPlaneRenderer::OnChunkGeoDataRemoved(AARPlaneChunk* chunk, const FGuid& id)
+{
+    // plane has moved on to another chunk
+    TWeakObjectPtr<AARPlaneChunk>* owner = PlaneChunkOwners.Find(id);
+    if (!owner || owner->Get() != chunk)
+        return;
+    
+    PlaneChunkOwners.Remove(id);
+    
+    FARTrackedGeoItem* item = GeoDataArray.Find(id);
+    if (item)
+    {
+        OnGeoDataRemoved(item->data_);
+        GeoDataArray.Remove(id);
+    }
+}
+
+void AARPlaneRenderer::UpdatePlaneChunk(const FARTrackedGeoData& data)
+{
+    FVector center = data.localToWorld_.GetLocation();
+    FIntVector cell(FMath::FloorToInt(center.X / ActivePlaneRelevancyCellSize),
+                    FMath::FloorToInt(center.Y / ActivePlaneRelevancyCellSize),
+                    FMath::FloorToInt(center.Z / ActivePlaneRelevancyCellSize));
+    
+    FIntVector* currentCell = PlaneChunkCells.Find(data.id_);
+    if (currentCell && *currentCell != cell)
+        RemovePlaneChunk(data.id_);
+    
+    AARPlaneChunk** existingChunk = PlaneChunks.Find(cell);
+    AARPlaneChunk* chunk = existingChunk ? *existingChunk : nullptr;
+    
+    if (!chunk)
+    {
+        FActorSpawnParameters spawnParams;
+        spawnParams.Owner = this;
+        spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
         
-        for (auto& d : GeoDataArray)
-            if (data->id_ == d->id_)
-            {
-                dataToUpdate = d;
-                break;
-            }
+        FVector location = (FVector(cell) + FVector(0.5f)) * ActivePlaneRelevancyCellSize;
+        chunk = GetWorld()->SpawnActor<AARPlaneChunk>(location, FRotator::ZeroRotator, spawnParams);
         
-        if (dataToUpdate)
+        if (!chunk)
         {
-            dataToUpdate->boundaryVerts_ = data->boundaryVerts_;
-            dataToUpdate->localToWorld_ = data->localToWorld_;
-            dataToUpdate->localToTracking_ = data->localToTracking_;
+            DLOG_MODULE_ERROR(DDAugmented, "Failed to spawn plane relevancy chunk");
+            return;
         }
-        else
+        
+        // plane centers anywhere in the cell -- cull distance is measured from cell center
+        chunk->Renderer = this;
+        chunk->NetCullDistanceSquared = FMath::Square(PlaneRelevancyRadius + ActivePlaneRelevancyCellSize * 0.5f * FMath::Sqrt(3.f));
+        PlaneChunks.Add(cell, chunk);
+    }
+    
+    PlaneChunkCells.Add(data.id_, cell);
+    
+    FARTrackedGeoItem* item = chunk->GeoDataArray.Find(data.id_);
+    if (item)
+    {
+        item->data_ = data;
+        chunk->GeoDataArray.MarkItemDirty(*item);
+    }
+    else
+    {
+        chunk->GeoDataArray.Add(data);
+    }
+}
+
+void AARPlaneRenderer::RemovePlaneChunk(const FGuid& id)
+{
+    FIntVector cell;
+    if (!PlaneChunkCells.RemoveAndCopyValue(id, cell))
+        return;
+    
+    AARPlaneChunk** chunk = PlaneChunks.Find(cell);
+    if (!chunk || !IsValid(*chunk))
+        return;
+    
+    (*chunk)->GeoDataArray.Remove(id);
+    
+    // empty chunks go away, clients drop them with their channel
+    if ((*chunk)->GeoDataArray.Num() == 0)
+    {
+        (*chunk)->Destroy();
+        PlaneChunks.Remove(cell);
+    }
+}
+
+void AARPlaneRenderer::UpdateBoundaryStats()
+{
+    BoundaryVerticesRaw = 0;
+    BoundaryVerticesSimplified = 0;
+    
+    for (const auto& it : PlanesDataMap)
+    {
+        FARTrackedGeoItem* item = GeoDataArray.Find(it.Value);
+        const FPlanePollState* state = PlanePollStates.Find(it.Value);
+        
+        // raw count as of the last accepted update
+        if (item && state)
         {
-            DLOG_MODULE_WARN(DDAugmented, "Failed to update data with id {} -- data not found on the server", TCHAR_TO_ANSI(*data->id_.ToString()));
+            BoundaryVerticesRaw += state->boundaryVertexCount_;
+            BoundaryVerticesSimplified += item->data_.boundaryVerts_.Num();
         }
     }
 }
 
-void AARPlaneRenderer::UpdateGeo(UARTrackedGeoData* TrackedGeoData)
+void AARPlaneRenderer::AddNewGeoData(const FGuid& sourceId, const FARTrackedGeoData& data)
 {
-    UProceduralMeshComponent* PlanePolygonMeshComponent = nullptr;
-    if (!GeoMeshMap.Contains(TrackedGeoData))
+    PlanesDataMap.Add(sourceId, data.id_);
+    
+    // AR client is also the server -- replicates straight from here
+    FARTrackedGeoItem& item = GeoDataArray.Add(data);
+    if (HasAuthority())
+    {
+        item.data_.netId_ = AllocateGeoNetId();
+        GeoHeaderArray.Add(item.data_);
+    }
+    
+    OnGeoDataAdded(item.data_);
+    
+    // call RPC here
+    if (GetLocalRole() == ROLE_AutonomousProxy)
     {
-        PlanePolygonMeshComponent = NewObject<UProceduralMeshComponent>(this);
-        PlanePolygonMeshComponent->RegisterComponent();
-        PlanePolygonMeshComponent->AttachToComponent(this->GetRootComponent(), FAttachmentTransformRules::KeepWorldTransform);
+        RPC_GeoDataAdd(data);
+    }
+}
 
-        UMaterialInstanceDynamic* DynMaterial = UMaterialInstanceDynamic::Create(PlaneMaterial, this);
-        FColor Color = TrackedGeoData->color_;
-        DynMaterial->SetScalarParameterValue(FName(TEXT("TextureRotationAngle")), FMath::FRandRange(0.0f, 1.0f));
-        DynMaterial->SetVectorParameterValue(FName(TEXT("PlaneTint")), FLinearColor(Color));
+void AARPlaneRenderer::RemoveGeoData(const FGuid& sourceId, FGuid id)
+{
+    // call RPC here
+    if (GetLocalRole() == ROLE_AutonomousProxy)
+    {
+        RPC_GeoDataRemove(id);
+    }
+    
+    FARTrackedGeoItem* item = GeoDataArray.Find(id);
+    if (item)
+    {
+        BoundaryVerticesSimplified -= item->data_.boundaryVerts_.Num();
+        OnGeoDataRemoved(item->data_);
+    }
+    
+    FPlanePollState* state = PlanePollStates.Find(id);
+    if (state)
+        BoundaryVerticesRaw -= state->boundaryVertexCount_;
+    
+    GeoDataArray.Remove(id);
+    PlanesDataMap.Remove(sourceId);
+    PlanePollStates.Remove(id);
+    GeoDeltaEncoders.Remove(id);
+}
+
+bool AARPlaneRenderer::PlaneChangedEnough(const FARPlaneSample& sample, const FGuid& id)
+{
+    FPlanePollState& state = PlanePollStates.FindOrAdd(id);
+    
+    // AR session didn't touch the plane since last accepted update
+    int32 frame = sample.lastUpdateFrame_;
+    if (state.isValid_ && frame == state.lastUpdateFrame_)
+        return false;
+    
+    const FTransform& localToWorld = sample.localToWorld_;
+    const FVector& extent = sample.extent_;
+    int32 nBoundaryVerts = sample.boundary_.Num();
+    // boundary can grow or shrink with the extent and vertex count unchanged
+    float area = FMath::Abs(ARPolygonUtils::SignedArea(sample.boundary_));
+    
+    if (state.isValid_)
+    {
+        state.lastUpdateFrame_ = frame;
+        
+        // compared against last accepted update, so slow drift still gets through
+        bool moved = FVector::Dist(localToWorld.GetLocation(), state.localToWorld_.GetLocation()) >= PlaneUpdateMinTranslation;
+        bool rotated = FMath::RadiansToDegrees(localToWorld.GetRotation().AngularDistance(state.localToWorld_.GetRotation())) >= PlaneUpdateMinRotation;
+        bool resized = (extent - state.extent_).GetAbsMax() >= PlaneUpdateMinExtentChange ||
+            nBoundaryVerts != state.boundaryVertexCount_ ||
+            FMath::Abs(area - state.area_) >= PlaneUpdateMinAreaChange * FMath::Max(state.area_, KINDA_SMALL_NUMBER);
+        
+        if (!moved && !rotated && !resized)
+            return false;
+    }
+    
+    // raw count as of the last accepted update
+    BoundaryVerticesRaw += nBoundaryVerts - state.boundaryVertexCount_;
+    
+    state.isValid_ = true;
+    state.lastUpdateFrame_ = frame;
+    state.localToWorld_ = localToWorld;
+    state.extent_ = extent;
+    state.boundaryVertexCount_ = nBoundaryVerts;
+    state.area_ = area;
+    
+    return true;
+}
+
+void AARPlaneRenderer::UpdateGeoData(const FARPlaneSample& sample, FARTrackedGeoItem& item)
+{
+    FARTrackedGeoData& data = item.data_;
+    
+    // boundaries carry many nearly collinear points -- simplify before they are
+    // hashed, replicated and triangulated, and only when AR reports a new boundary
+    const TArray<FVector>& rawBoundary = sample.boundary_;
+    uint32 sourceBoundaryHash = FCrc::MemCrc32(rawBoundary.GetData(), rawBoundary.Num() * sizeof(FVector));
+    
+    if (sourceBoundaryHash != data.sourceBoundaryHash_ || data.boundaryVerts_.Num() == 0)
+    {
+        int32 nSimplified = data.boundaryVerts_.Num();
+        ARPolygonUtils::SimplifyClosed(rawBoundary, BoundarySimplifyTolerance, MaxBoundaryVertices, data.boundaryVerts_);
+        data.sourceBoundaryHash_ = sourceBoundaryHash;
+        BoundaryVerticesSimplified += data.boundaryVerts_.Num() - nSimplified;
+        
+        DLOG_MODULE_TRACE(DDAugmented, "Plane {} boundary simplified {} -> {} vertices",
+                          TCHAR_TO_ANSI(*data.id_.ToString()), rawBoundary.Num(), data.boundaryVerts_.Num());
+    }
+    
+    data.localToWorld_ = sample.localToWorld_;
+    data.localToTracking_ = sample.localToTracking_;
+    
+    if (data.UpdateRevision())
+    {
+        // replicates directly when AR client is also the server
+        GeoDataArray.MarkItemDirty(item);
+        OnGeoDataChanged(data);
+    }
+    
+    // changes are sent to the server in batches from FlushGeoUpdates
+}
+
+void AARPlaneRenderer::FlushGeoUpdates()
+{
+    float now = GetWorld()->GetTimeSeconds();
+    
+    if (MaxGeoUpdateRate > 0.f && now - LastGeoFlushTime < 1.f / MaxGeoUpdateRate)
+        return;
+    
+    int32 nItems = GeoDataArray.Items.Num();
+    if (!nItems)
+        return;
+    
+    TArray<FARGeoDelta> batch;
+    int32 batchBytes = 0;
+    int32 nVisited = 0;
+    FBitWriter sizeWriter(0, true);
+    
+    for (; nVisited < nItems; ++nVisited)
+    {
+        FARTrackedGeoData& data = GeoDataArray.Items[(GeoSendCursor + nVisited) % nItems].data_;
+        FARGeoDeltaEncoder& encoder = GeoDeltaEncoders.FindOrAdd(data.id_);
+        FARGeoDelta delta;
+        
+        // nothing changed and no keyframe due
+        if (!encoder.Encode(data, now, GeoKeyframeInterval, delta))
+            continue;
+        
+        bool serialized = false;
+        sizeWriter.Reset();
+        delta.NetSerialize(sizeWriter, nullptr, serialized);
+        int32 deltaBytes = (int32)((sizeWriter.GetNumBits() + 7) >> 3);
+        
+        // always send at least one plane, even if it alone exceeds the budget
+        if (batch.Num() && batchBytes + deltaBytes > GeoUpdateByteBudget)
+            break;
+        
+        encoder.Commit(delta, data, now);
+        batchBytes += deltaBytes;
+        batch.Add(MoveTemp(delta));
+    }
+    
+    GeoSendCursor = (GeoSendCursor + nVisited) % nItems;
+    LastGeoFlushTime = now;
+    
+    if (batch.Num())
+    {
+        RPC_GeoDataDeltaBatch(batch);
+        GeoUpdateBatchCount++;
+        GeoUpdateBytesSent += batchBytes;
+    }
+}
+
+void AARPlaneRenderer::RPC_GeoDataAdd_Implementation(const FARTrackedGeoData& data)
+{
+    if (GeoDataArray.Find(data.id_))
+    {
+        DLOG_MODULE_WARN(DDAugmented, "SERVER ADD GEO TRACKED DATA -- data with id {} already exists", TCHAR_TO_ANSI(*data.id_.ToString()));
+        return;
+    }
+    
+    DLOG_MODULE_DEBUG(DDAugmented, "SERVER ADD GEO TRACKED DATA");
+    FARTrackedGeoData mapped = data;
+    mapped.netId_ = AllocateGeoNetId();
+    FARTrackedGeoItem& item = GeoDataArray.Add(mapped);
+    item.data_.UpdateRevision();
+    OnGeoDataAdded(item.data_);
+}
 
-        PlanePolygonMeshComponent->SetMaterial(0, DynMaterial);
-        GeoMeshMap.Add(TrackedGeoData, PlanePolygonMeshComponent);
+void AARPlaneRenderer::RPC_GeoDataRemove_Implementation(const FGuid& id)
+{
+    FARTrackedGeoItem* item = GeoDataArray.Find(id);
+    
+    if (item)
+    {
+        DLOG_MODULE_DEBUG(DDAugmented, "SERVER REMOVE GEO TRACKED DATA");
+        OnGeoDataRemoved(item->data_);
+        GeoDataArray.Remove(id);
+        GeoDeltaDecoders.Remove(id);
     }
     else
     {
-        PlanePolygonMeshComponent = *GeoMeshMap.Find(TrackedGeoData);
+        DLOG_MODULE_ERROR(DDAugmented, "SERVER REMOVE FAILED -- CAN'T FIND DATA WITH ID {}", TCHAR_TO_ANSI(*id.ToString()));
     }
+}
 
-//    if(ARCorePlaneObject->GetTrackingState() == EARTrackingState::Tracking &&
-//       ARCorePlaneObject->GetSubsumedBy() == nullptr)
-//    {
-        if (!PlanePolygonMeshComponent->IsVisible())
+void AARPlaneRenderer::RPC_GeoDataDeltaBatch_Implementation(const TArray<FARGeoDelta>& deltas)
+{
+    for (const FARGeoDelta& delta : deltas)
+        ApplyGeoDelta(delta);
+}
+
+void AARPlaneRenderer::ApplyGeoDelta(const FARGeoDelta& delta)
+{
+    FARTrackedGeoItem* item = GeoDataArray.Find(delta.id_);
+    
+    if (item)
+    {
+        // dropped updates are expected (unreliable RPC) -- next keyframe resyncs
+        if (GeoDeltaDecoders.FindOrAdd(delta.id_).Apply(delta, item->data_))
         {
-            PlanePolygonMeshComponent->SetVisibility(true, true);
+            GeoDataArray.MarkItemDirty(*item);
+            OnGeoDataChanged(item->data_);
         }
-        UpdateGeoMesh(TrackedGeoData, PlanePolygonMeshComponent);
-//    }
-//    else if (PlanePolygonMeshComponent->bVisible)
-//    {
-//        PlanePolygonMeshComponent->SetVisibility(false, true);
-//    }
+    }
+    else
+    {
+        DLOG_MODULE_WARN(DDAugmented, "Failed to update data with id {} -- data not found on the server", TCHAR_TO_ANSI(*delta.id_.ToString()));
+    }
+}
+
+void AARPlaneRenderer::UpdateGeo(FARTrackedGeoData& TrackedGeoData)
+{
+    // replicated data may have changed without going through UpdateGeoData
+    TrackedGeoData.UpdateRevision();
     
-//    if(ARCorePlaneObject->GetSubsumedBy() != nullptr || ARCorePlaneObject->GetTrackingState() == EARTrackingState::StoppedTracking)
-//    {
-//        PlanePolygonMeshComponent = *PlaneMeshMap.Find(ARCorePlaneObject);
-//        if(PlanePolygonMeshComponent != nullptr)
-//        {
-//            PlanePolygonMeshComponent->DestroyComponent(true);
-//            PlaneMeshMap.Remove(ARCorePlaneObject);
-//        }
-//    }
+    const FGuid& id = TrackedGeoData.id_;
+    bool isNewPlane = !GeoMeshStates.Contains(id);
+    FGeoMeshState& meshState = GeoMeshStates.FindOrAdd(id);
+    
+    if (isNewPlane)
+    {
+        GeoMeshTracker.Touch(id);
+        OnPlaneAdded.Broadcast(id);
+    }
+    
+    // culled planes are brought up to date when they become visible again
+    if (meshState.culled_)
+    {
+        meshState.staleWhileCulled_ = true;
+        return;
+    }
+    
+    // far planes: no feather band, coarser boundary
+    float featheringDistance = meshState.lowDetail_ ? 0.f : EdgeFeatheringDistance;
+    float simplifyTolerance = meshState.lowDetail_ ? PlaneLODSimplifyTolerance : 0.f;
+    
+    bool boundaryChanged = !meshState.isBuilt_ ||
+        meshState.boundaryHash_ != TrackedGeoData.boundaryHash_ ||
+        meshState.featheringDistance_ != featheringDistance ||
+        meshState.simplifyTolerance_ != simplifyTolerance;
+    bool poseChanged = !meshState.isBuilt_ || meshState.poseHash_ != TrackedGeoData.poseHash_;
+    bool rebuild = !bSkipUnchangedGeometry || boundaryChanged;
+    bool topologyChanged = false;
+    bool buildPending = false;
+    
+    // buffers remember the boundary and build parameters they were built from
+    uint32 sourceKey = FCrc::MemCrc32(&featheringDistance, sizeof(featheringDistance), TrackedGeoData.boundaryHash_);
+    sourceKey = FCrc::MemCrc32(&simplifyTolerance, sizeof(simplifyTolerance), sourceKey);
+    
+    if (rebuild)
+    {
+        // supersedes builds still running for this plane
+        meshState.buildSerial_ = ++GeoBuildSerial;
+        
+        if (meshState.buffers_.SourceKey == sourceKey && meshState.buffers_.Vertices.Num())
+        {
+            // triangulation of this boundary is already there, just push it
+            CancelGeoBuild(id);
+            TriangulationCacheHits++;
+        }
+        else if (bAsyncGeoMeshBuild)
+        {
+            FGeoBuildJob& job = QueueGeoBuild(id);
+            job.serial_ = meshState.buildSerial_;
+            job.sourceKey_ = sourceKey;
+            // Reset + Append keeps the pooled allocation, assignment would reallocate
+            job.boundaryVerts_.Reset();
+            job.boundaryVerts_.Append(TrackedGeoData.boundaryVerts_);
+            job.featheringDistance_ = featheringDistance;
+            job.simplifyTolerance_ = simplifyTolerance;
+            buildPending = true;
+            MeshRebuildCount++;
+        }
+        else
+        {
+            CancelGeoBuild(id);
+            topologyChanged = BuildGeoMeshBuffers(TrackedGeoData.boundaryVerts_, featheringDistance, simplifyTolerance, sourceKey, meshState.buffers_, GeoMeshScratch);
+            MeshRebuildCount++;
+        }
+    }
+    else
+    {
+        MeshRebuildSkippedCount++;
+        
+        if (poseChanged)
+            PoseOnlyUpdateCount++;
+    }
+    
+    meshState.boundaryHash_ = TrackedGeoData.boundaryHash_;
+    meshState.poseHash_ = TrackedGeoData.poseHash_;
+    meshState.featheringDistance_ = featheringDistance;
+    meshState.simplifyTolerance_ = simplifyTolerance;
+    meshState.localToWorld_ = TrackedGeoData.localToWorld_;
+    meshState.color_ = TrackedGeoData.color_;
+    meshState.isBuilt_ = true;
+    
+    // mesh (and its pose) is committed once the build job finishes
+    if (buildPending)
+        return;
+    
+    CommitGeoMesh(id, meshState, rebuild, topologyChanged, poseChanged);
+}
+
+void AARPlaneRenderer::CommitGeoMesh(const FGuid& id, FGeoMeshState& meshState, bool rebuild, bool topologyChanged, bool poseChanged)
+{
+    if (ActiveRenderMode == EARPlaneRenderMode::Merged)
+    {
+        // merged mesh is in world space -- pose changes need it rebuilt too
+        bMergedMeshDirty |= rebuild || poseChanged;
+        return;
+    }
+    
+    if (ActiveRenderMode == EARPlaneRenderMode::PlaneBuffers)
+    {
+        UpdatePlaneBuffersGeoMesh(id, meshState, rebuild, poseChanged);
+        return;
+    }
+    
+    UProceduralMeshComponent* PlanePolygonMeshComponent = nullptr;
+    UProceduralMeshComponent** existingComponent = GeoMeshMap.Find(id);
+    
+    if (existingComponent)
+    {
+        PlanePolygonMeshComponent = *existingComponent;
+    }
+    else
+    {
+        PlanePolygonMeshComponent = AcquirePlaneComponent(meshState.color_);
+        GeoMeshMap.Add(id, PlanePolygonMeshComponent);
+        // pooled component may still hold previous plane's section
+        rebuild = true;
+        topologyChanged = true;
+    }
+    
+    // plane may have been culled while its build was running
+    if (PlanePolygonMeshComponent->IsVisible() == meshState.culled_)
+    {
+        PlanePolygonMeshComponent->SetVisibility(!meshState.culled_, true);
+    }
+    
+    if (rebuild)
+        UpdateGeoMesh(meshState.localToWorld_, PlanePolygonMeshComponent, meshState.buffers_, topologyChanged);
+    else if (poseChanged)
+        PlanePolygonMeshComponent->SetWorldTransform(meshState.localToWorld_);
+}
+
+void AARPlaneRenderer::SetGeoMeshVisible(const FGuid& id, const FGeoMeshState& meshState)
+{
+    if (ActiveRenderMode == EARPlaneRenderMode::Merged)
+    {
+        bMergedMeshDirty = true;
+        return;
+    }
+    
+    if (ActiveRenderMode == EARPlaneRenderMode::PlaneBuffers)
+    {
+        if (PlaneBuffersComponent)
+            PlaneBuffersComponent->SetPlaneVisible(id, !meshState.culled_);
+        return;
+    }
+    
+    UProceduralMeshComponent** component = GeoMeshMap.Find(id);
+    if (component)
+        (*component)->SetVisibility(!meshState.culled_, true);
+}
+
+void AARPlaneRenderer::UpdatePlaneVisibility()
+{
+    LastPlaneVisibilityTime = GetWorld()->GetTimeSeconds();
+    
+    APlayerController* playerController = GetWorld()->GetFirstPlayerController();
+    if (!playerController || !playerController->PlayerCameraManager)
+        return;
+    
+    FVector cameraLocation = playerController->PlayerCameraManager->GetCameraLocation();
+    FVector cameraForward = playerController->PlayerCameraManager->GetCameraRotation().Vector();
+    
+    // cone around the view direction enclosing the frustum: half of the diagonal field of view
+    int32 viewportX = 0, viewportY = 0;
+    playerController->GetViewportSize(viewportX, viewportY);
+    float aspect = viewportY > 0 ? (float)viewportX / viewportY : 1.f;
+    float tanHalfFov = FMath::Tan(FMath::DegreesToRadians(playerController->PlayerCameraManager->GetFOVAngle() * 0.5f));
+    float halfDiagonalFov = FMath::Atan(tanHalfFov * FMath::Sqrt(1.f + 1.f / (aspect * aspect)));
+    
+    int32 nCulled = 0;
+    int32 nLowDetail = 0;
+    
+    for (auto& it : GeoMeshStates)
+    {
+        const FGuid& id = it.Key;
+        FGeoMeshState& meshState = it.Value;
+        const FBox* box = PlaneIndex.GetWorldBox(id);
+        
+        // not indexed yet -- leave as is until next pass
+        if (!box || !box->IsValid)
+            continue;
+        
+        // planes are tested by their bounding sphere
+        FVector center;
+        FVector extent;
+        box->GetCenterAndExtents(center, extent);
+        float radius = extent.Size();
+        FVector toPlane = center - cameraLocation;
+        float distance = FMath::Max(toPlane.Size() - radius, 0.f);
+        
+        bool culled = PlaneCullDistance > 0.f && distance > PlaneCullDistance;
+        
+        if (!culled && bFrustumCullPlanes && distance > 0.f)
+        {
+            float centerDistance = toPlane.Size();
+            float angle = FMath::Acos(FMath::Clamp(FVector::DotProduct(toPlane / centerDistance, cameraForward), -1.f, 1.f));
+            culled = angle > halfDiagonalFov + FMath::Asin(FMath::Min(radius / centerDistance, 1.f));
+        }
+        
+        bool lowDetail = PlaneLODDistance > 0.f && distance > PlaneLODDistance;
+        
+        if (culled != meshState.culled_)
+        {
+            meshState.culled_ = culled;
+            SetGeoMeshVisible(id, meshState);
+            
+            // apply updates missed while culled
+            if (!culled && meshState.staleWhileCulled_)
+            {
+                meshState.staleWhileCulled_ = false;
+                DirtyGeo.Add(id);
+            }
+        }
+        
+        if (lowDetail != meshState.lowDetail_)
+        {
+            meshState.lowDetail_ = lowDetail;
+            
+            if (culled)
+                meshState.staleWhileCulled_ = true;
+            else
+                DirtyGeo.Add(id);
+        }
+        
+        nCulled += culled ? 1 : 0;
+        nLowDetail += !culled && lowDetail ? 1 : 0;
+    }
+    
+    CulledPlaneCount = nCulled;
+    LowDetailPlaneCount = nLowDetail;
+}
+
+void AARPlaneRenderer::CommitGeoMeshBuilds()
+{
+    if (!GeoBuildTask.IsValid() || !GeoBuildTask.IsReady())
+        return;
+    
+    GeoBuildTask = TFuture<void>();
+    
+    for (FGeoBuildJob& job : GeoBuildsInFlight)
+    {
+        FGeoMeshState* meshState = GeoMeshStates.Find(job.id_);
+        
+        // plane was removed, or queued for another build since this one started
+        if (meshState && meshState->buildSerial_ == job.serial_)
+        {
+            bool topologyChanged = job.buffers_.Vertices.Num() != meshState->buffers_.Vertices.Num() ||
+                job.buffers_.Indices != meshState->buffers_.Indices;
+            
+            // job takes the previous buffers back to the pool, next build reuses them
+            Swap(meshState->buffers_, job.buffers_);
+            CommitGeoMesh(job.id_, *meshState, true, topologyChanged, true);
+        }
+        
+        GeoBuildJobPool.Add(MoveTemp(job));
+    }
+    
+    GeoBuildsInFlight.Reset();
+}
+
+AARPlaneRenderer::FGeoBuildJob& AARPlaneRenderer::QueueGeoBuild(const FGuid& id)
+{
+    FGeoBuildJob* job = PendingGeoBuilds.Find(id);
+    
+    if (!job)
+    {
+        job = &PendingGeoBuilds.Add(id, GeoBuildJobPool.Num() ? GeoBuildJobPool.Pop(false) : FGeoBuildJob());
+        job->id_ = id;
+    }
+    
+    return *job;
+}
+
+void AARPlaneRenderer::CancelGeoBuild(const FGuid& id)
+{
+    FGeoBuildJob* job = PendingGeoBuilds.Find(id);
+    
+    if (job)
+    {
+        GeoBuildJobPool.Add(MoveTemp(*job));
+        PendingGeoBuilds.Remove(id);
+    }
+}
+
+void AARPlaneRenderer::LaunchGeoMeshBuilds()
+{
+    if (GeoBuildTask.IsValid() || PendingGeoBuilds.Num() == 0)
+        return;
+    
+    GeoBuildsInFlight.Reset(PendingGeoBuilds.Num());
+    for (auto& it : PendingGeoBuilds)
+        GeoBuildsInFlight.Add(MoveTemp(it.Value));
+    PendingGeoBuilds.Reset();
+    
+    TArray<FGeoBuildJob>* jobs = &GeoBuildsInFlight;
+    
+    GeoBuildTask = Async(EAsyncExecution::TaskGraph, [jobs]()
+    {
+        ParallelFor(jobs->Num(), [jobs](int32 i)
+        {
+            FGeoBuildJob& job = (*jobs)[i];
+            BuildGeoMeshBuffers(job.boundaryVerts_, job.featheringDistance_, job.simplifyTolerance_, job.sourceKey_, job.buffers_, job.scratch_);
+        });
+    });
+}
+
+void AARPlaneRenderer::RemoveGeoMesh(const FGuid& id)
+{
+    UProceduralMeshComponent* PlanePolygonMeshComponent = nullptr;
+    
+    if (GeoMeshMap.RemoveAndCopyValue(id, PlanePolygonMeshComponent) && PlanePolygonMeshComponent)
+        ReleasePlaneComponent(PlanePolygonMeshComponent);
+    
+    if (GeoMeshStates.Remove(id))
+        bMergedMeshDirty = true;
+    
+    if (PlaneBuffersComponent)
+        PlaneBuffersComponent->RemovePlane(id);
+    
+    CancelGeoBuild(id);
+    
+    if (GeoMeshTracker.Remove(id))
+        OnPlaneRemoved.Broadcast(id);
+}
+
+void AARPlaneRenderer::ResetGeoMeshes()
+{
+    TArray<FGuid> ids;
+    GeoMeshStates.GetKeys(ids);
+    
+    for (const FGuid& id : ids)
+        RemoveGeoMesh(id);
+    
+    GeoBuildJobPool.Empty();
+    
+    if (MergedMeshComponent)
+    {
+        MergedMeshComponent->DestroyComponent();
+        MergedMeshComponent = nullptr;
+    }
+    
+    if (PlaneBuffersComponent)
+    {
+        PlaneBuffersComponent->DestroyComponent();
+        PlaneBuffersComponent = nullptr;
+    }
+    
+    bMergedMeshDirty = false;
+    
+    for (const FARTrackedGeoItem& item : GeoDataArray.Items)
+        DirtyGeo.Add(item.data_.id_);
 }
 
-void AARPlaneRenderer::UpdateGeoMesh(UARTrackedGeoData* TrackedGeoData, UProceduralMeshComponent* PlanePolygonMeshComponent)
+bool AARPlaneRenderer::BuildGeoMeshBuffers(const TArray<FVector>& SourceBoundaryVertices, float FeatheringDistance, float SimplifyTolerance, uint32 SourceKey,
+                                           FGeoMeshBuffers& Buffers, FGeoMeshScratch& Scratch)
 {
-    // Update polygon mesh vertex indices, using triangle fan due to its convex.
-    TArray<FVector> BoundaryVertices;
-    BoundaryVertices = TrackedGeoData->boundaryVerts_;
+    if (SimplifyTolerance > 0.f)
+        ARPolygonUtils::SimplifyClosed(SourceBoundaryVertices, SimplifyTolerance, 0, Scratch.SimplifiedBoundary, Scratch.Simplify);
+    
+    const TArray<FVector>& BoundaryVertices = SimplifyTolerance > 0.f ? Scratch.SimplifiedBoundary : SourceBoundaryVertices;
     int BoundaryVerticesNum = BoundaryVertices.Num();
+    Buffers.SourceKey = SourceKey;
 
     if (BoundaryVerticesNum < 3)
     {
-        PlanePolygonMeshComponent->ClearMeshSection(0);
-        return;
+        bool hadGeometry = Buffers.Vertices.Num() > 0;
+        Buffers.Vertices.Reset();
+        Buffers.UVs.Reset();
+        Buffers.Normals.Reset();
+        Buffers.Colors.Reset();
+        Buffers.Indices.Reset();
+        return hadGeometry;
     }
 
-    int PolygonMeshVerticesNum = BoundaryVerticesNum * 2;
-    // Triangle number is interior(n-2 for convex polygon) plus perimeter (EdgeNum * 2);
-    int TriangleNum = BoundaryVerticesNum - 2 + BoundaryVerticesNum * 2;
+    // low detail meshes have no feather band -- boundary vertices only, fully opaque
+    bool Feathered = FeatheringDistance > 0.f;
+    int VerticesPerBoundaryPoint = Feathered ? 2 : 1;
+    int PolygonMeshVerticesNum = BoundaryVerticesNum * VerticesPerBoundaryPoint;
+
+    // buffers and scratch persist between rebuilds -- Reset() keeps the allocation, so
+    // once a plane has reached its vertex count, rebuilding does not touch the heap
+    bool topologyChanged = (Buffers.Vertices.Num() != PolygonMeshVerticesNum) || Buffers.Feathered != Feathered;
+    Buffers.Feathered = Feathered;
+
+    // boundaries are often concave after plane merges: feather band is the boundary
+    // offset inwards along edge normals, interior is ear-clipped
+    TArray<FVector2D>& Boundary2D = Scratch.Boundary2D;
+    Boundary2D.Reset(BoundaryVerticesNum);
+    for (const FVector& BoundaryPoint : BoundaryVertices)
+        Boundary2D.Add(FVector2D(BoundaryPoint.X, BoundaryPoint.Y));
+
+    // unfeathered interior is the boundary itself
+    if (Feathered)
+        ARPolygonUtils::SafeOffsetInwards(Boundary2D, FeatheringDistance, Scratch.Interior2D);
 
-    TArray<FVector> PolygonMeshVertices;
-    TArray<FLinearColor> PolygonMeshVertexColors;
-    TArray<int> PolygonMeshIndices;
-    TArray<FVector> PolygonMeshNormals;
-    TArray<FVector2D> PolygonMeshUVs;
+    const TArray<FVector2D>& Interior2D = Feathered ? Scratch.Interior2D : Boundary2D;
 
-    PolygonMeshVertices.Empty(PolygonMeshVerticesNum);
-    PolygonMeshVertexColors.Empty(PolygonMeshVerticesNum);
-    PolygonMeshIndices.Empty(TriangleNum * 3);
-    PolygonMeshNormals.Empty(PolygonMeshVerticesNum);
+    TArray<int32>& InteriorTriangles = Scratch.InteriorTriangles;
+    ARPolygonUtils::Triangulate(Interior2D, InteriorTriangles, Scratch.Triangulation);
+
+    Buffers.Vertices.Reset(PolygonMeshVerticesNum);
+    Buffers.UVs.Reset(PolygonMeshVerticesNum);
 
-    FVector PlaneNormal = TrackedGeoData->localToWorld_.GetRotation().GetUpVector();
     for (int i = 0; i < BoundaryVerticesNum; i++)
     {
-        FVector BoundaryPoint = BoundaryVertices[i];
-        float BoundaryToCenterDist = BoundaryPoint.Size();
-        float FeatheringDist = FMath::Min(BoundaryToCenterDist, EdgeFeatheringDistance);
-        FVector InteriorPoint = BoundaryPoint - BoundaryPoint.GetUnsafeNormal() * FeatheringDist;
+        const FVector& BoundaryPoint = BoundaryVertices[i];
+
+        Buffers.Vertices.Add(BoundaryPoint);
+        Buffers.UVs.Add(FVector2D(BoundaryPoint.X, BoundaryPoint.Y));
+
+        if (Feathered)
+        {
+            FVector InteriorPoint(Interior2D[i].X, Interior2D[i].Y, BoundaryPoint.Z);
+
+            Buffers.Vertices.Add(InteriorPoint);
+            Buffers.UVs.Add(FVector2D(InteriorPoint.X, InteriorPoint.Y));
+        }
+    }
 
-        PolygonMeshVertices.Add(BoundaryPoint);
-        PolygonMeshVertices.Add(InteriorPoint);
+    // normals and colors depend on vertex count only
+    if (topologyChanged)
+    {
+        // mesh is built in plane local space (component carries the pose), so the
+        // normal is local up -- this keeps the mesh valid across pose-only updates
+        FVector PlaneNormal = FVector::UpVector;
 
-        PolygonMeshUVs.Add(FVector2D(BoundaryPoint.X, BoundaryPoint.Y));
-        PolygonMeshUVs.Add(FVector2D(InteriorPoint.X, InteriorPoint.Y));
+        Buffers.Normals.Reset(PolygonMeshVerticesNum);
+        Buffers.Colors.Reset(PolygonMeshVerticesNum);
 
-        PolygonMeshNormals.Add(PlaneNormal);
-        PolygonMeshNormals.Add(PlaneNormal);
+        for (int i = 0; i < BoundaryVerticesNum; i++)
+        {
+            if (Feathered)
+            {
+                Buffers.Normals.Add(PlaneNormal);
+                Buffers.Colors.Add(FLinearColor(0.0f, 0.f, 0.f, 0.f));
+            }
 
-        PolygonMeshVertexColors.Add(FLinearColor(0.0f, 0.f, 0.f, 0.f));
-        PolygonMeshVertexColors.Add(FLinearColor(0.0f, 0.f, 0.f, 1.f));
+            Buffers.Normals.Add(PlaneNormal);
+            Buffers.Colors.Add(FLinearColor(0.0f, 0.f, 0.f, 1.f));
+        }
     }
 
-    // Generate triangle indices
+    // interior triangulation depends on vertex positions -- indices are written
+    // in place and compared on the way, so unchanged triangulation keeps the section
+    TArray<int>& PolygonMeshIndices = Buffers.Indices;
+    int NumIndices = 0;
+
+    auto AddIndex = [&PolygonMeshIndices, &NumIndices, &topologyChanged](int Index)
+    {
+        if (NumIndices < PolygonMeshIndices.Num())
+        {
+            if (PolygonMeshIndices[NumIndices] != Index)
+            {
+                PolygonMeshIndices[NumIndices] = Index;
+                topologyChanged = true;
+            }
+        }
+        else
+        {
+            PolygonMeshIndices.Add(Index);
+            topologyChanged = true;
+        }
+
+        NumIndices++;
+    };
 
     // Perimeter triangles
-    for (int i = 0; i < BoundaryVerticesNum - 1; i++)
+    for (int i = 0; i < BoundaryVerticesNum && Feathered; i++)
     {
-        PolygonMeshIndices.Add(i * 2);
-        PolygonMeshIndices.Add(i * 2 + 2);
-        PolygonMeshIndices.Add(i * 2 + 1);
+        int Next = (i + 1) % BoundaryVerticesNum;
+
+        AddIndex(i * 2);
+        AddIndex(Next * 2);
+        AddIndex(i * 2 + 1);
 
-        PolygonMeshIndices.Add(i * 2 + 1);
-        PolygonMeshIndices.Add(i * 2 + 2);
-        PolygonMeshIndices.Add(i * 2 + 3);
+        AddIndex(i * 2 + 1);
+        AddIndex(Next * 2);
+        AddIndex(Next * 2 + 1);
     }
 
-    PolygonMeshIndices.Add((BoundaryVerticesNum - 1) * 2);
-    PolygonMeshIndices.Add(0);
-    PolygonMeshIndices.Add((BoundaryVerticesNum - 1) * 2 + 1);
+    // interior triangles, on interior (odd) vertices when feathered
+    for (int32 Index : InteriorTriangles)
+        AddIndex(Feathered ? Index * 2 + 1 : Index);
 
+    if (NumIndices != PolygonMeshIndices.Num())
+    {
+        PolygonMeshIndices.SetNum(NumIndices, false);
+        topologyChanged = true;
+    }
 
-    PolygonMeshIndices.Add((BoundaryVerticesNum - 1) * 2 + 1);
-    PolygonMeshIndices.Add(0);
-    PolygonMeshIndices.Add(1);
+    return topologyChanged;
+}
 
-    // interior triangles
-    for (int i = 3; i < PolygonMeshVerticesNum - 1; i += 2)
+void AARPlaneRenderer::UpdateGeoMesh(const FTransform& localToWorld, UProceduralMeshComponent* PlanePolygonMeshComponent, const FGeoMeshBuffers& Buffers, bool topologyChanged)
+{
+    if (Buffers.Vertices.Num() == 0)
     {
-        PolygonMeshIndices.Add(1);
-        PolygonMeshIndices.Add(i);
-        PolygonMeshIndices.Add(i + 2);
+        PlanePolygonMeshComponent->ClearMeshSection(0);
+        return;
     }
 
     // No need to fill uv and tangent;
-    PlanePolygonMeshComponent->CreateMeshSection_LinearColor(0, PolygonMeshVertices, PolygonMeshIndices, PolygonMeshNormals, PolygonMeshUVs, PolygonMeshVertexColors, TArray<FProcMeshTangent>(), false);
+    // same topology -- update section buffers in place instead of recreating the section
+    FProcMeshSection* Section = PlanePolygonMeshComponent->GetProcMeshSection(0);
+    if (!topologyChanged && Section && Section->ProcVertexBuffer.Num() == Buffers.Vertices.Num())
+        PlanePolygonMeshComponent->UpdateMeshSection_LinearColor(0, Buffers.Vertices, Buffers.Normals, Buffers.UVs, Buffers.Colors, EmptyTangents);
+    else
+        PlanePolygonMeshComponent->CreateMeshSection_LinearColor(0, Buffers.Vertices, Buffers.Indices, Buffers.Normals, Buffers.UVs, Buffers.Colors, EmptyTangents, false);
 
     // Set the component transform to Plane's transform.
-    PlanePolygonMeshComponent->SetWorldTransform(TrackedGeoData->localToWorld_);
+    PlanePolygonMeshComponent->SetWorldTransform(localToWorld);
+}
+
+void AARPlaneRenderer::UpdateMergedGeoMesh()
+{
+    if (!MergedMeshComponent)
+    {
+        MergedMeshComponent = NewObject<UProceduralMeshComponent>(this);
+        MergedMeshComponent->RegisterComponent();
+        MergedMeshComponent->AttachToComponent(this->GetRootComponent(), FAttachmentTransformRules::KeepWorldTransform);
+        MergedMeshComponent->SetWorldTransform(FTransform::Identity);
+        MergedMeshComponent->SetMaterial(0, MergedPlaneMaterial ? MergedPlaneMaterial : PlaneMaterial);
+    }
+    
+    FGeoMeshBuffers& Merged = MergedMeshBuffers;
+    Merged.Vertices.Reset();
+    Merged.Normals.Reset();
+    Merged.UVs.Reset();
+    Merged.Colors.Reset();
+    Merged.Indices.Reset();
+    
+    // planes are baked in world space, plane tint goes to vertex color RGB,
+    // edge feathering stays in alpha
+    for (const auto& it : GeoMeshStates)
+    {
+        const FGeoMeshState& meshState = it.Value;
+        
+        if (meshState.culled_)
+            continue;
+        
+        const FGeoMeshBuffers& Buffers = meshState.buffers_;
+        int32 baseIndex = Merged.Vertices.Num();
+        FLinearColor tint(meshState.color_);
+        
+        for (int32 i = 0; i < Buffers.Vertices.Num(); ++i)
+        {
+            Merged.Vertices.Add(meshState.localToWorld_.TransformPosition(Buffers.Vertices[i]));
+            Merged.Normals.Add(meshState.localToWorld_.TransformVectorNoScale(Buffers.Normals[i]));
+            Merged.UVs.Add(Buffers.UVs[i]);
+            Merged.Colors.Add(FLinearColor(tint.R, tint.G, tint.B, Buffers.Colors[i].A));
+        }
+        
+        for (int idx : Buffers.Indices)
+            Merged.Indices.Add(baseIndex + idx);
+    }
+    
+    if (Merged.Vertices.Num() == 0)
+    {
+        MergedMeshComponent->ClearMeshSection(0);
+        MergedIndicesHash = 0;
+        return;
+    }
+    
+    uint32 indicesHash = FCrc::MemCrc32(Merged.Indices.GetData(), Merged.Indices.Num() * sizeof(int));
+    FProcMeshSection* Section = MergedMeshComponent->GetProcMeshSection(0);
+    
+    if (Section && indicesHash == MergedIndicesHash && Section->ProcVertexBuffer.Num() == Merged.Vertices.Num())
+        MergedMeshComponent->UpdateMeshSection_LinearColor(0, Merged.Vertices, Merged.Normals, Merged.UVs, Merged.Colors, EmptyTangents);
+    else
+        MergedMeshComponent->CreateMeshSection_LinearColor(0, Merged.Vertices, Merged.Indices, Merged.Normals, Merged.UVs, Merged.Colors, EmptyTangents, false);
+    
+    MergedIndicesHash = indicesHash;
+}
+
+void AARPlaneRenderer::UpdatePlaneBuffersGeoMesh(const FGuid& id, const FGeoMeshState& meshState, bool rebuild, bool poseChanged)
+{
+    if (!PlaneBuffersComponent)
+    {
+        PlaneBuffersComponent = NewObject<UARPlaneMeshComponent>(this);
+        PlaneBuffersComponent->RegisterComponent();
+        PlaneBuffersComponent->AttachToComponent(this->GetRootComponent(), FAttachmentTransformRules::KeepWorldTransform);
+        PlaneBuffersComponent->SetWorldTransform(FTransform::Identity);
+        PlaneBuffersComponent->SetMaterial(0, MergedPlaneMaterial ? MergedPlaneMaterial : PlaneMaterial);
+    }
+    
+    // component sits at world origin, so plane pose is its local-to-component transform
+    if (!rebuild)
+    {
+        if (poseChanged)
+            PlaneBuffersComponent->UpdatePlaneTransform(id, meshState.localToWorld_);
+        return;
+    }
+    
+    const FGeoMeshBuffers& Buffers = meshState.buffers_;
+    FARPlaneMeshData data;
+    
+    data.positions_ = Buffers.Vertices;
+    data.uvs_ = Buffers.UVs;
+    data.colors_.Reserve(Buffers.Colors.Num());
+    for (const FLinearColor& c : Buffers.Colors)
+        data.colors_.Add(FColor(meshState.color_.R, meshState.color_.G, meshState.color_.B, (uint8)FMath::RoundToInt(c.A * 255.f)));
+    
+    data.indices_.Reserve(Buffers.Indices.Num());
+    for (int idx : Buffers.Indices)
+        data.indices_.Add((uint32)idx);
+    
+    PlaneBuffersComponent->UpdatePlane(id, meshState.localToWorld_, MoveTemp(data));
+    
+    // plane may have been culled while its build was running
+    PlaneBuffersComponent->SetPlaneVisible(id, !meshState.culled_);
+}
+
+UProceduralMeshComponent* AARPlaneRenderer::CreatePlaneComponent()
+{
+    UProceduralMeshComponent* PlanePolygonMeshComponent = NewObject<UProceduralMeshComponent>(this);
+    PlanePolygonMeshComponent->RegisterComponent();
+    PlanePolygonMeshComponent->AttachToComponent(this->GetRootComponent(), FAttachmentTransformRules::KeepWorldTransform);
+
+    UMaterialInstanceDynamic* DynMaterial = UMaterialInstanceDynamic::Create(PlaneMaterial, this);
+    PlanePolygonMeshComponent->SetMaterial(0, DynMaterial);
+    
+    return PlanePolygonMeshComponent;
+}
+
+UProceduralMeshComponent* AARPlaneRenderer::AcquirePlaneComponent(const FColor& Color)
+{
+    UProceduralMeshComponent* PlanePolygonMeshComponent = nullptr;
+    
+    while (PlaneComponentPool.Num() && !PlanePolygonMeshComponent)
+        PlanePolygonMeshComponent = PlaneComponentPool.Pop(false);
+    
+    if (PlanePolygonMeshComponent)
+    {
+        PlaneComponentPoolHits++;
+    }
+    else
+    {
+        PlanePolygonMeshComponent = CreatePlaneComponent();
+        PlaneComponentPoolMisses++;
+    }
+    
+    UMaterialInstanceDynamic* DynMaterial = Cast<UMaterialInstanceDynamic>(PlanePolygonMeshComponent->GetMaterial(0));
+    if (DynMaterial)
+    {
+        DynMaterial->SetScalarParameterValue(FName(TEXT("TextureRotationAngle")), FMath::FRandRange(0.0f, 1.0f));
+        DynMaterial->SetVectorParameterValue(FName(TEXT("PlaneTint")), FLinearColor(Color));
+    }
+    
+    return PlanePolygonMeshComponent;
+}
+
+void AARPlaneRenderer::ReleasePlaneComponent(UProceduralMeshComponent* PlanePolygonMeshComponent)
+{
+    if (PlaneComponentPool.Num() >= MaxPooledPlaneComponents)
+    {
+        PlanePolygonMeshComponent->DestroyComponent();
+        return;
+    }
+    
+    // keep registered component and its material instance, just hide it.
+    // mesh section is recreated when the component is reused
+    PlanePolygonMeshComponent->SetVisibility(false, true);
+    PlaneComponentPool.Push(PlanePolygonMeshComponent);
 }
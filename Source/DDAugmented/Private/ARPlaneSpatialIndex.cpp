@@ -0,0 +1,364 @@
+//
+// ARPlaneSpatialIndex.cpp
+//
+
+#include "ARPlaneSpatialIndex.h"
+#include "ARPlaneRenderer.h"
+#include "ARPolygonUtils.h"
+
+namespace
+{
+    // planes spanning more cells than this are kept in the oversized list
+    constexpr int32 kMaxCellsPerPlane = 64;
+
+    // upper bound of cells a single raycast walks
+    constexpr int32 kMaxRaycastCells = 4096;
+
+    int64 NumCells(const FIntVector& cellMin, const FIntVector& cellMax)
+    {
+        return (int64)(cellMax.X - cellMin.X + 1) * (cellMax.Y - cellMin.Y + 1) * (cellMax.Z - cellMin.Z + 1);
+    }
+}
+
+FARPlaneSpatialIndex::FARPlaneSpatialIndex(float cellSize)
+: cellSize_(FMath::Max(cellSize, 1.f))
+{}
+
+void FARPlaneSpatialIndex::SetCellSize(float cellSize)
+{
+    cellSize = FMath::Max(cellSize, 1.f);
+    if (cellSize == cellSize_)
+        return;
+
+    cellSize_ = cellSize;
+    cells_.Reset();
+    oversized_.Reset();
+
+    for (auto& it : entries_)
+        Insert(it.Value);
+}
+
+void FARPlaneSpatialIndex::Update(const FARTrackedGeoData& data)
+{
+    FEntry* existing = entries_.Find(data.id_);
+    if (existing)
+        Unlink(*existing);
+
+    FEntry& entry = existing ? *existing : entries_.Add(data.id_);
+    entry.id_ = data.id_;
+    entry.localToWorld_ = data.localToWorld_;
+    entry.boundary_.Reset(data.boundaryVerts_.Num());
+    entry.worldBox_ = FBox(ForceInit);
+
+    for (const FVector& v : data.boundaryVerts_)
+    {
+        entry.boundary_.Add(FVector2D(v.X, v.Y));
+        entry.worldBox_ += data.localToWorld_.TransformPosition(v);
+    }
+
+    Insert(entry);
+}
+
+void FARPlaneSpatialIndex::Remove(const FGuid& id)
+{
+    FEntry entry;
+    if (entries_.RemoveAndCopyValue(id, entry))
+        Unlink(entry);
+}
+
+void FARPlaneSpatialIndex::Reset()
+{
+    entries_.Reset();
+    cells_.Reset();
+    oversized_.Reset();
+}
+
+const FBox* FARPlaneSpatialIndex::GetWorldBox(const FGuid& id) const
+{
+    const FEntry* entry = entries_.Find(id);
+    return entry ? &entry->worldBox_ : nullptr;
+}
+
+FIntVector FARPlaneSpatialIndex::ToCell(const FVector& p) const
+{
+    return FIntVector(FMath::FloorToInt(p.X / cellSize_),
+                      FMath::FloorToInt(p.Y / cellSize_),
+                      FMath::FloorToInt(p.Z / cellSize_));
+}
+
+void FARPlaneSpatialIndex::Insert(FEntry& entry)
+{
+    // planes with degenerate boundary are kept, but are never returned by queries
+    if (!entry.worldBox_.IsValid)
+    {
+        entry.oversized_ = false;
+        entry.cellMin_ = FIntVector(0, 0, 0);
+        entry.cellMax_ = FIntVector(-1, -1, -1);
+        return;
+    }
+
+    entry.cellMin_ = ToCell(entry.worldBox_.Min);
+    entry.cellMax_ = ToCell(entry.worldBox_.Max);
+    entry.oversized_ = NumCells(entry.cellMin_, entry.cellMax_) > kMaxCellsPerPlane;
+
+    if (entry.oversized_)
+    {
+        oversized_.Add(entry.id_);
+        return;
+    }
+
+    for (int32 x = entry.cellMin_.X; x <= entry.cellMax_.X; ++x)
+        for (int32 y = entry.cellMin_.Y; y <= entry.cellMax_.Y; ++y)
+            for (int32 z = entry.cellMin_.Z; z <= entry.cellMax_.Z; ++z)
+                cells_.FindOrAdd(FIntVector(x, y, z)).Add(entry.id_);
+}
+
+void FARPlaneSpatialIndex::Unlink(const FEntry& entry)
+{
+    if (entry.oversized_)
+    {
+        oversized_.RemoveSwap(entry.id_);
+        return;
+    }
+
+    for (int32 x = entry.cellMin_.X; x <= entry.cellMax_.X; ++x)
+        for (int32 y = entry.cellMin_.Y; y <= entry.cellMax_.Y; ++y)
+            for (int32 z = entry.cellMin_.Z; z <= entry.cellMax_.Z; ++z)
+            {
+                FIntVector cell(x, y, z);
+                TArray<FGuid>* ids = cells_.Find(cell);
+
+                if (ids)
+                {
+                    ids->RemoveSwap(entry.id_);
+                    if (ids->Num() == 0)
+                        cells_.Remove(cell);
+                }
+            }
+}
+
+template<typename Visitor>
+void FARPlaneSpatialIndex::ForEachInBox(const FBox& box, Visitor&& visitor) const
+{
+    uint32 stamp = ++queryStamp_;
+
+    auto visit = [this, stamp, &visitor](const FGuid& id)
+    {
+        const FEntry& entry = entries_.FindChecked(id);
+        if (entry.queryStamp_ == stamp)
+            return;
+
+        entry.queryStamp_ = stamp;
+        visitor(entry);
+    };
+
+    for (const FGuid& id : oversized_)
+        visit(id);
+
+    FIntVector cellMin = ToCell(box.Min);
+    FIntVector cellMax = ToCell(box.Max);
+
+    // box covers more cells than are occupied -- walking occupied cells is cheaper
+    if (NumCells(cellMin, cellMax) > cells_.Num())
+    {
+        for (const auto& it : cells_)
+        {
+            const FIntVector& c = it.Key;
+            if (c.X >= cellMin.X && c.X <= cellMax.X && c.Y >= cellMin.Y && c.Y <= cellMax.Y && c.Z >= cellMin.Z && c.Z <= cellMax.Z)
+                for (const FGuid& id : it.Value)
+                    visit(id);
+        }
+        return;
+    }
+
+    for (int32 x = cellMin.X; x <= cellMax.X; ++x)
+        for (int32 y = cellMin.Y; y <= cellMax.Y; ++y)
+            for (int32 z = cellMin.Z; z <= cellMax.Z; ++z)
+            {
+                const TArray<FGuid>* ids = cells_.Find(FIntVector(x, y, z));
+                if (ids)
+                    for (const FGuid& id : *ids)
+                        visit(id);
+            }
+}
+
+bool FARPlaneSpatialIndex::Raycast(const FVector& start, const FVector& end, FARPlaneQueryHit& outHit) const
+{
+    uint32 stamp = ++queryStamp_;
+    bool hasHit = false;
+    FARPlaneQueryHit hit;
+
+    auto test = [&](const FGuid& id)
+    {
+        const FEntry& entry = entries_.FindChecked(id);
+        if (entry.queryStamp_ == stamp)
+            return;
+
+        entry.queryStamp_ = stamp;
+
+        if (RaycastPlane(entry.localToWorld_, entry.boundary_, start, end, hit) &&
+            (!hasHit || hit.Distance < outHit.Distance))
+        {
+            hit.PlaneId = entry.id_;
+            outHit = hit;
+            hasHit = true;
+        }
+    };
+
+    for (const FGuid& id : oversized_)
+        test(id);
+
+    // 3D DDA over grid cells along the segment
+    FVector dir = end - start;
+    float length = dir.Size();
+    FIntVector cell = ToCell(start);
+    FIntVector endCell = ToCell(end);
+
+    int32 step[3];
+    float tMax[3], tDelta[3];
+
+    for (int32 axis = 0; axis < 3; ++axis)
+    {
+        float d = dir[axis];
+        step[axis] = d > 0.f ? 1 : (d < 0.f ? -1 : 0);
+
+        if (step[axis] == 0)
+        {
+            tMax[axis] = tDelta[axis] = MAX_flt;
+            continue;
+        }
+
+        float boundary = (cell[axis] + (step[axis] > 0 ? 1 : 0)) * cellSize_;
+        tMax[axis] = (boundary - start[axis]) / d;
+        tDelta[axis] = cellSize_ / FMath::Abs(d);
+    }
+
+    for (int32 i = 0; i < kMaxRaycastCells; ++i)
+    {
+        const TArray<FGuid>* ids = cells_.Find(cell);
+        if (ids)
+            for (const FGuid& id : *ids)
+                test(id);
+
+        if (cell == endCell)
+            break;
+
+        int32 axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+
+        // hits in cells further along the ray can't be closer
+        if (hasHit && outHit.Distance <= tMax[axis] * length)
+            break;
+
+        if (tMax[axis] > 1.f)
+            break;
+
+        cell[axis] += step[axis];
+        tMax[axis] += tDelta[axis];
+    }
+
+    return hasHit;
+}
+
+bool FARPlaneSpatialIndex::FindNearest(const FVector& point, float maxDistance, FARPlaneQueryHit& outHit) const
+{
+    bool hasHit = false;
+    float best = maxDistance > 0.f ? maxDistance : MAX_flt;
+
+    auto test = [&](const FEntry& entry)
+    {
+        if (!entry.worldBox_.IsValid || entry.worldBox_.ComputeSquaredDistanceToPoint(point) > best * best)
+            return;
+
+        FVector closest;
+        float distance = DistanceToPlane(entry.localToWorld_, entry.boundary_, point, closest);
+
+        if (distance <= best)
+        {
+            best = distance;
+            outHit.PlaneId = entry.id_;
+            outHit.Location = closest;
+            outHit.Normal = entry.localToWorld_.TransformVectorNoScale(FVector::UpVector);
+            outHit.Distance = distance;
+            hasHit = true;
+        }
+    };
+
+    if (maxDistance > 0.f)
+    {
+        ForEachInBox(FBox(point - FVector(maxDistance), point + FVector(maxDistance)), test);
+    }
+    else
+    {
+        for (const auto& it : entries_)
+            test(it.Value);
+    }
+
+    return hasHit;
+}
+
+void FARPlaneSpatialIndex::Overlap(const FBox& box, TArray<FGuid>& outIds) const
+{
+    ForEachInBox(box, [&box, &outIds](const FEntry& entry)
+    {
+        if (entry.worldBox_.IsValid && entry.worldBox_.Intersect(box))
+            outIds.Add(entry.id_);
+    });
+}
+
+bool FARPlaneSpatialIndex::IsPointOnPlane(const FGuid& id, const FVector& point, float maxHeight) const
+{
+    const FEntry* entry = entries_.Find(id);
+    if (!entry)
+        return false;
+
+    FVector local = entry->localToWorld_.InverseTransformPosition(point);
+
+    return FMath::Abs(local.Z) <= maxHeight &&
+        ARPolygonUtils::IsPointInside(entry->boundary_, FVector2D(local.X, local.Y));
+}
+
+bool FARPlaneSpatialIndex::RaycastPlane(const FTransform& localToWorld, const TArray<FVector2D>& boundary,
+                                        const FVector& start, const FVector& end, FARPlaneQueryHit& outHit)
+{
+    if (boundary.Num() < 3)
+        return false;
+
+    // plane is local z = 0
+    FVector localStart = localToWorld.InverseTransformPosition(start);
+    FVector localEnd = localToWorld.InverseTransformPosition(end);
+
+    if ((localStart.Z > 0.f) == (localEnd.Z > 0.f) || localStart.Z == localEnd.Z)
+        return false;
+
+    float t = localStart.Z / (localStart.Z - localEnd.Z);
+    FVector localHit = FMath::Lerp(localStart, localEnd, t);
+
+    if (!ARPolygonUtils::IsPointInside(boundary, FVector2D(localHit.X, localHit.Y)))
+        return false;
+
+    outHit.Location = FMath::Lerp(start, end, t);
+    outHit.Normal = localToWorld.TransformVectorNoScale(FVector::UpVector);
+    outHit.Distance = t * FVector::Dist(start, end);
+
+    return true;
+}
+
+float FARPlaneSpatialIndex::DistanceToPlane(const FTransform& localToWorld, const TArray<FVector2D>& boundary,
+                                            const FVector& point, FVector& outClosest)
+{
+    if (boundary.Num() < 3)
+    {
+        outClosest = point;
+        return MAX_flt;
+    }
+
+    FVector local = localToWorld.InverseTransformPosition(point);
+    FVector2D local2D(local.X, local.Y);
+
+    if (!ARPolygonUtils::IsPointInside(boundary, local2D))
+        local2D = ARPolygonUtils::ClosestPointOnBoundary(boundary, local2D);
+
+    outClosest = localToWorld.TransformPosition(FVector(local2D.X, local2D.Y, 0.f));
+
+    return FVector::Dist(outClosest, point);
+}
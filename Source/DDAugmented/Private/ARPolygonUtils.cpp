@@ -0,0 +1,364 @@
+//
+// ARPolygonUtils.cpp
+//
+
+#include "ARPolygonUtils.h"
+
+namespace
+{
+    // smallest cos(half corner angle) used for miter, limits miter to 2x offset
+    constexpr float kMinMiterCos = 0.5f;
+
+    // number of times SafeOffsetInwards halves the offset before giving up
+    constexpr int32 kOffsetAttempts = 4;
+
+    float Cross(const FVector2D& a, const FVector2D& b, const FVector2D& c)
+    {
+        return FVector2D::CrossProduct(b - a, c - b);
+    }
+
+    bool PointInTriangle(const FVector2D& p, const FVector2D& a, const FVector2D& b, const FVector2D& c, float orientation)
+    {
+        return Cross(a, b, p) * orientation >= 0.f &&
+            Cross(b, c, p) * orientation >= 0.f &&
+            Cross(c, a, p) * orientation >= 0.f;
+    }
+
+    bool SegmentsIntersect(const FVector2D& a0, const FVector2D& a1, const FVector2D& b0, const FVector2D& b1)
+    {
+        float d0 = FVector2D::CrossProduct(a1 - a0, b0 - a0);
+        float d1 = FVector2D::CrossProduct(a1 - a0, b1 - a0);
+        float d2 = FVector2D::CrossProduct(b1 - b0, a0 - b0);
+        float d3 = FVector2D::CrossProduct(b1 - b0, a1 - b0);
+
+        return ((d0 > 0.f) != (d1 > 0.f)) && ((d2 > 0.f) != (d3 > 0.f));
+    }
+
+    using FSimplifySpan = ARPolygonUtils::FSimplifyScratch::FSpan;
+
+    FSimplifySpan MakeSpan(const TArray<FVector>& polygon, int32 first, int32 last)
+    {
+        int32 n = polygon.Num();
+        FSimplifySpan span{ first, last, INDEX_NONE, 0.f };
+
+        for (int32 i = (first + 1) % n; i != last; i = (i + 1) % n)
+        {
+            float d = FMath::PointDistToSegment(polygon[i], polygon[first], polygon[last]);
+            if (d > span.distance_)
+            {
+                span.distance_ = d;
+                span.farthest_ = i;
+            }
+        }
+
+        return span;
+    }
+}
+
+float ARPolygonUtils::SignedArea(const TArray<FVector2D>& polygon)
+{
+    float area = 0.f;
+
+    for (int32 i = 0, n = polygon.Num(); i < n; ++i)
+        area += FVector2D::CrossProduct(polygon[i], polygon[(i + 1) % n]);
+
+    return area * 0.5f;
+}
+
+float ARPolygonUtils::SignedArea(const TArray<FVector>& polygon)
+{
+    float area = 0.f;
+
+    for (int32 i = 0, n = polygon.Num(); i < n; ++i)
+    {
+        const FVector& a = polygon[i];
+        const FVector& b = polygon[(i + 1) % n];
+        area += a.X * b.Y - a.Y * b.X;
+    }
+
+    return area * 0.5f;
+}
+
+bool ARPolygonUtils::IsPointInside(const TArray<FVector2D>& polygon, const FVector2D& point)
+{
+    bool inside = false;
+
+    for (int32 i = 0, j = polygon.Num() - 1; i < polygon.Num(); j = i++)
+    {
+        const FVector2D& a = polygon[i];
+        const FVector2D& b = polygon[j];
+
+        if ((a.Y > point.Y) != (b.Y > point.Y) &&
+            point.X < (b.X - a.X) * (point.Y - a.Y) / (b.Y - a.Y) + a.X)
+            inside = !inside;
+    }
+
+    return inside;
+}
+
+FVector2D ARPolygonUtils::ClosestPointOnBoundary(const TArray<FVector2D>& polygon, const FVector2D& point)
+{
+    FVector2D closest = point;
+    float bestDistSq = MAX_flt;
+
+    for (int32 i = 0, j = polygon.Num() - 1; i < polygon.Num(); j = i++)
+    {
+        const FVector2D& a = polygon[j];
+        FVector2D ab = polygon[i] - a;
+        float lenSq = ab.SizeSquared();
+        float t = lenSq > SMALL_NUMBER ? FMath::Clamp(FVector2D::DotProduct(point - a, ab) / lenSq, 0.f, 1.f) : 0.f;
+        FVector2D candidate = a + ab * t;
+        float distSq = FVector2D::DistSquared(candidate, point);
+
+        if (distSq < bestDistSq)
+        {
+            bestDistSq = distSq;
+            closest = candidate;
+        }
+    }
+
+    return closest;
+}
+
+bool ARPolygonUtils::IsSimple(const TArray<FVector2D>& polygon)
+{
+    int32 n = polygon.Num();
+
+    for (int32 i = 0; i < n; ++i)
+    {
+        const FVector2D& a0 = polygon[i];
+        const FVector2D& a1 = polygon[(i + 1) % n];
+
+        // skip adjacent edges, they share a vertex
+        for (int32 j = i + 2; j < n; ++j)
+        {
+            if (i == 0 && j == n - 1)
+                continue;
+
+            if (SegmentsIntersect(a0, a1, polygon[j], polygon[(j + 1) % n]))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool ARPolygonUtils::Triangulate(const TArray<FVector2D>& polygon, TArray<int32>& outIndices)
+{
+    TArray<int32> remaining;
+    return Triangulate(polygon, outIndices, remaining);
+}
+
+bool ARPolygonUtils::Triangulate(const TArray<FVector2D>& polygon, TArray<int32>& outIndices, TArray<int32>& remaining)
+{
+    int32 n = polygon.Num();
+    outIndices.Reset(FMath::Max(0, n - 2) * 3);
+
+    if (n < 3)
+        return n == 0;
+
+    float orientation = SignedArea(polygon) >= 0.f ? 1.f : -1.f;
+    bool clean = true;
+
+    remaining.Reset(n);
+    for (int32 i = 0; i < n; ++i)
+        remaining.Add(i);
+
+    // index into remaining, kept moving around the polygon so ears are
+    // found in amortized O(n) steps on typical boundaries
+    int32 cursor = 0;
+    int32 nFailed = 0;
+
+    while (remaining.Num() > 3)
+    {
+        int32 m = remaining.Num();
+        int32 iPrev = remaining[(cursor + m - 1) % m];
+        int32 iCur = remaining[cursor % m];
+        int32 iNext = remaining[(cursor + 1) % m];
+
+        const FVector2D& a = polygon[iPrev];
+        const FVector2D& b = polygon[iCur];
+        const FVector2D& c = polygon[iNext];
+
+        bool isEar = Cross(a, b, c) * orientation >= 0.f;
+
+        for (int32 k = 0; k < m && isEar; ++k)
+        {
+            int32 iTest = remaining[k];
+            if (iTest == iPrev || iTest == iCur || iTest == iNext)
+                continue;
+
+            const FVector2D& p = polygon[iTest];
+            if (p.Equals(a) || p.Equals(b) || p.Equals(c))
+                continue;
+
+            isEar = !PointInTriangle(p, a, b, c, orientation);
+        }
+
+        // went full circle without an ear -- polygon is not simple, clip anyway
+        if (!isEar && nFailed < m)
+        {
+            nFailed++;
+            cursor = (cursor + 1) % m;
+            continue;
+        }
+
+        clean &= isEar;
+        nFailed = 0;
+
+        outIndices.Add(iPrev);
+        outIndices.Add(iCur);
+        outIndices.Add(iNext);
+
+        remaining.RemoveAt(cursor % m, 1, false);
+        cursor = (cursor % m) % remaining.Num();
+    }
+
+    outIndices.Add(remaining[0]);
+    outIndices.Add(remaining[1]);
+    outIndices.Add(remaining[2]);
+
+    return clean;
+}
+
+void ARPolygonUtils::ConvexHull(const TArray<FVector2D>& points, TArray<FVector2D>& outHull)
+{
+    TArray<FVector2D> sorted = points;
+    sorted.Sort([](const FVector2D& a, const FVector2D& b) { return a.X < b.X || (a.X == b.X && a.Y < b.Y); });
+
+    int32 n = sorted.Num();
+    outHull.Reset(n + 1);
+
+    if (n < 3)
+    {
+        outHull = sorted;
+        return;
+    }
+
+    // lower hull, then upper hull; collinear points are dropped
+    for (int32 i = 0; i < n; ++i)
+    {
+        while (outHull.Num() >= 2 && Cross(outHull[outHull.Num() - 2], outHull.Last(), sorted[i]) <= 0.f)
+            outHull.Pop(false);
+        outHull.Add(sorted[i]);
+    }
+
+    for (int32 i = n - 2, lower = outHull.Num() + 1; i >= 0; --i)
+    {
+        while (outHull.Num() >= lower && Cross(outHull[outHull.Num() - 2], outHull.Last(), sorted[i]) <= 0.f)
+            outHull.Pop(false);
+        outHull.Add(sorted[i]);
+    }
+
+    // last point repeats the first
+    outHull.Pop(false);
+}
+
+void ARPolygonUtils::OffsetInwards(const TArray<FVector2D>& polygon, float distance, TArray<FVector2D>& outPolygon)
+{
+    int32 n = polygon.Num();
+    float orientation = SignedArea(polygon) >= 0.f ? 1.f : -1.f;
+
+    outPolygon.SetNumUninitialized(n);
+
+    for (int32 i = 0; i < n; ++i)
+    {
+        const FVector2D& prev = polygon[(i + n - 1) % n];
+        const FVector2D& cur = polygon[i];
+        const FVector2D& next = polygon[(i + 1) % n];
+
+        FVector2D e0 = (cur - prev).GetSafeNormal();
+        FVector2D e1 = (next - cur).GetSafeNormal();
+
+        // left side of an edge is inside for counter-clockwise polygons
+        FVector2D n0 = FVector2D(-e0.Y, e0.X) * orientation;
+        FVector2D n1 = FVector2D(-e1.Y, e1.X) * orientation;
+        FVector2D bisector = (n0 + n1).GetSafeNormal();
+
+        // duplicate vertex or 180 degree spike
+        if (bisector.IsNearlyZero())
+            bisector = !n0.IsNearlyZero() ? n0 : n1;
+
+        float cosHalf = FVector2D::DotProduct(bisector, !n0.IsNearlyZero() ? n0 : n1);
+        outPolygon[i] = cur + bisector * (distance / FMath::Max(cosHalf, kMinMiterCos));
+    }
+}
+
+float ARPolygonUtils::SafeOffsetInwards(const TArray<FVector2D>& polygon, float distance, TArray<FVector2D>& outPolygon)
+{
+    float area = SignedArea(polygon);
+
+    for (int32 attempt = 0; attempt < kOffsetAttempts && distance > KINDA_SMALL_NUMBER; ++attempt, distance *= 0.5f)
+    {
+        OffsetInwards(polygon, distance, outPolygon);
+
+        float offsetArea = SignedArea(outPolygon);
+
+        // offset past the polygon's "thickness" flips or tangles the result
+        if (offsetArea * area > 0.f && FMath::Abs(offsetArea) < FMath::Abs(area) && IsSimple(outPolygon))
+            return distance;
+    }
+
+    outPolygon.Reset(polygon.Num());
+    outPolygon.Append(polygon);
+    return 0.f;
+}
+
+void ARPolygonUtils::SimplifyClosed(const TArray<FVector>& polygon, float tolerance, int32 maxVertices, TArray<FVector>& outPolygon)
+{
+    FSimplifyScratch scratch;
+    SimplifyClosed(polygon, tolerance, maxVertices, outPolygon, scratch);
+}
+
+void ARPolygonUtils::SimplifyClosed(const TArray<FVector>& polygon, float tolerance, int32 maxVertices, TArray<FVector>& outPolygon,
+                                    FSimplifyScratch& scratch)
+{
+    int32 n = polygon.Num();
+
+    if (n <= 3 || (tolerance <= 0.f && (maxVertices <= 0 || n <= maxVertices)))
+    {
+        outPolygon.Reset(n);
+        outPolygon.Append(polygon);
+        return;
+    }
+
+    maxVertices = maxVertices > 0 ? FMath::Max(maxVertices, 3) : n;
+
+    // closed polygon: start from vertex 0 and the vertex farthest from it
+    int32 opposite = 1;
+    for (int32 i = 2; i < n; ++i)
+        if (FVector::DistSquared(polygon[i], polygon[0]) > FVector::DistSquared(polygon[opposite], polygon[0]))
+            opposite = i;
+
+    TArray<bool>& keep = scratch.keep_;
+    keep.Reset(n);
+    keep.AddZeroed(n);
+    keep[0] = keep[opposite] = true;
+    int32 nKept = 2;
+
+    TArray<FSimplifySpan>& heap = scratch.heap_;
+    heap.Reset();
+    heap.HeapPush(MakeSpan(polygon, 0, opposite));
+    heap.HeapPush(MakeSpan(polygon, opposite, 0));
+
+    while (heap.Num() && nKept < maxVertices)
+    {
+        FSimplifySpan span;
+        heap.HeapPop(span, false);
+
+        // a triangle needs a third vertex even if it is within tolerance
+        if (span.farthest_ == INDEX_NONE || (span.distance_ <= tolerance && nKept >= 3))
+            continue;
+
+        keep[span.farthest_] = true;
+        nKept++;
+
+        heap.HeapPush(MakeSpan(polygon, span.first_, span.farthest_));
+        heap.HeapPush(MakeSpan(polygon, span.farthest_, span.last_));
+    }
+
+    outPolygon.Reset(nKept);
+    for (int32 i = 0; i < n; ++i)
+        if (keep[i])
+            outPolygon.Add(polygon[i]);
+}
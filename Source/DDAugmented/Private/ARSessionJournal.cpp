@@ -0,0 +1,853 @@
+//
+// ARSessionJournal.cpp
+//
+
+#include "ARSessionJournal.h"
+#include "AugmentedDebugger.h"
+#include "ARPlaneRenderer.h"
+#include "ARGeoDelta.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Serialization/BitReader.h"
+#include "Misc/Crc.h"
+#include "DDLog.h"
+
+using namespace ARSessionJournal;
+
+namespace
+{
+    void SerializeRecordType(FArchive& Ar, ERecord& type)
+    {
+        uint32 value = (uint32)type;
+        Ar.SerializeInt(value, kRecordTypes);
+        type = (ERecord)value;
+    }
+
+    void SerializeTrackingInfo(FArchive& Ar, FTrackingInfo& info)
+    {
+        ARGeoQuantize::SerializeTransform(Ar, info.PawnToTrackOrigin);
+        ARGeoQuantize::SerializeTransform(Ar, info.TrackingAlignment);
+
+        uint8 sessionStatus = (uint8)info.ArSessionStatus;
+        uint8 trackingQuality = (uint8)info.TrackingQuality;
+        uint8 mappingState = (uint8)info.WorldMappingState;
+        Ar << sessionStatus << trackingQuality << mappingState;
+        Ar << info.SessionStatusInfo;
+
+        info.ArSessionStatus = (EARSessionStatus)sessionStatus;
+        info.TrackingQuality = (EARTrackingQuality)trackingQuality;
+        info.WorldMappingState = (EARWorldMappingState)mappingState;
+    }
+
+    // everything but identity, which goes in the image's definition record
+    void SerializeImage(FArchive& Ar, FTrackedImageData& image)
+    {
+        ARGeoQuantize::SerializeTransform(Ar, image.PawnToImage);
+        Ar << image.EstimatedSize;
+
+        uint8 trackingState = (uint8)image.TrackingState;
+        uint8 picked = image.PickedForEstimation ? 1 : 0;
+        Ar << trackingState;
+        Ar.SerializeBits(&picked, 1);
+
+        image.TrackingState = (EARTrackingState)trackingState;
+        image.PickedForEstimation = picked != 0;
+    }
+
+    // everything but identity. Boundary is quantized like replicated planes
+    void SerializePlaneSample(FArchive& Ar, FARPlaneSample& sample)
+    {
+        uint8 trackingState = (uint8)sample.trackingState_;
+        uint8 subsumed = sample.subsumed_ ? 1 : 0;
+        uint32 frame = (uint32)sample.lastUpdateFrame_;
+        Ar << trackingState;
+        Ar.SerializeBits(&subsumed, 1);
+        Ar.SerializeIntPacked(frame);
+
+        ARGeoQuantize::SerializeTransform(Ar, sample.localToWorld_);
+        ARGeoQuantize::SerializeTransform(Ar, sample.localToTracking_);
+        Ar << sample.extent_;
+
+        // longer boundaries are cut, AR sessions don't report anything near as long
+        uint32 nVerts = FMath::Min<uint32>(sample.boundary_.Num(), ARGeoQuantize::kMaxBoundaryVertices);
+        Ar.SerializeIntPacked(nVerts);
+
+        if (Ar.IsLoading())
+        {
+            if (nVerts > (uint32)ARGeoQuantize::kMaxBoundaryVertices)
+            {
+                Ar.SetError();
+                return;
+            }
+            sample.boundary_.SetNumUninitialized(nVerts);
+        }
+
+        for (uint32 i = 0; i < nVerts; ++i)
+        {
+            FVector& v = sample.boundary_[i];
+            int16 x = ARGeoQuantize::QuantizePosition(v.X);
+            int16 y = ARGeoQuantize::QuantizePosition(v.Y);
+            Ar << x << y;
+
+            if (Ar.IsLoading())
+                v = FVector(ARGeoQuantize::DequantizePosition(x), ARGeoQuantize::DequantizePosition(y), 0.f);
+        }
+
+        sample.trackingState_ = (EARTrackingState)trackingState;
+        sample.subsumed_ = subsumed != 0;
+        sample.lastUpdateFrame_ = (int32)frame;
+    }
+}
+
+FARSessionJournalWriter::FARSessionJournalWriter()
+    : ChunkSize(64 * 1024)
+    , FlushInterval(1.f)
+    , MaxPendingChunks(8)
+    , MaxPendingBytes(2 * 1024 * 1024)
+    , IndexInterval(16)
+    , Payload(0, true)
+    , PayloadRecords(0)
+    , ChunkTime(0.)
+    , CurrentTime(0.)
+    , bFrameWritten(false)
+    , bChunkKeyframe(true)
+    , bKeyframeRequested(false)
+    , bSegmentPending(false)
+    , NextImageIndex(1)
+    , NextPlaneIndex(1)
+    , NextOffset(0)
+    , LastIndexOffset(0)
+    , QueuedBytes(0)
+    , BytesWritten(0)
+    , DroppedChunks(0)
+{
+}
+
+FARSessionJournalWriter::~FARSessionJournalWriter()
+{
+    Close();
+}
+
+bool FARSessionJournalWriter::Open(const FString& path)
+{
+    Close();
+
+    File.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*path));
+
+    if (!File.IsValid())
+    {
+        DLOG_MODULE_ERROR(DDAugmented, "Can't open session journal {}", TCHAR_TO_ANSI(*path));
+        return false;
+    }
+
+    Payload.Reset();
+    PayloadRecords = 0;
+    CurrentTime = 0.;
+    NextOffset = 0;
+    LastIndexOffset = 0;
+    IndexEntries.Reset();
+    BytesWritten = 0;
+    DroppedChunks = 0;
+
+    FFileHeader header;
+    FMemory::Memzero(header);
+    header.magic_ = kMagic;
+    header.version_ = kVersion;
+    header.startTicks_ = FDateTime::UtcNow().GetTicks();
+
+    QueueBlock(&header, sizeof(header), nullptr, 0);
+    StartSegment();
+
+    return true;
+}
+
+void FARSessionJournalWriter::Close()
+{
+    if (!File.IsValid())
+        return;
+
+    FlushChunk(false);
+    QueueIndexBlock();
+
+    FFooter footer;
+    FMemory::Memzero(footer);
+    footer.tag_ = kFooterTag;
+    footer.lastIndexOffset_ = LastIndexOffset;
+    QueueBlock(&footer, sizeof(footer), nullptr, 0);
+
+    LaunchWrite();
+    while (WriteTask.IsValid())
+    {
+        WriteTask.Wait();
+        CommitWrite();
+    }
+
+    File.Reset();
+    PendingBlocks.Reset();
+    QueuedBytes = 0;
+    ImageDefinitions.Reset();
+    PlaneDefinitions.Reset();
+}
+
+bool FARSessionJournalWriter::ConsumeKeyframe()
+{
+    bool requested = bKeyframeRequested;
+    bKeyframeRequested = false;
+    return requested;
+}
+
+void FARSessionJournalWriter::SetTime(double time)
+{
+    if (time == CurrentTime)
+        return;
+
+    CurrentTime = time;
+    bFrameWritten = false;
+
+    // segments start on a frame boundary, so the caller's full state is the keyframe chunk's first frame.
+    // The segment starts over either way, so the chunk may be dropped like any other
+    if (bSegmentPending)
+    {
+        FlushChunk(true);
+        StartSegment();
+    }
+}
+
+void FARSessionJournalWriter::WriteTrackingInfo(const FTrackingInfo& info)
+{
+    if (!IsOpen())
+        return;
+
+    FlushIfFull();
+
+    BeginRecord(ERecord::TrackingInfo);
+    FTrackingInfo copy = info;
+    SerializeTrackingInfo(Payload, copy);
+}
+
+void FARSessionJournalWriter::WriteImage(const FTrackedImageData& image)
+{
+    if (!IsOpen())
+        return;
+
+    FlushIfFull();
+
+    uint32 index = Define(ImageDefinitions, NextImageIndex, ERecord::ImageDefine, image.id_, image.ImageName);
+
+    BeginRecord(ERecord::Image);
+    Payload.SerializeIntPacked(index);
+    FTrackedImageData copy = image;
+    SerializeImage(Payload, copy);
+}
+
+void FARSessionJournalWriter::RemoveImage(const FGuid& id)
+{
+    FDefinition definition;
+
+    if (!IsOpen() || !ImageDefinitions.RemoveAndCopyValue(id, definition))
+        return;
+
+    FlushIfFull();
+
+    BeginRecord(ERecord::ImageRemove);
+    Payload.SerializeIntPacked(definition.index_);
+}
+
+void FARSessionJournalWriter::WritePlane(const FARTrackedGeoData& data)
+{
+    if (!IsOpen())
+        return;
+
+    FlushIfFull();
+
+    uint32 index = Define(PlaneDefinitions, NextPlaneIndex, ERecord::PlaneDefine, data.id_, data.debugName_.ToString());
+
+    // plane wire format with the journal index standing in for the net id
+    FARTrackedGeoData copy = data;
+    copy.netId_ = (uint16)index;
+
+    BeginRecord(ERecord::Plane);
+    bool success = false;
+    copy.NetSerialize(Payload, nullptr, success);
+}
+
+void FARSessionJournalWriter::RemovePlane(const FGuid& id)
+{
+    FDefinition definition;
+
+    if (!IsOpen() || !PlaneDefinitions.RemoveAndCopyValue(id, definition))
+        return;
+
+    FlushIfFull();
+
+    BeginRecord(ERecord::PlaneRemove);
+    Payload.SerializeIntPacked(definition.index_);
+}
+
+void FARSessionJournalWriter::WritePlaneSample(const FARPlaneSample& sample)
+{
+    if (!IsOpen())
+        return;
+
+    FlushIfFull();
+
+    uint32 index = Define(PlaneDefinitions, NextPlaneIndex, ERecord::PlaneDefine, sample.sourceId_, sample.debugName_.ToString());
+
+    BeginRecord(ERecord::PlaneSample);
+    Payload.SerializeIntPacked(index);
+    FARPlaneSample copy = sample;
+    SerializePlaneSample(Payload, copy);
+
+    // AR session never reports a stopped plane again
+    if (sample.trackingState_ == EARTrackingState::StoppedTracking)
+        PlaneDefinitions.Remove(sample.sourceId_);
+}
+
+void FARSessionJournalWriter::Tick()
+{
+    CommitWrite();
+
+    if (IsOpen() && PayloadRecords && CurrentTime - ChunkTime >= FlushInterval)
+        FlushChunk(true);
+}
+
+void FARSessionJournalWriter::StartSegment()
+{
+    ImageDefinitions.Reset();
+    PlaneDefinitions.Reset();
+    // 0 is not a valid plane net id
+    NextImageIndex = 1;
+    NextPlaneIndex = 1;
+    bChunkKeyframe = true;
+    bKeyframeRequested = true;
+    bSegmentPending = false;
+}
+
+void FARSessionJournalWriter::FlushChunk(bool bAllowDrop)
+{
+    if (!PayloadRecords)
+        return;
+
+    FBlockHeader header;
+    FMemory::Memzero(header);
+    header.tag_ = kChunkTag;
+    header.size_ = (uint32)Payload.GetNumBytes();
+    header.time_ = ChunkTime;
+    header.count_ = PayloadRecords;
+    header.flags_ = bChunkKeyframe ? kKeyframe : 0;
+
+    // queued and in-flight bytes both count: a stalled write holds on to its batch
+    bool dropped = bAllowDrop && (PendingBlocks.Num() >= MaxPendingChunks ||
+        QueuedBytes + sizeof(header) + header.size_ > (uint64)MaxPendingBytes);
+
+    if (!dropped)
+    {
+        FIndexEntry& entry = IndexEntries.AddZeroed_GetRef();
+        entry.time_ = ChunkTime;
+        entry.offset_ = NextOffset;
+        entry.flags_ = header.flags_;
+
+        QueueBlock(&header, sizeof(header), Payload.GetData(), header.size_);
+    }
+
+    Payload.Reset();
+    PayloadRecords = 0;
+    bFrameWritten = false;
+    bChunkKeyframe = false;
+
+    if (dropped)
+    {
+        // definitions of the dropped chunk are lost. Records referring to them
+        // until the next frame are skipped by readers
+        DroppedChunks++;
+        bSegmentPending = true;
+
+        DLOG_MODULE_WARN(DDAugmented, "Session journal writer is behind, dropped chunk at {:.2f}s", ChunkTime);
+    }
+    else if (IndexEntries.Num() >= IndexInterval)
+    {
+        QueueIndexBlock();
+        bSegmentPending = true;
+    }
+
+    LaunchWrite();
+}
+
+void FARSessionJournalWriter::FlushIfFull()
+{
+    if (Payload.GetNumBytes() >= ChunkSize)
+        FlushChunk(true);
+}
+
+void FARSessionJournalWriter::QueueIndexBlock()
+{
+    if (!IndexEntries.Num())
+        return;
+
+    FBlockHeader header;
+    FMemory::Memzero(header);
+    header.tag_ = kIndexTag;
+    header.size_ = sizeof(uint64) + IndexEntries.Num() * sizeof(FIndexEntry);
+    header.time_ = IndexEntries.Last().time_;
+    header.count_ = IndexEntries.Num();
+
+    TArray<uint8> payload;
+    payload.SetNumUninitialized(header.size_);
+    FMemory::Memcpy(payload.GetData(), &LastIndexOffset, sizeof(uint64));
+    FMemory::Memcpy(payload.GetData() + sizeof(uint64), IndexEntries.GetData(), IndexEntries.Num() * sizeof(FIndexEntry));
+
+    LastIndexOffset = NextOffset;
+    QueueBlock(&header, sizeof(header), payload.GetData(), payload.Num());
+
+    IndexEntries.Reset();
+}
+
+void FARSessionJournalWriter::QueueBlock(const void* header, int32 headerSize, const void* payload, int32 payloadSize)
+{
+    TArray<uint8>& block = PendingBlocks.AddDefaulted_GetRef();
+    block.SetNumUninitialized(headerSize + payloadSize);
+    FMemory::Memcpy(block.GetData(), header, headerSize);
+    if (payloadSize)
+        FMemory::Memcpy(block.GetData() + headerSize, payload, payloadSize);
+
+    NextOffset += block.Num();
+    QueuedBytes += block.Num();
+}
+
+void FARSessionJournalWriter::BeginRecord(ERecord type)
+{
+    if (!PayloadRecords)
+    {
+        ChunkTime = CurrentTime;
+        bFrameWritten = false;
+    }
+
+    if (!bFrameWritten)
+    {
+        ERecord frame = ERecord::Frame;
+        SerializeRecordType(Payload, frame);
+
+        uint32 ms = (uint32)FMath::Max(0, FMath::RoundToInt((CurrentTime - ChunkTime) * 1000.));
+        Payload.SerializeIntPacked(ms);
+
+        PayloadRecords++;
+        bFrameWritten = true;
+    }
+
+    SerializeRecordType(Payload, type);
+    PayloadRecords++;
+}
+
+uint32 FARSessionJournalWriter::Define(TMap<FGuid, FDefinition>& definitions, uint32& nextIndex, ERecord type,
+                                       const FGuid& id, const FString& name)
+{
+    uint32 nameHash = FCrc::StrCrc32(*name);
+    FDefinition* definition = definitions.Find(id);
+
+    if (definition && definition->nameHash_ == nameHash)
+        return definition->index_;
+
+    if (!definition)
+    {
+        // indices of this segment are used up -- start over with a keyframe
+        if (nextIndex > kMaxDefinitions)
+        {
+            FlushChunk(true);
+            StartSegment();
+        }
+
+        definition = &definitions.Add(id);
+        definition->index_ = nextIndex++;
+    }
+
+    definition->nameHash_ = nameHash;
+
+    BeginRecord(type);
+    Payload.SerializeIntPacked(definition->index_);
+    FGuid idCopy = id;
+    FString nameCopy = name;
+    Payload << idCopy << nameCopy;
+
+    return definition->index_;
+}
+
+void FARSessionJournalWriter::LaunchWrite()
+{
+    if (WriteTask.IsValid() || !PendingBlocks.Num() || !File.IsValid())
+        return;
+
+    BlocksInFlight = MoveTemp(PendingBlocks);
+    PendingBlocks.Reset();
+
+    // file and blocks are left alone by game thread until the task is committed
+    IFileHandle* file = File.Get();
+    const TArray<TArray<uint8>>* blocks = &BlocksInFlight;
+
+    WriteTask = Async(EAsyncExecution::ThreadPool, [file, blocks]()
+    {
+        for (const TArray<uint8>& block : *blocks)
+            if (!file->Write(block.GetData(), block.Num()))
+                return false;
+
+        return true;
+    });
+}
+
+void FARSessionJournalWriter::CommitWrite()
+{
+    if (!WriteTask.IsValid() || !WriteTask.IsReady())
+        return;
+
+    bool res = WriteTask.Get();
+    WriteTask = TFuture<bool>();
+
+    if (!res)
+    {
+        DLOG_MODULE_ERROR(DDAugmented, "Session journal write failed, journal stopped");
+
+        File.Reset();
+        PendingBlocks.Reset();
+        BlocksInFlight.Reset();
+        QueuedBytes = 0;
+        return;
+    }
+
+    for (const TArray<uint8>& block : BlocksInFlight)
+    {
+        BytesWritten += block.Num();
+        QueuedBytes -= block.Num();
+    }
+
+    BlocksInFlight.Reset();
+
+    LaunchWrite();
+}
+
+FARSessionJournalReader::FARSessionJournalReader()
+    : NextChunk(0)
+    , bKeyframeOpen(false)
+    , KeyframeTime(0.)
+{
+}
+
+FARSessionJournalReader::~FARSessionJournalReader()
+{
+    Close();
+}
+
+bool FARSessionJournalReader::Open(const FString& path)
+{
+    Close();
+
+    File.Reset(IFileManager::Get().CreateFileReader(*path, FILEREAD_Silent));
+
+    FFileHeader header;
+    if (!File.IsValid() || !ReadAt(0, &header, sizeof(header)) ||
+        header.magic_ != kMagic || header.version_ > kVersion)
+    {
+        Close();
+        return false;
+    }
+
+    StartTime = FDateTime(header.startTicks_);
+
+    if (!ReadIndexBlocks())
+        ScanIndex();
+
+    NextChunk = 0;
+    return true;
+}
+
+void FARSessionJournalReader::Close()
+{
+    File.Reset();
+    Index.Reset();
+    ChunkBytes.Empty();
+    NextChunk = 0;
+    bKeyframeOpen = false;
+}
+
+bool FARSessionJournalReader::Seek(double time)
+{
+    int32 found = INDEX_NONE;
+
+    for (int32 i = 0; i < Index.Num() && (found == INDEX_NONE || Index[i].time_ <= time); ++i)
+        if (Index[i].flags_ & kKeyframe)
+            found = i;
+
+    if (found == INDEX_NONE)
+        return false;
+
+    NextChunk = found;
+    bKeyframeOpen = false;
+    return true;
+}
+
+bool FARSessionJournalReader::ReadChunk(IARSessionJournalVisitor& visitor)
+{
+    if (!IsOpen() || NextChunk >= Index.Num())
+    {
+        if (bKeyframeOpen)
+        {
+            bKeyframeOpen = false;
+            visitor.OnKeyframeEnd(KeyframeTime);
+        }
+
+        return false;
+    }
+
+    FBlockHeader header;
+    uint64 offset = Index[NextChunk++].offset_;
+
+    if (!ReadAt(offset, &header, sizeof(header)) || header.tag_ != kChunkTag || header.size_ > kMaxChunkSize)
+        return false;
+
+    ChunkBytes.SetNumUninitialized(header.size_);
+    if (!ReadAt(offset + sizeof(header), ChunkBytes.GetData(), header.size_))
+        return false;
+
+    if (header.flags_ & kKeyframe)
+    {
+        if (bKeyframeOpen)
+            visitor.OnKeyframeEnd(KeyframeTime);
+
+        ImageIds.Reset();
+        ImageNames.Reset();
+        PlaneIds.Reset();
+        PlaneNames.Reset();
+
+        bKeyframeOpen = true;
+        KeyframeTime = header.time_;
+        visitor.OnKeyframe(header.time_);
+    }
+
+    FBitReader reader(ChunkBytes.GetData(), (int64)header.size_ * 8);
+    double time = header.time_;
+
+    auto resolve = [](const TArray<FGuid>& ids, uint32 index)
+    {
+        return ids.IsValidIndex(index) ? ids[index] : FGuid();
+    };
+
+    for (uint32 i = 0; i < header.count_ && !reader.IsError(); ++i)
+    {
+        ERecord type = ERecord::Count;
+        SerializeRecordType(reader, type);
+
+        switch (type)
+        {
+            case ERecord::Frame:
+            {
+                uint32 ms = 0;
+                reader.SerializeIntPacked(ms);
+
+                time = header.time_ + ms / 1000.;
+
+                // keyframe's full state may go on in following chunks, it ends with its frame
+                if (bKeyframeOpen && time != KeyframeTime)
+                {
+                    bKeyframeOpen = false;
+                    visitor.OnKeyframeEnd(KeyframeTime);
+                }
+                break;
+            }
+            case ERecord::TrackingInfo:
+            {
+                FTrackingInfo info;
+                SerializeTrackingInfo(reader, info);
+                if (!reader.IsError())
+                    visitor.OnTrackingInfo(time, info);
+                break;
+            }
+            case ERecord::ImageDefine:
+            case ERecord::PlaneDefine:
+            {
+                uint32 index = 0;
+                FGuid id;
+                FString name;
+                reader.SerializeIntPacked(index);
+                reader << id << name;
+
+                if (index == 0 || index > kMaxDefinitions)
+                    reader.SetError();
+
+                if (reader.IsError())
+                    break;
+
+                if (type == ERecord::ImageDefine)
+                {
+                    ImageIds.SetNum(FMath::Max<int32>(ImageIds.Num(), index + 1));
+                    ImageNames.SetNum(ImageIds.Num());
+                    ImageIds[index] = id;
+                    ImageNames[index] = name;
+                }
+                else
+                {
+                    PlaneIds.SetNum(FMath::Max<int32>(PlaneIds.Num(), index + 1));
+                    PlaneNames.SetNum(PlaneIds.Num());
+                    PlaneIds[index] = id;
+                    PlaneNames[index] = FName(*name);
+                }
+                break;
+            }
+            case ERecord::Image:
+            {
+                uint32 index = 0;
+                reader.SerializeIntPacked(index);
+
+                FTrackedImageData image;
+                SerializeImage(reader, image);
+                image.id_ = resolve(ImageIds, index);
+
+                // records of items defined in a dropped chunk are skipped
+                if (!reader.IsError() && image.id_.IsValid())
+                {
+                    image.ImageName = ImageNames[index];
+                    visitor.OnImage(time, image);
+                }
+                break;
+            }
+            case ERecord::Plane:
+            {
+                FARTrackedGeoData data;
+                bool success = false;
+                data.NetSerialize(reader, nullptr, success);
+                data.id_ = resolve(PlaneIds, data.netId_);
+
+                if (!reader.IsError() && data.id_.IsValid())
+                {
+                    data.debugName_ = PlaneNames[data.netId_];
+                    data.netId_ = 0;
+                    visitor.OnPlane(time, data);
+                }
+                break;
+            }
+            case ERecord::PlaneSample:
+            {
+                uint32 index = 0;
+                reader.SerializeIntPacked(index);
+
+                FARPlaneSample sample;
+                SerializePlaneSample(reader, sample);
+                sample.sourceId_ = resolve(PlaneIds, index);
+
+                if (!reader.IsError() && sample.sourceId_.IsValid())
+                {
+                    sample.debugName_ = PlaneNames[index];
+                    visitor.OnPlaneSample(time, sample);
+                }
+                break;
+            }
+            case ERecord::ImageRemove:
+            case ERecord::PlaneRemove:
+            {
+                uint32 index = 0;
+                reader.SerializeIntPacked(index);
+
+                FGuid id = resolve(type == ERecord::ImageRemove ? ImageIds : PlaneIds, index);
+
+                if (!reader.IsError() && id.IsValid())
+                {
+                    if (type == ERecord::ImageRemove)
+                        visitor.OnImageRemoved(time, id);
+                    else
+                        visitor.OnPlaneRemoved(time, id);
+                }
+                break;
+            }
+            default:
+                reader.SetError();
+                break;
+        }
+    }
+
+    if (reader.IsError())
+    {
+        DLOG_MODULE_WARN(DDAugmented, "Session journal chunk at offset {} is damaged", offset);
+        return false;
+    }
+
+    return true;
+}
+
+bool FARSessionJournalReader::ReadIndexBlocks()
+{
+    int64 fileSize = File->TotalSize();
+    FFooter footer;
+
+    if (fileSize < (int64)(sizeof(FFileHeader) + sizeof(FFooter)) ||
+        !ReadAt(fileSize - sizeof(FFooter), &footer, sizeof(footer)) || footer.tag_ != kFooterTag)
+        return false;
+
+    // index blocks are linked back to front
+    TArray<TArray<FIndexEntry>> blocks;
+    uint64 offset = footer.lastIndexOffset_;
+
+    while (offset)
+    {
+        FBlockHeader header;
+        uint64 previous = 0;
+
+        if (offset >= (uint64)fileSize || !ReadAt(offset, &header, sizeof(header)) || header.tag_ != kIndexTag)
+            return false;
+
+        // in 64 bit, and within the file, before the count is trusted with an allocation
+        uint64 entryBytes = (uint64)header.count_ * sizeof(FIndexEntry);
+        if ((uint64)header.size_ != sizeof(uint64) + entryBytes ||
+            offset + sizeof(header) + header.size_ > (uint64)fileSize ||
+            !ReadAt(offset + sizeof(header), &previous, sizeof(previous)) || previous >= offset)
+            return false;
+
+        TArray<FIndexEntry>& entries = blocks.AddDefaulted_GetRef();
+        entries.SetNumUninitialized(header.count_);
+        if (!ReadAt(offset + sizeof(header) + sizeof(previous), entries.GetData(), entryBytes))
+            return false;
+
+        offset = previous;
+    }
+
+    for (int32 i = blocks.Num() - 1; i >= 0; --i)
+        Index.Append(blocks[i]);
+
+    return true;
+}
+
+void FARSessionJournalReader::ScanIndex()
+{
+    int64 fileSize = File->TotalSize();
+    uint64 offset = sizeof(FFileHeader);
+    FBlockHeader header;
+
+    Index.Reset();
+
+    // blocks up to the first one that is cut short or damaged
+    while (offset + sizeof(header) <= (uint64)fileSize && ReadAt(offset, &header, sizeof(header)))
+    {
+        uint64 next = offset + sizeof(header) + header.size_;
+
+        if ((header.tag_ != kChunkTag && header.tag_ != kIndexTag) || next > (uint64)fileSize)
+            break;
+
+        if (header.tag_ == kChunkTag)
+        {
+            FIndexEntry& entry = Index.AddZeroed_GetRef();
+            entry.time_ = header.time_;
+            entry.offset_ = offset;
+            entry.flags_ = header.flags_;
+        }
+
+        offset = next;
+    }
+}
+
+bool FARSessionJournalReader::ReadAt(uint64 offset, void* dest, int64 size)
+{
+    if ((int64)offset + size > File->TotalSize())
+        return false;
+
+    File->Seek(offset);
+    File->Serialize(dest, size);
+
+    return !File->IsError();
+}
@@ -5,9 +5,129 @@
 #include "DDLog.h"
 #include "DDBlueprintLibrary.h"
 #include "ARBasePlayerController.h"
+#include "FiducialSnapshot.h"
+#include "ARGeoDelta.h"
+#include "EngineUtils.h"
+#include "Async/Async.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
 #include <Net/UnrealNetwork.h>
 #include <Math/UnrealMathUtility.h>
 
+namespace
+{
+    // above wire quantization (0.1cm, ~0.005 deg), so a pose compares equal to its replicated copy
+    constexpr float kImageMinTranslation = 0.1f;
+    constexpr float kImageMinRotation = 0.1f;
+    constexpr float kImageMinSizeChange = 0.1f;
+}
+
+void FTrackedImagePose::FromImageData(const FTrackedImageData& image)
+{
+    PawnToImage = image.PawnToImage;
+    EstimatedSize = image.EstimatedSize;
+    TrackingState = image.TrackingState;
+    PickedForEstimation = image.PickedForEstimation;
+}
+
+void FTrackedImagePose::ToImageData(FTrackedImageData& image) const
+{
+    image.PawnToImage = PawnToImage;
+    image.EstimatedSize = EstimatedSize;
+    image.TrackingState = TrackingState;
+    image.PickedForEstimation = PickedForEstimation;
+}
+
+bool FTrackedImagePose::Differs(const FTrackedImagePose& other) const
+{
+    return TrackingState != other.TrackingState ||
+        PickedForEstimation != other.PickedForEstimation ||
+        FVector::Dist(PawnToImage.GetTranslation(), other.PawnToImage.GetTranslation()) >= kImageMinTranslation ||
+        FMath::RadiansToDegrees(PawnToImage.GetRotation().AngularDistance(other.PawnToImage.GetRotation())) >= kImageMinRotation ||
+        (EstimatedSize - other.EstimatedSize).GetAbsMax() >= kImageMinSizeChange;
+}
+
+bool FTrackedImagePose::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+    uint32 netId = netId_;
+    Ar.SerializeIntPacked(netId);
+    
+    if (netId > MAX_uint16)
+    {
+        Ar.SetError();
+        bOutSuccess = false;
+        return true;
+    }
+    
+    netId_ = (uint16)netId;
+    
+    if (netId_ == 0)
+        Ar << id_;
+    
+    ARGeoQuantize::SerializeTransform(Ar, PawnToImage);
+    
+    // estimated size in mm
+    uint32 sizeX = (uint32)FMath::RoundToInt(FMath::Max(0.f, EstimatedSize.X) * 10.f);
+    uint32 sizeY = (uint32)FMath::RoundToInt(FMath::Max(0.f, EstimatedSize.Y) * 10.f);
+    Ar.SerializeIntPacked(sizeX);
+    Ar.SerializeIntPacked(sizeY);
+    
+    uint8 trackingState = (uint8)TrackingState;
+    uint8 picked = PickedForEstimation ? 1 : 0;
+    Ar << trackingState;
+    Ar.SerializeBits(&picked, 1);
+    
+    if (Ar.IsLoading())
+    {
+        // comes from AR clients' RPCs -- don't let an unknown state into server state
+        if (trackingState > (uint8)EARTrackingState::StoppedTracking)
+        {
+            Ar.SetError();
+            bOutSuccess = false;
+            return true;
+        }
+        
+        EstimatedSize = FVector2D(sizeX / 10.f, sizeY / 10.f);
+        TrackingState = (EARTrackingState)trackingState;
+        PickedForEstimation = picked != 0;
+    }
+    
+    bOutSuccess = !Ar.IsError();
+    return true;
+}
+
+void FTrackedImageHeader::PostReplicatedAdd(const FTrackedImageHeaderArray& InArraySerializer)
+{
+    if (InArraySerializer.Owner)
+        InArraySerializer.Owner->OnImageHeaderReplicated(*this);
+}
+
+void FTrackedImageHeader::PostReplicatedChange(const FTrackedImageHeaderArray& InArraySerializer)
+{
+    // image renamed
+    if (InArraySerializer.Owner)
+        InArraySerializer.Owner->OnImageHeaderReplicated(*this);
+}
+
+void FTrackedImageItem::PreReplicatedRemove(const FTrackedImageArray& InArraySerializer)
+{
+    if (InArraySerializer.Owner)
+        InArraySerializer.Owner->OnImagePoseRemoved(pose_);
+}
+
+void FTrackedImageItem::PostReplicatedAdd(const FTrackedImageArray& InArraySerializer)
+{
+    if (InArraySerializer.Owner)
+        InArraySerializer.Owner->OnImagePoseReplicated(pose_);
+}
+
+void FTrackedImageItem::PostReplicatedChange(const FTrackedImageArray& InArraySerializer)
+{
+    if (InArraySerializer.Owner)
+        InArraySerializer.Owner->OnImagePoseReplicated(pose_);
+}
+
 // Sets default values for this component's properties
 UAugmentedDebugger::UAugmentedDebugger()
 {
@@ -15,6 +135,30 @@ UAugmentedDebugger::UAugmentedDebugger()
 	// off to improve performance if you don't need them.
 	PrimaryComponentTick.bCanEverTick = true;
     SetIsReplicatedByDefault(true);
+    
+    TrackedImageHeaders.Owner = this;
+    TrackedImagePoses.Owner = this;
+    NextImageNetId = 0;
+    TrackedImageIndexFrame = 0;
+    ImageReconcileInterval = 2.f;
+    LastImageReconcileTime = 0.f;
+    
+    MaxQueuedSnapshots = 4;
+    
+    JournalInterval = 0.1f;
+    JournalChunkSizeKB = 64;
+    JournalFlushInterval = 1.f;
+    MaxPendingJournalChunks = 8;
+    bJournalPlaneSamples = true;
+    JournalStartTime = 0.;
+    LastJournalTime = 0.;
+    bJournaledTrackingInfo = false;
+    
+    ReplayRate = 1.f;
+    NextReplayRecord = 0;
+    ReplayTime = 0.;
+    ReplayStartTime = 0.;
+    bReplayKeyframe = false;
 }
 
 void UAugmentedDebugger::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const { Super::GetLifetimeReplicatedProps(OutLifetimeProps);
@@ -23,6 +167,8 @@ void UAugmentedDebugger::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& O
     DOREPLIFETIME_CONDITION(UAugmentedDebugger, isRenderingPawn, COND_OwnerOnly);
     DOREPLIFETIME_CONDITION(UAugmentedDebugger, isRenderingTrackOrigin, COND_OwnerOnly);
     DOREPLIFETIME_CONDITION(UAugmentedDebugger, isRenderingImages, COND_OwnerOnly);
+    DOREPLIFETIME(UAugmentedDebugger, TrackedImageHeaders);
+    DOREPLIFETIME(UAugmentedDebugger, TrackedImagePoses);
 }
 
 // Called when the game starts
@@ -49,6 +195,39 @@ void UAugmentedDebugger::BeginPlay()
 void UAugmentedDebugger::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+    
+    CommitSnapshotWrite();
+    
+    if (Replay.IsOpen())
+        UpdateReplay(DeltaTime);
+    
+    FlushImageUpdates();
+    
+    if (GetOwnerRole() == ROLE_Authority && GetNetMode() != NM_Standalone)
+        ReplicateTrackedImages();
+    
+    if (Journal.IsOpen())
+    {
+        if (GetWorld()->GetTimeSeconds() - LastJournalTime >= JournalInterval)
+            UpdateJournal();
+        
+        Journal.Tick();
+    }
+}
+
+void UAugmentedDebugger::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    StopReplay();
+    StopJournal();
+    
+    // session is over -- finish queued snapshots rather than losing them
+    while (SnapshotTask.IsValid())
+    {
+        SnapshotTask.Wait();
+        CommitSnapshotWrite();
+    }
+    
+    Super::EndPlay(EndPlayReason);
 }
 
 
@@ -133,19 +312,23 @@ void UAugmentedDebugger::ServerAddTrackedImage_Implementation(FTrackedImageData
                           TCHAR_TO_ANSI(*tImage.id_.ToString()),
                           TCHAR_TO_ANSI(*tImage.ImageName),
                           TCHAR_TO_ANSI(*tImage.PawnToImage.ToHumanReadableString()));
-        TrackedImages.Add(tImage);
+        
+        if (FindTrackedImage(tImage.id_))
+            DLOG_MODULE_WARN(DDAugmented, "TrackedImage {} already exists -- overwriting",
+                             TCHAR_TO_ANSI(*tImage.id_.ToString()));
+        
+        AddTrackedImage(tImage);
     }
 }
 
-void UAugmentedDebugger::ServerRemoveTrackedImage_Implementation(const TArray<FString>& imageIds)
+void UAugmentedDebugger::ServerRemoveTrackedImage_Implementation(const TArray<FGuid>& imageIds)
 {
     if (GetNetMode() != NM_Standalone)
     {
         DLOG_MODULE_TRACE(DDAugmented, "Removing {} old tracked image", imageIds.Num());
         
-        TrackedImages.RemoveAll([imageIds](FTrackedImageData v){
-            return imageIds.Contains(v.id_.ToString());
-        });
+        for (const FGuid& id : imageIds)
+            RemoveTrackedImage(id);
     }
 }
 
@@ -158,13 +341,11 @@ void UAugmentedDebugger::ServerUpdateTrackedImage_Implementation(FTrackedImageDa
         //                     TCHAR_TO_ANSI(*tImage.ImageName),
         //                     TCHAR_TO_ANSI(*tImage.PawnToImage.ToHumanReadableString()));
         
-        auto* updateImageData =
-        TrackedImages.FindByPredicate([&tImage](const FTrackedImageData& img){
-            return tImage.id_.ToString().Equals(img.id_.ToString());
-        });
+        auto* updateImageData = FindTrackedImage(tImage.id_);
         
         if (updateImageData)
         {
+            MarkImageDirty(tImage.id_);
             updateImageData->PawnToImage = tImage.PawnToImage;
             updateImageData->EstimatedSize = tImage.EstimatedSize;
             updateImageData->TrackingState = tImage.TrackingState;
@@ -174,6 +355,341 @@ void UAugmentedDebugger::ServerUpdateTrackedImage_Implementation(FTrackedImageDa
     }
 }
 
+void UAugmentedDebugger::UpdateTrackedImage(const FTrackedImageData& tImage)
+{
+    FTrackedImagePose& pose = PendingImageUpdates.FindOrAdd(tImage.id_);
+    pose.id_ = tImage.id_;
+    pose.FromImageData(tImage);
+}
+
+void UAugmentedDebugger::FlushImageUpdates()
+{
+    if (!PendingImageUpdates.Num())
+        return;
+    
+    TArray<FTrackedImagePose> batch;
+    batch.Reserve(PendingImageUpdates.Num());
+    
+    for (auto& it : PendingImageUpdates)
+    {
+        FTrackedImagePose& pose = it.Value;
+        
+        // compared against what the server replicated back, so a lost batch is resent
+        if (const FTrackedImageData* replicated = FindTrackedImage(it.Key))
+        {
+            FTrackedImagePose current;
+            current.FromImageData(*replicated);
+            if (!pose.Differs(current))
+                continue;
+        }
+        
+        // short net id once the image's header got here, full id until then
+        const uint16* netId = ImageNetIds.Find(it.Key);
+        pose.netId_ = netId ? *netId : 0;
+        batch.Add(pose);
+    }
+    
+    PendingImageUpdates.Reset();
+    
+    if (batch.Num())
+        ServerUpdateTrackedImages(batch);
+}
+
+void UAugmentedDebugger::ServerUpdateTrackedImages_Implementation(const TArray<FTrackedImagePose>& poses)
+{
+    if (GetNetMode() == NM_Standalone)
+        return;
+    
+    for (const FTrackedImagePose& pose : poses)
+    {
+        FGuid id = pose.id_;
+        
+        if (pose.netId_)
+        {
+            const FImageIdentity* identity = ImageIdentities.Find(pose.netId_);
+            if (!identity)
+                continue;
+            
+            id = identity->id_;
+        }
+        
+        // changes replicate from ReplicateTrackedImages
+        if (FTrackedImageData* image = FindTrackedImage(id))
+        {
+            pose.ToImageData(*image);
+            MarkImageDirty(id);
+        }
+    }
+}
+
+void UAugmentedDebugger::ReplicateTrackedImages()
+{
+    if (ImageReconcileInterval > 0.f && GetWorld()->GetTimeSeconds() - LastImageReconcileTime >= ImageReconcileInterval)
+    {
+        ReconcileTrackedImages();
+        return;
+    }
+    
+    if (!DirtyImages.Num())
+        return;
+    
+    bool removed = false;
+    
+    for (const FGuid& id : DirtyImages)
+    {
+        if (const FTrackedImageData* image = FindTrackedImage(id))
+        {
+            ReplicateTrackedImage(*image);
+        }
+        else if (const int32* idx = ReplicatedImageIndex.Find(id))
+        {
+            RemoveReplicatedImage(*idx);
+            removed = true;
+        }
+    }
+    
+    DirtyImages.Reset();
+    
+    if (removed)
+    {
+        TrackedImagePoses.MarkArrayDirty();
+        TrackedImageHeaders.MarkArrayDirty();
+    }
+}
+
+void UAugmentedDebugger::ReconcileTrackedImages()
+{
+    LastImageReconcileTime = GetWorld()->GetTimeSeconds();
+    DirtyImages.Reset();
+    
+    ReconciledImages.Reset();
+    
+    for (const FTrackedImageData& image : TrackedImages)
+    {
+        bool duplicate = false;
+        ReconciledImages.Add(image.id_, &duplicate);
+        if (!duplicate)
+            ReplicateTrackedImage(image);
+    }
+    
+    // nothing was removed since last pass
+    if (ReconciledImages.Num() == TrackedImagePoses.Items.Num())
+        return;
+    
+    for (int32 i = TrackedImagePoses.Items.Num() - 1; i >= 0; --i)
+        if (!ReconciledImages.Contains(TrackedImagePoses.Items[i].pose_.id_))
+            RemoveReplicatedImage(i);
+    
+    TrackedImagePoses.MarkArrayDirty();
+    TrackedImageHeaders.MarkArrayDirty();
+}
+
+void UAugmentedDebugger::ReplicateTrackedImage(const FTrackedImageData& image)
+{
+    FTrackedImagePose pose;
+    pose.FromImageData(image);
+    
+    const int32* idx = ReplicatedImageIndex.Find(image.id_);
+    
+    if (!idx)
+    {
+        uint16 netId = AllocateImageNetId();
+        
+        FImageIdentity& identity = ImageIdentities.Add(netId);
+        identity.id_ = image.id_;
+        identity.name_ = image.ImageName;
+        ImageNetIds.Add(image.id_, netId);
+        
+        FTrackedImageHeader& header = TrackedImageHeaders.Items.AddDefaulted_GetRef();
+        header.netId_ = netId;
+        header.id_ = image.id_;
+        header.ImageName = image.ImageName;
+        TrackedImageHeaders.MarkItemDirty(header);
+        
+        // id_ stays off the wire, items are sent by net id
+        FTrackedImageItem& item = TrackedImagePoses.Items.AddDefaulted_GetRef();
+        item.pose_ = pose;
+        item.pose_.netId_ = netId;
+        item.pose_.id_ = image.id_;
+        TrackedImagePoses.MarkItemDirty(item);
+        
+        ReplicatedImageIndex.Add(image.id_, TrackedImagePoses.Items.Num() - 1);
+        return;
+    }
+    
+    FTrackedImageHeader& header = TrackedImageHeaders.Items[*idx];
+    if (header.ImageName != image.ImageName)
+    {
+        header.ImageName = image.ImageName;
+        ImageIdentities.FindChecked(header.netId_).name_ = image.ImageName;
+        TrackedImageHeaders.MarkItemDirty(header);
+    }
+    
+    FTrackedImageItem& item = TrackedImagePoses.Items[*idx];
+    if (item.pose_.Differs(pose))
+    {
+        item.pose_.FromImageData(image);
+        TrackedImagePoses.MarkItemDirty(item);
+    }
+}
+
+void UAugmentedDebugger::RemoveReplicatedImage(int32 idx)
+{
+    const FTrackedImagePose& pose = TrackedImagePoses.Items[idx].pose_;
+    
+    ReplicatedImageIndex.Remove(pose.id_);
+    ImageNetIds.Remove(pose.id_);
+    ImageIdentities.Remove(pose.netId_);
+    
+    // headers stay at the index of their pose items
+    TrackedImagePoses.Items.RemoveAtSwap(idx);
+    TrackedImageHeaders.Items.RemoveAtSwap(idx);
+    if (TrackedImagePoses.Items.IsValidIndex(idx))
+        ReplicatedImageIndex.Add(TrackedImagePoses.Items[idx].pose_.id_, idx);
+}
+
+void UAugmentedDebugger::MarkImageDirty(const FGuid& id)
+{
+    // only the server replicates images
+    if (GetOwnerRole() == ROLE_Authority && GetNetMode() != NM_Standalone)
+        DirtyImages.Add(id);
+}
+
+uint16 UAugmentedDebugger::AllocateImageNetId()
+{
+    // 0 marks poses with inline identity; ids wrap after 65535 images
+    do
+    {
+        NextImageNetId++;
+    }
+    while (NextImageNetId == 0 || ImageIdentities.Contains(NextImageNetId));
+    
+    return NextImageNetId;
+}
+
+void UAugmentedDebugger::OnImageHeaderReplicated(const FTrackedImageHeader& header)
+{
+    FImageIdentity& identity = ImageIdentities.FindOrAdd(header.netId_);
+    identity.id_ = header.id_;
+    identity.name_ = header.ImageName;
+    ImageNetIds.Add(header.id_, header.netId_);
+    
+    if (FTrackedImageData* image = FindTrackedImage(header.id_))
+        image->ImageName = header.ImageName;
+    
+    FTrackedImagePose pose;
+    if (UnresolvedImagePoses.RemoveAndCopyValue(header.netId_, pose))
+        OnImagePoseReplicated(pose);
+}
+
+void UAugmentedDebugger::OnImagePoseReplicated(const FTrackedImagePose& pose)
+{
+    const FImageIdentity* identity = ImageIdentities.Find(pose.netId_);
+    
+    // header is on its way, picked up with it
+    if (!identity)
+    {
+        UnresolvedImagePoses.Add(pose.netId_, pose);
+        return;
+    }
+    
+    FTrackedImageData* image = FindTrackedImage(identity->id_);
+    
+    if (!image)
+    {
+        FTrackedImageData added;
+        added.id_ = identity->id_;
+        added.ImageName = identity->name_;
+        image = &AddTrackedImage(added);
+    }
+    
+    pose.ToImageData(*image);
+}
+
+void UAugmentedDebugger::OnImagePoseRemoved(const FTrackedImagePose& pose)
+{
+    UnresolvedImagePoses.Remove(pose.netId_);
+    
+    FImageIdentity identity;
+    if (!ImageIdentities.RemoveAndCopyValue(pose.netId_, identity))
+        return;
+    
+    ImageNetIds.Remove(identity.id_);
+    RemoveTrackedImage(identity.id_);
+}
+
+FTrackedImageData* UAugmentedDebugger::FindTrackedImage(const FGuid& id)
+{
+    const int32* idx = TrackedImageIndex.Find(id);
+    
+    // Blueprints may change TrackedImages directly, bypassing Server*TrackedImage.
+    // A stale entry, or the first miss of a frame, resyncs the index; later misses
+    // in the frame trust it, so a burst of adds doesn't rescan per image
+    bool stale = idx ? !(TrackedImages.IsValidIndex(*idx) && TrackedImages[*idx].id_ == id) :
+        TrackedImageIndexFrame != GFrameCounter;
+    
+    if (stale)
+    {
+        RebuildTrackedImageIndex();
+        idx = TrackedImageIndex.Find(id);
+    }
+    
+    return idx ? &TrackedImages[*idx] : nullptr;
+}
+
+void UAugmentedDebugger::RebuildTrackedImageIndex()
+{
+    TrackedImageIndex.Reset();
+    TrackedImageIndexFrame = GFrameCounter;
+    
+    for (int32 i = 0; i < TrackedImages.Num();)
+    {
+        const FGuid& id = TrackedImages[i].id_;
+        
+        // first image with the id wins
+        if (TrackedImageIndex.Contains(id))
+        {
+            DLOG_MODULE_WARN(DDAugmented, "TrackedImage {} is in TrackedImages twice -- dropping the copy",
+                             TCHAR_TO_ANSI(*id.ToString()));
+            TrackedImages.RemoveAt(i);
+            continue;
+        }
+        
+        TrackedImageIndex.Add(id, i++);
+    }
+}
+
+FTrackedImageData& UAugmentedDebugger::AddTrackedImage(const FTrackedImageData& image)
+{
+    MarkImageDirty(image.id_);
+    
+    FTrackedImageData* existing = FindTrackedImage(image.id_);
+    
+    if (existing)
+    {
+        *existing = image;
+        return *existing;
+    }
+    
+    int32 idx = TrackedImages.Add(image);
+    TrackedImageIndex.Add(image.id_, idx);
+    return TrackedImages[idx];
+}
+
+void UAugmentedDebugger::RemoveTrackedImage(const FGuid& id)
+{
+    if (!FindTrackedImage(id))
+        return;
+    
+    int32 idx = TrackedImageIndex.FindAndRemoveChecked(id);
+    MarkImageDirty(id);
+    
+    // swap keeps removal O(1) -- only the moved image needs its index patched
+    TrackedImages.RemoveAtSwap(idx);
+    if (TrackedImages.IsValidIndex(idx))
+        TrackedImageIndex.Add(TrackedImages[idx].id_, idx);
+}
+
 FTrackedImageData UAugmentedDebugger::MakeNewTrackedImageData() const
 {
     FGuid guid(FMath::RandRange(0,32000),
@@ -190,92 +706,513 @@ void UAugmentedDebugger::SnapFiducials(const FString& fileName, bool onlyTrackin
 {
     FString filePath = UDDBlueprintLibrary::GetCrossPlatformWriteableFolder() + "/" + fileName;
     
-    TArray<FTrackedImageData> imageData = TrackedImages.FilterByPredicate([&](const FTrackedImageData& img){
-        return onlyTracking ? img.TrackingState == EARTrackingState::Tracking : true;
+    // a newer snapshot to the same file replaces the one still waiting
+    FSnapshotJob* job = QueuedSnapshots.FindByPredicate([&](const FSnapshotJob& queued){
+        return queued.filePath_ == filePath;
     });
     
-    SaveFiducialImages(filePath, imageData);
+    if (!job && SnapshotTask.IsValid() && QueuedSnapshots.Num() >= MaxQueuedSnapshots)
+    {
+        DLOG_MODULE_WARN(FiducialRelocalizer, "{} fiducial snapshots are queued -- dropping snapshot {}",
+                         QueuedSnapshots.Num(), TCHAR_TO_ANSI(*filePath));
+        OnFiducialSnapshotSaved.Broadcast(filePath, false);
+    }
+    else
+    {
+        if (!job)
+        {
+            job = &QueuedSnapshots.AddDefaulted_GetRef();
+            job->filePath_ = filePath;
+        }
+        
+        job->images_ = TrackedImages.FilterByPredicate([&](const FTrackedImageData& img){
+            return onlyTracking ? img.TrackingState == EARTrackingState::Tracking : true;
+        });
+        
+        LaunchSnapshotWrite();
+    }
     
     if (GetNetMode() == NM_Client)
         ServerSnapFiducials(fileName, onlyTracking);
 }
 
+void UAugmentedDebugger::LaunchSnapshotWrite() const
+{
+    if (SnapshotTask.IsValid() || QueuedSnapshots.Num() == 0)
+        return;
+    
+    SnapshotInFlight = MoveTemp(QueuedSnapshots[0]);
+    QueuedSnapshots.RemoveAt(0);
+    
+    // job is left alone by game thread until the task is committed
+    const FSnapshotJob* job = &SnapshotInFlight;
+    
+    // file I/O blocks, so it goes to the thread pool rather than task graph workers
+    SnapshotTask = Async(EAsyncExecution::ThreadPool, [job]()
+    {
+        return SaveFiducialImages(job->filePath_, job->images_);
+    });
+}
+
+void UAugmentedDebugger::CommitSnapshotWrite()
+{
+    if (!SnapshotTask.IsValid() || !SnapshotTask.IsReady())
+        return;
+    
+    bool res = SnapshotTask.Get();
+    SnapshotTask = TFuture<bool>();
+    
+    FString filePath = MoveTemp(SnapshotInFlight.filePath_);
+    SnapshotInFlight.images_.Empty();
+    
+    LaunchSnapshotWrite();
+    
+    OnFiducialSnapshotSaved.Broadcast(filePath, res);
+}
+
 void UAugmentedDebugger::ServerSnapFiducials_Implementation(const FString& fileName, bool onlyTracking = false) const
 {
     SnapFiducials(fileName, onlyTracking);
 }
 
-bool UAugmentedDebugger::SaveFiducialImages(const FString& savePath,
-const TArray<FTrackedImageData>& imageData)
+bool UAugmentedDebugger::StartJournal(const FString& fileName)
 {
-    FBufferArchive binArchive;
-    int nSerialized = 0;
+    StopJournal();
+    
+    FString filePath = UDDBlueprintLibrary::GetCrossPlatformWriteableFolder() + "/" + fileName;
+    
+    Journal.ChunkSize = FMath::Max(1, JournalChunkSizeKB) * 1024;
+    Journal.FlushInterval = JournalFlushInterval;
+    Journal.MaxPendingChunks = MaxPendingJournalChunks;
+    // pending chunks plus an in-flight batch as large, each chunk can run over ChunkSize by a record
+    Journal.MaxPendingBytes = (int32)FMath::Min<int64>((int64)Journal.ChunkSize * FMath::Max(1, MaxPendingJournalChunks) * 4, MAX_int32);
     
-    if (imageData.Num())
+    if (!Journal.Open(filePath))
+        return false;
+    
+    JournalStartTime = GetWorld()->GetTimeSeconds();
+    UpdateJournal();
+    
+    DLOG_MODULE_DEBUG(DDAugmented, "Started session journal {}", TCHAR_TO_ANSI(*filePath));
+    return true;
+}
+
+void UAugmentedDebugger::StopJournal()
+{
+    if (!Journal.IsOpen())
+        return;
+    
+    // last changes since the previous pass
+    UpdateJournal();
+    UnbindPlaneSamples();
+    Journal.Close();
+    
+    DLOG_MODULE_DEBUG(DDAugmented, "Stopped session journal, {} bytes written, {} chunks dropped",
+                      Journal.GetBytesWritten(), Journal.GetDroppedChunks());
+    
+    JournaledImages.Reset();
+    JournaledPlaneRevisions.Reset();
+    bJournaledTrackingInfo = false;
+}
+
+void UAugmentedDebugger::UpdateJournal()
+{
+    LastJournalTime = GetWorld()->GetTimeSeconds();
+    
+    if (!BeginJournalFrame())
+        JournalChanges();
+    
+    // renderer may be spawned (or replaced) after the journal started
+    AARPlaneRenderer* renderer = bJournalPlaneSamples ? FindPlaneRenderer() : nullptr;
+    
+    if (renderer != SampledPlaneRenderer.Get())
     {
-        int nFiducials = imageData.Num();
-        binArchive << nFiducials;
+        UnbindPlaneSamples();
+        
+        if (renderer)
+        {
+            PlaneSampleHandle = renderer->OnPlaneSample.AddUObject(this, &UAugmentedDebugger::JournalPlaneSample);
+            SampledPlaneRenderer = renderer;
+        }
     }
+}
+
+bool UAugmentedDebugger::BeginJournalFrame()
+{
+    Journal.SetTime(GetWorld()->GetTimeSeconds() - JournalStartTime);
+    
+    if (!Journal.ConsumeKeyframe())
+        return false;
+    
+    // new keyframe segment -- everything goes in again, in its first frame
+    JournaledImages.Reset();
+    JournaledPlaneRevisions.Reset();
+    bJournaledTrackingInfo = false;
+    
+    JournalChanges();
+    return true;
+}
 
-    for (auto image : imageData)
+void UAugmentedDebugger::JournalChanges()
+{
+    if (!bJournaledTrackingInfo || !Equals(TrackingInfo, JournaledTrackingInfo) ||
+        TrackingInfo.SessionStatusInfo != JournaledTrackingInfo.SessionStatusInfo ||
+        !TrackingInfo.TrackingAlignment.Equals(JournaledTrackingInfo.TrackingAlignment, 0.01))
     {
-        SaveLoadTrackedImage(binArchive, image);
-        nSerialized += 1;
+        Journal.WriteTrackingInfo(TrackingInfo);
+        JournaledTrackingInfo = TrackingInfo;
+        bJournaledTrackingInfo = true;
     }
     
-    if (binArchive.Num() <= 0)
-        DLOG_MODULE_WARN(FiducialRelocalizer, "Fiducial snapshot is empty");
-    else
+    TSet<FGuid> live;
+    live.Reserve(TrackedImages.Num());
+    
+    for (const FTrackedImageData& image : TrackedImages)
     {
-        // save to a file
-        bool res = FFileHelper::SaveArrayToFile(binArchive, *savePath);
+        live.Add(image.id_);
         
-        binArchive.FlushCache();
-        binArchive.Empty();
+        FTrackedImageData* journaled = JournaledImages.Find(image.id_);
         
-        if (!res)
-            DLOG_MODULE_ERROR(FiducialRelocalizer, "Failed to save to file {}", TCHAR_TO_ANSI(*savePath));
-        else
-            DLOG_MODULE_DEBUG(FiducialRelocalizer, "Succesfully saved {} fiducial snapshots to file {}",
-                              nSerialized,
-                              TCHAR_TO_ANSI(*savePath));
+        if (journaled && journaled->PawnToImage.Equals(image.PawnToImage, 0.01) &&
+            journaled->EstimatedSize.Equals(image.EstimatedSize, 0.01) &&
+            journaled->TrackingState == image.TrackingState &&
+            journaled->PickedForEstimation == image.PickedForEstimation &&
+            journaled->ImageName == image.ImageName)
+            continue;
         
-        return res;
+        Journal.WriteImage(image);
+        JournaledImages.Add(image.id_, image);
+    }
+    
+    for (auto it = JournaledImages.CreateIterator(); it; ++it)
+    {
+        if (!live.Contains(it.Key()))
+        {
+            Journal.RemoveImage(it.Key());
+            it.RemoveCurrent();
+        }
     }
     
-    return false;
+    AARPlaneRenderer* renderer = FindPlaneRenderer();
+    live.Reset();
+    
+    if (renderer)
+    {
+        for (const FARTrackedGeoItem& item : renderer->GeoDataArray.Items)
+        {
+            const FARTrackedGeoData& data = item.data_;
+            
+            // client: plane still waiting for its header
+            if (!data.id_.IsValid())
+                continue;
+            
+            live.Add(data.id_);
+            
+            uint32* revision = JournaledPlaneRevisions.Find(data.id_);
+            
+            if (revision && *revision == data.revision_)
+                continue;
+            
+            Journal.WritePlane(data);
+            JournaledPlaneRevisions.Add(data.id_, data.revision_);
+        }
+    }
+    
+    for (auto it = JournaledPlaneRevisions.CreateIterator(); it; ++it)
+    {
+        if (!live.Contains(it.Key()))
+        {
+            Journal.RemovePlane(it.Key());
+            it.RemoveCurrent();
+        }
+    }
 }
 
-bool UAugmentedDebugger::LoadFiducialImages(const FString& loadPath, TArray<FTrackedImageData>& imageData)
+void UAugmentedDebugger::JournalPlaneSample(const FARPlaneSample& sample)
 {
-    TArray<uint8> BinaryArray;
+    // samples come from the renderer's tick, in frames between journal passes
+    BeginJournalFrame();
+    Journal.WritePlaneSample(sample);
+}
+
+void UAugmentedDebugger::UnbindPlaneSamples()
+{
+    if (SampledPlaneRenderer.IsValid())
+        SampledPlaneRenderer->OnPlaneSample.Remove(PlaneSampleHandle);
     
-    if (!FFileHelper::LoadFileToArray(BinaryArray, *loadPath)) return false;
+    SampledPlaneRenderer.Reset();
+    PlaneSampleHandle.Reset();
+}
+
+bool UAugmentedDebugger::StartReplay(const FString& fileName)
+{
+    StopReplay();
     
-    if (BinaryArray.Num() <= 0) return false;
+    FString filePath = UDDBlueprintLibrary::GetCrossPlatformWriteableFolder() + "/" + fileName;
+    
+    if (!Replay.Open(filePath))
+    {
+        DLOG_MODULE_ERROR(DDAugmented, "Can't open session journal {} for replay", TCHAR_TO_ANSI(*filePath));
+        return false;
+    }
+    
+    if (!FindPlaneRenderer())
+        DLOG_MODULE_WARN(DDAugmented, "No plane renderer to replay planes into, replaying images only");
+    
+    ReplayTime = 0.;
+    ReplayStartTime = GetWorld()->GetTimeSeconds();
+    
+    DLOG_MODULE_DEBUG(DDAugmented, "Started replay of session journal {}, {} chunks at rate {}",
+                      TCHAR_TO_ANSI(*filePath), Replay.GetIndex().Num(), ReplayRate);
+    return true;
+}
+
+void UAugmentedDebugger::StopReplay()
+{
+    if (!Replay.IsOpen())
+        return;
     
-    FMemoryReader binArchive = FMemoryReader(BinaryArray, true);
-    binArchive.Seek(0);
+    Replay.Close();
+    ReplayRecords.Reset();
+    NextReplayRecord = 0;
+    ReplayedImages.Reset();
+    ReplayKeyframeImages.Reset();
+    bReplayKeyframe = false;
+}
+
+void UAugmentedDebugger::UpdateReplay(float DeltaTime)
+{
+    const FReplayRecord* record = PeekReplayRecord();
     
-    int nFiducials = 0;
-    binArchive << nFiducials;
+    // rate 0 steps one recorded frame per tick
+    if (ReplayRate > 0.f)
+        ReplayTime += DeltaTime * ReplayRate;
+    else if (record)
+        ReplayTime = record->time_;
     
-    for (int i = 0; i < nFiducials; ++i)
+    for (; record && record->time_ <= ReplayTime; record = PeekReplayRecord())
     {
-        FTrackedImageData fiducial;
-        SaveLoadTrackedImage(binArchive, fiducial);
-        imageData.Add(fiducial);
+        ReplayRecord(*record);
+        ++NextReplayRecord;
     }
     
-    binArchive.FlushCache();
-    BinaryArray.Empty();
-    binArchive.Close();
+    // planes of this tick go in one batch, like an AR poll
+    AARPlaneRenderer* renderer = FindPlaneRenderer();
+    if (renderer && ReplayPlaneSamples.Num())
+        renderer->FeedPlaneSamples(ReplayPlaneSamples);
     
-    return true;
+    ReplayPlaneSamples.Reset();
+    
+    if (!record)
+    {
+        DLOG_MODULE_DEBUG(DDAugmented, "Replayed {} sec of session in {} sec",
+                          ReplayTime, GetWorld()->GetTimeSeconds() - ReplayStartTime);
+        
+        StopReplay();
+        OnSessionReplayFinished.Broadcast();
+    }
+}
+
+const UAugmentedDebugger::FReplayRecord* UAugmentedDebugger::PeekReplayRecord()
+{
+    // collects a chunk's records, they are replayed over the following ticks
+    struct FCollector : public IARSessionJournalVisitor
+    {
+        TArray<FReplayRecord>& records_;
+        
+        FCollector(TArray<FReplayRecord>& records) : records_(records) {}
+        
+        FReplayRecord& Add(FReplayRecord::EType type, double time)
+        {
+            FReplayRecord& record = records_.AddDefaulted_GetRef();
+            record.type_ = type;
+            record.time_ = time;
+            return record;
+        }
+        
+        virtual void OnKeyframe(double time) override { Add(FReplayRecord::EType::KeyframeStart, time); }
+        virtual void OnKeyframeEnd(double time) override { Add(FReplayRecord::EType::KeyframeEnd, time); }
+        virtual void OnTrackingInfo(double time, const FTrackingInfo& info) override
+        {
+            Add(FReplayRecord::EType::TrackingInfo, time).trackingInfo_ = info;
+        }
+        virtual void OnImage(double time, const FTrackedImageData& image) override
+        {
+            Add(FReplayRecord::EType::Image, time).image_ = image;
+        }
+        virtual void OnImageRemoved(double time, const FGuid& id) override
+        {
+            Add(FReplayRecord::EType::ImageRemove, time).image_.id_ = id;
+        }
+        virtual void OnPlaneSample(double time, const FARPlaneSample& sample) override
+        {
+            Add(FReplayRecord::EType::PlaneSample, time).planeSample_ = sample;
+        }
+    };
+    
+    while (NextReplayRecord == ReplayRecords.Num())
+    {
+        ReplayRecords.Reset();
+        NextReplayRecord = 0;
+        
+        FCollector collector(ReplayRecords);
+        if (!Replay.ReadChunk(collector))
+            return nullptr;
+    }
+    
+    return &ReplayRecords[NextReplayRecord];
+}
+
+void UAugmentedDebugger::ReplayRecord(const FReplayRecord& record)
+{
+    bool authority = GetOwnerRole() == ROLE_Authority;
+    
+    switch (record.type_)
+    {
+        case FReplayRecord::EType::KeyframeStart:
+            ReplayKeyframeImages.Reset();
+            bReplayKeyframe = true;
+            break;
+            
+        case FReplayRecord::EType::KeyframeEnd:
+        {
+            // keyframe has full state -- images it doesn't mention were removed in a dropped chunk
+            TArray<FGuid> stale;
+            for (const FGuid& id : ReplayedImages)
+                if (!ReplayKeyframeImages.Contains(id))
+                    stale.Add(id);
+            
+            for (const FGuid& id : stale)
+            {
+                FReplayRecord remove;
+                remove.type_ = FReplayRecord::EType::ImageRemove;
+                remove.time_ = record.time_;
+                remove.image_.id_ = id;
+                ReplayRecord(remove);
+            }
+            
+            bReplayKeyframe = false;
+            break;
+        }
+        case FReplayRecord::EType::TrackingInfo:
+            TrackingInfo = record.trackingInfo_;
+            if (!authority)
+                ServerUpdateTrackingInfo(record.trackingInfo_);
+            break;
+            
+        case FReplayRecord::EType::Image:
+        {
+            const FTrackedImageData& image = record.image_;
+            bool known = ReplayedImages.Contains(image.id_);
+            
+            if (bReplayKeyframe)
+                ReplayKeyframeImages.Add(image.id_);
+            
+            if (!authority)
+            {
+                if (known)
+                    UpdateTrackedImage(image);
+                else
+                    ServerAddTrackedImage(image);
+            }
+            else
+                AddTrackedImage(image);
+            
+            ReplayedImages.Add(image.id_);
+            break;
+        }
+        case FReplayRecord::EType::ImageRemove:
+            if (authority)
+                RemoveTrackedImage(record.image_.id_);
+            else
+                ServerRemoveTrackedImage(TArray<FGuid>{ record.image_.id_ });
+            
+            ReplayedImages.Remove(record.image_.id_);
+            break;
+            
+        case FReplayRecord::EType::PlaneSample:
+            ReplayPlaneSamples.Add(record.planeSample_);
+            break;
+    }
+}
+
+AARPlaneRenderer* UAugmentedDebugger::FindPlaneRenderer() const
+{
+    if (IsValid(PlaneRenderer))
+        return PlaneRenderer;
+    
+    TActorIterator<AARPlaneRenderer> it(GetWorld());
+    return it ? *it : nullptr;
+}
+
+bool UAugmentedDebugger::SaveFiducialImages(const FString& savePath,
+const TArray<FTrackedImageData>& imageData)
+{
+    if (!imageData.Num())
+    {
+        DLOG_MODULE_WARN(FiducialRelocalizer, "Fiducial snapshot is empty");
+        return false;
+    }
+    
+    TArray<uint8> snapshot;
+    FiducialSnapshot::Write(imageData, snapshot);
+    
+    // written next to the target and renamed over it, so readers never see a partial snapshot
+    FString tempPath = savePath + TEXT(".tmp");
+    
+    bool res = FFileHelper::SaveArrayToFile(snapshot, *tempPath) &&
+        IFileManager::Get().Move(*savePath, *tempPath, true, true);
+    
+    if (!res)
+    {
+        IFileManager::Get().Delete(*tempPath, false, false, true);
+        DLOG_MODULE_ERROR(FiducialRelocalizer, "Failed to save to file {}", TCHAR_TO_ANSI(*savePath));
+    }
+    else
+        DLOG_MODULE_DEBUG(FiducialRelocalizer, "Succesfully saved {} fiducial snapshots to file {}",
+                          imageData.Num(),
+                          TCHAR_TO_ANSI(*savePath));
+    
+    return res;
 }
 
-void UAugmentedDebugger::SaveLoadTrackedImage(FArchive& Ar, FTrackedImageData& imageData)
+bool UAugmentedDebugger::LoadFiducialImages(const FString& loadPath, TArray<FTrackedImageData>& imageData)
 {
-    Ar << imageData.ImageName;
-    Ar << imageData.PawnToImage;
+    FFiducialSnapshotView snapshot;
+    
+    if (snapshot.Open(loadPath))
+    {
+        snapshot.GetImageData(imageData);
+        return true;
+    }
+    
+    // files saved before snapshots were versioned
+    return FiducialSnapshot::LoadLegacy(loadPath, imageData);
+}
+
+namespace
+{
+    // headless and editor runs: -ExecCmds="DDAugmented.ReplaySession <journal file> [rate]"
+    FAutoConsoleCommandWithWorldAndArgs ReplaySessionCmd(TEXT("DDAugmented.ReplaySession"),
+        TEXT("Replays a session journal from the writeable folder through the first AugmentedDebugger. Rate 0 -- one recorded frame per tick"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+        {
+            if (!Args.Num() || !World)
+                return;
+            
+            for (TActorIterator<AActor> it(World); it; ++it)
+            {
+                UAugmentedDebugger* debugger = it->FindComponentByClass<UAugmentedDebugger>();
+                if (!debugger)
+                    continue;
+                
+                if (Args.Num() > 1)
+                    debugger->ReplayRate = FCString::Atof(*Args[1]);
+                
+                debugger->StartReplay(Args[0]);
+                return;
+            }
+            
+            DLOG_MODULE_WARN(DDAugmented, "No AugmentedDebugger to replay {} with", TCHAR_TO_ANSI(*Args[0]));
+        }));
 }
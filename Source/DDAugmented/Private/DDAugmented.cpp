@@ -8,7 +8,14 @@
 
 #include "DDAugmented.h"
 #include "logging.hpp"
+#if __has_include("git-describe.h")
 #include "git-describe.h"
+#endif
+
+// platforms without a pre-build step (or building outside a git checkout)
+#ifndef GIT_DESCRIBE
+#define GIT_DESCRIBE unknown
+#endif
 
 #define STRINGIZE_VERSION(v) STRINGIZE_TOKEN(v)
 #define STRINGIZE_TOKEN(t) #t
@@ -0,0 +1,771 @@
+//
+// DDAugmentedBenchmarks.cpp
+//
+// Micro-benchmarks for plane pipeline, run from the console:
+//   DDAugmented.Bench.PlaneDiff
+//   DDAugmented.Bench.PlaneQueries
+//   DDAugmented.Bench.GeoWireFormat
+//   DDAugmented.Bench.FiducialSnapshot
+//   DDAugmented.Bench.ImageWireFormat
+//   DDAugmented.Bench.SessionJournal
+//
+// and automation tests (Session Frontend, or "Automation RunTests DDAugmented"):
+//   DDAugmented.GeoWireFormat
+//
+// None of it is built into Shipping.
+//
+
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Serialization/BitWriter.h"
+#include "Serialization/BitReader.h"
+#include "Serialization/BufferArchive.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "HAL/FileManager.h"
+#include "Misc/AutomationTest.h"
+#include "ARPlaneSetTracker.h"
+#include "ARPlaneSpatialIndex.h"
+#include "ARPlaneRenderer.h"
+#include "AugmentedDebugger.h"
+#include "FiducialSnapshot.h"
+#include "ARSessionJournal.h"
+#include "DDLog.h"
+
+// benchmarks allocate thousands of planes and write under Saved -- development builds only
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+    constexpr int32 kBenchPasses = 200;
+
+    // replaces ~5% of planes per pass, like ARCore merging and splitting planes
+    void ChurnPlanes(TArray<FGuid>& planes, FRandomStream& rnd)
+    {
+        int32 nReplace = FMath::Max(1, planes.Num() / 20);
+        for (int32 i = 0; i < nReplace; ++i)
+            planes[rnd.RandRange(0, planes.Num() - 1)] = FGuid::NewGuid();
+    }
+
+    // previous AARPlaneRenderer::Tick diff: array of mesh keys, linear Remove per plane
+    double BenchArrayRemoveDiff(int32 nPlanes)
+    {
+        FRandomStream rnd(nPlanes);
+        TArray<FGuid> planes;
+        for (int32 i = 0; i < nPlanes; ++i)
+            planes.Add(FGuid::NewGuid());
+
+        TSet<FGuid> meshes(planes);
+        double total = 0.;
+
+        for (int32 pass = 0; pass < kBenchPasses; ++pass)
+        {
+            ChurnPlanes(planes, rnd);
+
+            double start = FPlatformTime::Seconds();
+
+            TArray<FGuid> oldPlanes = meshes.Array();
+            for (const FGuid& id : planes)
+            {
+                oldPlanes.Remove(id);
+                meshes.Add(id);
+            }
+            for (const FGuid& id : oldPlanes)
+                meshes.Remove(id);
+
+            total += FPlatformTime::Seconds() - start;
+        }
+
+        return total / kBenchPasses;
+    }
+
+    double BenchGenerationDiff(int32 nPlanes)
+    {
+        FRandomStream rnd(nPlanes);
+        TArray<FGuid> planes;
+        FARPlaneSetTracker tracker;
+        for (int32 i = 0; i < nPlanes; ++i)
+        {
+            planes.Add(FGuid::NewGuid());
+            tracker.Touch(planes.Last());
+        }
+
+        TArray<FGuid> removed;
+        double total = 0.;
+
+        for (int32 pass = 0; pass < kBenchPasses; ++pass)
+        {
+            ChurnPlanes(planes, rnd);
+
+            double start = FPlatformTime::Seconds();
+
+            tracker.BeginPass();
+            for (const FGuid& id : planes)
+                tracker.Touch(id);
+            removed.Reset();
+            tracker.EndPass(removed);
+
+            total += FPlatformTime::Seconds() - start;
+        }
+
+        return total / kBenchPasses;
+    }
+
+    void BenchPlaneDiff()
+    {
+        for (int32 nPlanes : { 10, 100, 1000 })
+        {
+            double arrayDiff = BenchArrayRemoveDiff(nPlanes);
+            double generationDiff = BenchGenerationDiff(nPlanes);
+
+            DLOG_MODULE_INFO(DDAugmented, "PlaneDiff {} planes: array remove {:.2f}us, generation stamp {:.2f}us",
+                             nPlanes, arrayDiff * 1e6, generationDiff * 1e6);
+        }
+    }
+
+    FAutoConsoleCommand BenchPlaneDiffCmd(TEXT("DDAugmented.Bench.PlaneDiff"),
+                                          TEXT("Compares plane set diff strategies at 10/100/1000 planes"),
+                                          FConsoleCommandDelegate::CreateStatic(&BenchPlaneDiff));
+
+    constexpr int32 kBenchQueries = 1000;
+
+    // horizontal planes with irregular octagon boundaries scattered over a 50x50m room
+    void MakeBenchPlanes(int32 nPlanes, FRandomStream& rnd, TArray<FARTrackedGeoData>& outPlanes)
+    {
+        for (int32 i = 0; i < nPlanes; ++i)
+        {
+            FARTrackedGeoData& data = outPlanes.AddDefaulted_GetRef();
+            data.id_ = FGuid::NewGuid();
+            data.localToWorld_ = FTransform(FRotator(0.f, rnd.FRandRange(0.f, 360.f), 0.f),
+                                            FVector(rnd.FRandRange(-2500.f, 2500.f), rnd.FRandRange(-2500.f, 2500.f), rnd.FRandRange(0.f, 300.f)));
+
+            float radius = rnd.FRandRange(50.f, 300.f);
+            for (int32 v = 0; v < 8; ++v)
+            {
+                float angle = v * PI / 4.f;
+                float r = radius * rnd.FRandRange(0.6f, 1.f);
+                data.boundaryVerts_.Add(FVector(r * FMath::Cos(angle), r * FMath::Sin(angle), 0.f));
+            }
+        }
+    }
+
+    void BenchPlaneQueries()
+    {
+        for (int32 nPlanes : { 100, 1000 })
+        {
+            FRandomStream rnd(nPlanes);
+            TArray<FARTrackedGeoData> planes;
+            MakeBenchPlanes(nPlanes, rnd, planes);
+
+            FARPlaneSpatialIndex index;
+            TArray<TArray<FVector2D>> boundaries;
+            for (const FARTrackedGeoData& data : planes)
+            {
+                index.Update(data);
+
+                TArray<FVector2D>& boundary = boundaries.AddDefaulted_GetRef();
+                for (const FVector& v : data.boundaryVerts_)
+                    boundary.Add(FVector2D(v.X, v.Y));
+            }
+
+            TArray<FVector> points;
+            for (int32 q = 0; q < kBenchQueries; ++q)
+                points.Add(FVector(rnd.FRandRange(-2500.f, 2500.f), rnd.FRandRange(-2500.f, 2500.f), rnd.FRandRange(0.f, 300.f)));
+
+            int32 mismatches = 0;
+            int32 indexHits = 0;
+            FARPlaneQueryHit hit, bruteHit;
+
+            // downward rays, like placing content on the floor under the cursor
+            double start = FPlatformTime::Seconds();
+            for (const FVector& p : points)
+                indexHits += index.Raycast(p + FVector(0.f, 0.f, 500.f), p - FVector(0.f, 0.f, 500.f), hit) ? 1 : 0;
+            double indexRaycast = FPlatformTime::Seconds() - start;
+
+            start = FPlatformTime::Seconds();
+            for (const FVector& p : points)
+            {
+                bool hasBrute = false;
+                for (int32 i = 0; i < planes.Num(); ++i)
+                    if (FARPlaneSpatialIndex::RaycastPlane(planes[i].localToWorld_, boundaries[i], p + FVector(0.f, 0.f, 500.f), p - FVector(0.f, 0.f, 500.f), hit) &&
+                        (!hasBrute || hit.Distance < bruteHit.Distance))
+                    {
+                        bruteHit = hit;
+                        hasBrute = true;
+                    }
+            }
+            double bruteRaycast = FPlatformTime::Seconds() - start;
+
+            start = FPlatformTime::Seconds();
+            for (const FVector& p : points)
+                index.FindNearest(p, 500.f, hit);
+            double indexNearest = FPlatformTime::Seconds() - start;
+
+            TArray<float> bruteNearestDistances;
+            bruteNearestDistances.Reserve(points.Num());
+
+            start = FPlatformTime::Seconds();
+            for (const FVector& p : points)
+            {
+                float best = MAX_flt;
+                FVector closest;
+                for (int32 i = 0; i < planes.Num(); ++i)
+                    best = FMath::Min(best, FARPlaneSpatialIndex::DistanceToPlane(planes[i].localToWorld_, boundaries[i], p, closest));
+
+                bruteNearestDistances.Add(best);
+            }
+            double bruteNearest = FPlatformTime::Seconds() - start;
+
+            // grid results must agree with the scan
+            for (int32 q = 0; q < points.Num(); ++q)
+            {
+                bool hasBrute = bruteNearestDistances[q] <= 500.f;
+                bool hasIndex = index.FindNearest(points[q], 500.f, hit);
+
+                if (hasIndex != hasBrute || (hasIndex && !FMath::IsNearlyEqual(hit.Distance, bruteNearestDistances[q], 0.01f)))
+                    mismatches++;
+            }
+
+            DLOG_MODULE_INFO(DDAugmented, "PlaneQueries {} planes, {} queries: raycast grid {:.1f}us brute {:.1f}us ({} hits); nearest grid {:.1f}us brute {:.1f}us; {} mismatches",
+                             nPlanes, kBenchQueries, indexRaycast * 1e6, bruteRaycast * 1e6, indexHits,
+                             indexNearest * 1e6, bruteNearest * 1e6, mismatches);
+        }
+    }
+
+    FAutoConsoleCommand BenchPlaneQueriesCmd(TEXT("DDAugmented.Bench.PlaneQueries"),
+                                             TEXT("Compares plane spatial index queries against a brute force scan at 100/1000 planes"),
+                                             FConsoleCommandDelegate::CreateStatic(&BenchPlaneQueries));
+
+    // per-property encoding planes were replicated with before: full floats, GUID and name on every send
+    int32 LegacyGeoBytes(const FARTrackedGeoData& data)
+    {
+        FBitWriter writer(0, true);
+        TArray<FVector> boundary = data.boundaryVerts_;
+        FTransform localToWorld = data.localToWorld_;
+        FTransform localToTracking = data.localToTracking_;
+        FString debugName = data.debugName_.ToString();
+        FColor color = data.color_;
+        FGuid id = data.id_;
+
+        writer << boundary << localToWorld << localToTracking << debugName << color << id;
+
+        return (int32)((writer.GetNumBits() + 7) >> 3);
+    }
+
+    // planes with arbitrary orientations and names; every other one goes as
+    // RPC payload, with identity inline
+    void MakeWirePlanes(FRandomStream& rnd, TArray<FARTrackedGeoData>& outPlanes)
+    {
+        MakeBenchPlanes(1000, rnd, outPlanes);
+
+        for (int32 i = 0; i < outPlanes.Num(); ++i)
+        {
+            FARTrackedGeoData& data = outPlanes[i];
+            data.localToWorld_.SetRotation(FRotator(rnd.FRandRange(-90.f, 90.f), rnd.FRandRange(0.f, 360.f), rnd.FRandRange(-180.f, 180.f)).Quaternion());
+            data.localToTracking_ = data.localToWorld_ * FTransform(FRotator(0.f, 30.f, 0.f), FVector(120.f, -45.f, 10.f));
+            data.debugName_ = FName(*FString::Printf(TEXT("Plane_%d"), i));
+            data.color_ = FColor::MakeRandomColor();
+            data.netId_ = (i % 2) ? (uint16)i : 0;
+        }
+    }
+
+    void BenchGeoWireFormat()
+    {
+        FRandomStream rnd(19);
+        TArray<FARTrackedGeoData> planes;
+        MakeWirePlanes(rnd, planes);
+
+        int64 legacyBytes = 0;
+        int64 compactBytes = 0;
+        double encode = 0., decode = 0.;
+
+        for (int32 pass = 0; pass < kBenchPasses; ++pass)
+        {
+            for (FARTrackedGeoData& data : planes)
+            {
+                double start = FPlatformTime::Seconds();
+                FBitWriter writer(0, true);
+                bool success = false;
+                data.NetSerialize(writer, nullptr, success);
+                encode += FPlatformTime::Seconds() - start;
+
+                start = FPlatformTime::Seconds();
+                FBitReader reader(writer.GetData(), writer.GetNumBits());
+                FARTrackedGeoData received;
+                received.NetSerialize(reader, nullptr, success);
+                decode += FPlatformTime::Seconds() - start;
+
+                if (pass == 0)
+                {
+                    legacyBytes += LegacyGeoBytes(data);
+                    compactBytes += (writer.GetNumBits() + 7) >> 3;
+                }
+            }
+        }
+
+        int32 nSends = kBenchPasses * planes.Num();
+
+        DLOG_MODULE_INFO(DDAugmented, "GeoWireFormat {} planes: legacy {} bytes, compact {} bytes ({:.1f}%); encode {:.2f}us decode {:.2f}us per plane",
+                         planes.Num(), legacyBytes, compactBytes, 100.0 * compactBytes / FMath::Max<int64>(legacyBytes, 1),
+                         encode / nSends * 1e6, decode / nSends * 1e6);
+    }
+
+    FAutoConsoleCommand BenchGeoWireFormatCmd(TEXT("DDAugmented.Bench.GeoWireFormat"),
+                                              TEXT("Times plane wire format encode/decode and compares its size with the per-property encoding"),
+                                              FConsoleCommandDelegate::CreateStatic(&BenchGeoWireFormat));
+
+    constexpr int32 kBenchLoadPasses = 20;
+
+    // markers of a large venue map, names repeat across floors
+    void MakeBenchFiducials(int32 nFiducials, FRandomStream& rnd, TArray<FTrackedImageData>& outImages)
+    {
+        for (int32 i = 0; i < nFiducials; ++i)
+        {
+            FTrackedImageData& image = outImages.AddDefaulted_GetRef();
+            image.id_ = FGuid::NewGuid();
+            image.ImageName = FString::Printf(TEXT("Marker_%03d"), i % 500);
+            image.PawnToImage = FTransform(FRotator(rnd.FRandRange(-90.f, 90.f), rnd.FRandRange(0.f, 360.f), 0.f),
+                                           FVector(rnd.FRandRange(-5000.f, 5000.f), rnd.FRandRange(-5000.f, 5000.f), rnd.FRandRange(0.f, 1500.f)));
+            image.EstimatedSize = FVector2D(rnd.FRandRange(10.f, 40.f), rnd.FRandRange(10.f, 40.f));
+            image.TrackingState = (i % 3) ? EARTrackingState::Tracking : EARTrackingState::NotTracking;
+            image.PickedForEstimation = (i % 7) == 0;
+        }
+    }
+
+    bool SameFiducial(const FTrackedImageData& a, const FTrackedImageData& b, bool onlyLegacyFields)
+    {
+        bool same = a.ImageName == b.ImageName && a.PawnToImage.Equals(b.PawnToImage, 0.f);
+
+        return onlyLegacyFields ? same :
+            same && a.id_ == b.id_ && a.EstimatedSize == b.EstimatedSize &&
+            a.TrackingState == b.TrackingState && a.PickedForEstimation == b.PickedForEstimation;
+    }
+
+    void BenchFiducialSnapshot()
+    {
+        FString legacyPath = FPaths::ProjectSavedDir() / TEXT("BenchFiducialsLegacy.bin");
+        FString snapshotPath = FPaths::ProjectSavedDir() / TEXT("BenchFiducials.bin");
+
+        for (int32 nFiducials : { 100, 1000, 10000 })
+        {
+            FRandomStream rnd(nFiducials);
+            TArray<FTrackedImageData> images;
+            MakeBenchFiducials(nFiducials, rnd, images);
+
+            // unversioned format SaveFiducialImages used to write
+            FBufferArchive legacy;
+            int32 count = images.Num();
+            legacy << count;
+            for (FTrackedImageData image : images)
+                legacy << image.ImageName << image.PawnToImage;
+
+            if (!FFileHelper::SaveArrayToFile(legacy, *legacyPath) ||
+                !UAugmentedDebugger::SaveFiducialImages(snapshotPath, images))
+            {
+                DLOG_MODULE_ERROR(DDAugmented, "FiducialSnapshot: can't write bench files to {}", TCHAR_TO_ANSI(*FPaths::ProjectSavedDir()));
+                return;
+            }
+
+            int32 failures = 0;
+            double legacyLoad = 0., snapshotLoad = 0., viewLoad = 0.;
+            FVector checksum = FVector::ZeroVector;
+            bool mapped = false;
+
+            for (int32 pass = 0; pass < kBenchLoadPasses; ++pass)
+            {
+                TArray<FTrackedImageData> loaded;
+
+                double start = FPlatformTime::Seconds();
+                bool ok = UAugmentedDebugger::LoadFiducialImages(legacyPath, loaded);
+                legacyLoad += FPlatformTime::Seconds() - start;
+
+                for (int32 i = 0; ok && i < images.Num(); ++i)
+                    ok = loaded.Num() == images.Num() && SameFiducial(images[i], loaded[i], true);
+                failures += ok ? 0 : 1;
+
+                loaded.Reset();
+
+                start = FPlatformTime::Seconds();
+                ok = UAugmentedDebugger::LoadFiducialImages(snapshotPath, loaded);
+                snapshotLoad += FPlatformTime::Seconds() - start;
+
+                for (int32 i = 0; ok && i < images.Num(); ++i)
+                    ok = loaded.Num() == images.Num() && SameFiducial(images[i], loaded[i], false);
+                failures += ok ? 0 : 1;
+
+                // in place: open and read every pose without decoding records
+                start = FPlatformTime::Seconds();
+                FFiducialSnapshotView view;
+                if (view.Open(snapshotPath))
+                {
+                    for (int32 i = 0; i < view.Num(); ++i)
+                    {
+                        const FiducialSnapshot::FRecord& record = view.GetRecord(i);
+                        checksum += FVector(record.translation_[0], record.translation_[1], record.translation_[2]);
+                    }
+                }
+                viewLoad += FPlatformTime::Seconds() - start;
+
+                mapped = view.IsMapped();
+                failures += view.Num() == images.Num() ? 0 : 1;
+            }
+
+            DLOG_MODULE_INFO(DDAugmented, "FiducialSnapshot {} images: file legacy {} bytes, snapshot {} bytes; load legacy {:.1f}us, snapshot {:.1f}us, in place ({}) {:.1f}us (checksum {:.0f})",
+                             nFiducials, IFileManager::Get().FileSize(*legacyPath), IFileManager::Get().FileSize(*snapshotPath),
+                             legacyLoad / kBenchLoadPasses * 1e6, snapshotLoad / kBenchLoadPasses * 1e6,
+                             mapped ? "mapped" : "read", viewLoad / kBenchLoadPasses * 1e6, checksum.Size());
+
+            if (failures)
+                DLOG_MODULE_ERROR(DDAugmented, "FiducialSnapshot: {} loads of {} images failed round trip", failures, nFiducials);
+        }
+
+        IFileManager::Get().Delete(*legacyPath);
+        IFileManager::Get().Delete(*snapshotPath);
+    }
+
+    FAutoConsoleCommand BenchFiducialSnapshotCmd(TEXT("DDAugmented.Bench.FiducialSnapshot"),
+                                                 TEXT("Compares fiducial load time of legacy and snapshot files at 100/1000/10000 images and checks round trip"),
+                                                 FConsoleCommandDelegate::CreateStatic(&BenchFiducialSnapshot));
+
+    // ServerUpdateTrackedImage payload: the whole image, name included, on every update
+    int32 LegacyImageBytes(const FTrackedImageData& image)
+    {
+        FBitWriter writer(0, true);
+        FTrackedImageData copy = image;
+        uint8 trackingState = (uint8)copy.TrackingState;
+
+        writer << copy.PawnToImage << copy.EstimatedSize << trackingState << copy.ImageName << copy.id_;
+        writer.WriteBit(copy.PickedForEstimation ? 1 : 0);
+
+        return (int32)((writer.GetNumBits() + 7) >> 3);
+    }
+
+    void BenchImageWireFormat()
+    {
+        const float kTranslationTolerance = 0.1f;
+        const float kRotationTolerance = 1e-3f;
+        const float kSizeTolerance = 0.05f + KINDA_SMALL_NUMBER;
+
+        FRandomStream rnd(29);
+        TArray<FTrackedImageData> images;
+        MakeBenchFiducials(1000, rnd, images);
+
+        int64 legacyBytes = 0;
+        int64 compactBytes = 0;
+        int32 failures = 0;
+        float maxTranslationError = 0.f;
+        float maxRotationError = 0.f;
+
+        for (int32 i = 0; i < images.Num(); ++i)
+        {
+            const FTrackedImageData& image = images[i];
+
+            FTrackedImagePose pose;
+            pose.FromImageData(image);
+            pose.id_ = image.id_;
+            // every tenth update goes before the AR client has the image's net id
+            pose.netId_ = (i % 10) ? (uint16)(i + 1) : 0;
+
+            FBitWriter writer(0, true);
+            bool success = false;
+            pose.NetSerialize(writer, nullptr, success);
+
+            FBitReader reader(writer.GetData(), writer.GetNumBits());
+            FTrackedImagePose received;
+            bool readSuccess = false;
+            received.NetSerialize(reader, nullptr, readSuccess);
+
+            legacyBytes += LegacyImageBytes(image);
+            compactBytes += (writer.GetNumBits() + 7) >> 3;
+
+            float translationError = FVector::Dist(received.PawnToImage.GetTranslation(), pose.PawnToImage.GetTranslation());
+            float rotationError = received.PawnToImage.GetRotation().AngularDistance(pose.PawnToImage.GetRotation());
+            maxTranslationError = FMath::Max(maxTranslationError, translationError);
+            maxRotationError = FMath::Max(maxRotationError, rotationError);
+
+            // replicated copy must compare equal, or senders would resend it forever
+            bool ok = success && readSuccess && !reader.IsError() &&
+                received.netId_ == pose.netId_ &&
+                (pose.netId_ != 0 || received.id_ == pose.id_) &&
+                translationError <= kTranslationTolerance && rotationError <= kRotationTolerance &&
+                (received.EstimatedSize - pose.EstimatedSize).GetAbsMax() <= kSizeTolerance &&
+                !received.Differs(pose);
+
+            failures += ok ? 0 : 1;
+        }
+
+        DLOG_MODULE_INFO(DDAugmented, "ImageWireFormat {} updates: legacy {} bytes, compact {} bytes ({:.1f}%); max error translation {:.3f}cm rotation {:.5f}rad",
+                         images.Num(), legacyBytes, compactBytes, 100.0 * compactBytes / FMath::Max<int64>(legacyBytes, 1),
+                         maxTranslationError, maxRotationError);
+
+        if (failures)
+            DLOG_MODULE_ERROR(DDAugmented, "ImageWireFormat: {} updates failed round trip", failures);
+        else
+            DLOG_MODULE_INFO(DDAugmented, "ImageWireFormat: round trip within bounds");
+    }
+
+    FAutoConsoleCommand BenchImageWireFormatCmd(TEXT("DDAugmented.Bench.ImageWireFormat"),
+                                                TEXT("Checks tracked image update round trip error bounds and compares its size with the per-image RPC"),
+                                                FConsoleCommandDelegate::CreateStatic(&BenchImageWireFormat));
+
+    // state rebuilt from journal records
+    struct FJournalState : public IARSessionJournalVisitor
+    {
+        TMap<FGuid, FTrackedImageData> images_;
+        TMap<FGuid, FARTrackedGeoData> planes_;
+        // items not refreshed by the keyframe being read
+        TSet<FGuid> stale_;
+
+        virtual void OnKeyframe(double time) override
+        {
+            stale_.Reset();
+            for (const auto& it : images_)
+                stale_.Add(it.Key);
+            for (const auto& it : planes_)
+                stale_.Add(it.Key);
+        }
+
+        virtual void OnKeyframeEnd(double time) override
+        {
+            for (const FGuid& id : stale_)
+            {
+                images_.Remove(id);
+                planes_.Remove(id);
+            }
+            stale_.Reset();
+        }
+
+        virtual void OnImage(double time, const FTrackedImageData& image) override { images_.Add(image.id_, image); stale_.Remove(image.id_); }
+        virtual void OnImageRemoved(double time, const FGuid& id) override { images_.Remove(id); }
+        virtual void OnPlane(double time, const FARTrackedGeoData& data) override { planes_.Add(data.id_, data); stale_.Remove(data.id_); }
+        virtual void OnPlaneRemoved(double time, const FGuid& id) override { planes_.Remove(id); }
+    };
+
+    int32 CountJournalMismatches(const TArray<FTrackedImageData>& images, const TArray<FARTrackedGeoData>& planes, const FJournalState& state)
+    {
+        int32 mismatches = FMath::Abs(images.Num() - state.images_.Num()) + FMath::Abs(planes.Num() - state.planes_.Num());
+
+        for (const FTrackedImageData& image : images)
+        {
+            const FTrackedImageData* read = state.images_.Find(image.id_);
+            mismatches += read && read->ImageName == image.ImageName && read->TrackingState == image.TrackingState &&
+                read->PawnToImage.GetTranslation().Equals(image.PawnToImage.GetTranslation(), 0.1f) ? 0 : 1;
+        }
+
+        for (const FARTrackedGeoData& data : planes)
+        {
+            const FARTrackedGeoData* read = state.planes_.Find(data.id_);
+            mismatches += read && read->boundaryVerts_.Num() == data.boundaryVerts_.Num() &&
+                read->localToWorld_.GetTranslation().Equals(data.localToWorld_.GetTranslation(), 0.1f) ? 0 : 1;
+        }
+
+        return mismatches;
+    }
+
+    // 60 seconds at 60 fps: a few images move every frame, planes grow now and then, some come and go
+    void BenchSessionJournal()
+    {
+        constexpr int32 kFrames = 3600;
+        FString journalPath = FPaths::ProjectSavedDir() / TEXT("BenchSession.journal");
+
+        FRandomStream rnd(23);
+        TArray<FTrackedImageData> images;
+        TArray<FARTrackedGeoData> planes;
+        MakeBenchFiducials(1000, rnd, images);
+        MakeBenchPlanes(300, rnd, planes);
+
+        FARSessionJournalWriter journal;
+        if (!journal.Open(journalPath))
+            return;
+
+        TSet<int32> changedImages, changedPlanes;
+        double total = 0., worst = 0.;
+        int64 snapshotBytes = 0;
+
+        for (int32 frame = 0; frame < kFrames; ++frame)
+        {
+            changedImages.Reset();
+            changedPlanes.Reset();
+
+            for (int32 i = 0; i < 20; ++i)
+            {
+                int32 idx = rnd.RandRange(0, images.Num() - 1);
+                images[idx].PawnToImage.AddToTranslation(FVector(rnd.FRandRange(-1.f, 1.f), rnd.FRandRange(-1.f, 1.f), 0.f));
+                changedImages.Add(idx);
+            }
+
+            for (int32 i = 0; i < 3; ++i)
+            {
+                int32 idx = rnd.RandRange(0, planes.Num() - 1);
+                planes[idx].boundaryVerts_.Add(FVector(rnd.FRandRange(-300.f, 300.f), rnd.FRandRange(-300.f, 300.f), 0.f));
+                changedPlanes.Add(idx);
+            }
+
+            TArray<FGuid> removedPlanes;
+            if (frame % 60 == 0)
+            {
+                removedPlanes.Add(planes.Last().id_);
+                planes.Pop();
+                MakeBenchPlanes(1, rnd, planes);
+                changedPlanes.Add(planes.Num() - 1);
+            }
+
+            double start = FPlatformTime::Seconds();
+
+            journal.SetTime(frame / 60.);
+
+            if (journal.ConsumeKeyframe())
+            {
+                for (const FTrackedImageData& image : images)
+                    journal.WriteImage(image);
+                for (const FARTrackedGeoData& data : planes)
+                    journal.WritePlane(data);
+            }
+            else
+            {
+                for (int32 idx : changedImages)
+                    journal.WriteImage(images[idx]);
+                for (int32 idx : changedPlanes)
+                    journal.WritePlane(planes[idx]);
+            }
+
+            for (const FGuid& id : removedPlanes)
+                journal.RemovePlane(id);
+
+            journal.Tick();
+
+            double elapsed = FPlatformTime::Seconds() - start;
+            total += elapsed;
+            worst = FMath::Max(worst, elapsed);
+
+            // what a fiducial snapshot per frame would cost, images only
+            if (frame == 0)
+            {
+                TArray<uint8> snapshot;
+                FiducialSnapshot::Write(images, snapshot);
+                snapshotBytes = (int64)snapshot.Num() * kFrames;
+            }
+        }
+
+        journal.Close();
+
+        FARSessionJournalReader reader;
+        FJournalState fromStart, fromSeek;
+        int32 nChunks = 0;
+
+        if (reader.Open(journalPath))
+        {
+            nChunks = reader.GetIndex().Num();
+
+            while (reader.ReadChunk(fromStart))
+                ;
+
+            // from the middle: keyframe before 30s brings full state back
+            reader.Seek(30.);
+            while (reader.ReadChunk(fromSeek))
+                ;
+        }
+
+        int32 mismatches = CountJournalMismatches(images, planes, fromStart);
+        int32 seekMismatches = CountJournalMismatches(images, planes, fromSeek);
+
+        DLOG_MODULE_INFO(DDAugmented, "SessionJournal {} frames, {} images, {} planes: {:.1f}us/frame (worst {:.1f}us), {} bytes in {} chunks ({} dropped); image snapshot per frame would be {} bytes",
+                         kFrames, images.Num(), planes.Num(), total / kFrames * 1e6, worst * 1e6,
+                         journal.GetBytesWritten(), nChunks, journal.GetDroppedChunks(), snapshotBytes);
+
+        if (mismatches || seekMismatches)
+            DLOG_MODULE_ERROR(DDAugmented, "SessionJournal: replayed state differs -- {} items from start, {} items after seek", mismatches, seekMismatches);
+        else
+            DLOG_MODULE_INFO(DDAugmented, "SessionJournal: replayed state matches from start and after seek");
+
+        IFileManager::Get().Delete(*journalPath);
+    }
+
+    FAutoConsoleCommand BenchSessionJournalCmd(TEXT("DDAugmented.Bench.SessionJournal"),
+                                               TEXT("Journals a simulated minute of image and plane updates, reports game thread cost and size, checks replay"),
+                                               FConsoleCommandDelegate::CreateStatic(&BenchSessionJournal));
+}
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FARGeoWireFormatTest, "DDAugmented.GeoWireFormat",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FARGeoWireFormatTest::RunTest(const FString& Parameters)
+{
+    // one quantization step of boundary, 0.1cm packed translation, 15 bit quaternion components
+    const float kBoundaryTolerance = ARGeoQuantize::kPositionStep * 0.5f + KINDA_SMALL_NUMBER;
+    const float kTranslationTolerance = 0.1f;
+    const float kRotationTolerance = 1e-3f;
+
+    FRandomStream rnd(19);
+    TArray<FARTrackedGeoData> planes;
+    MakeWirePlanes(rnd, planes);
+
+    int32 decodeFailures = 0;
+    int32 identityFailures = 0;
+    int32 nonPlanarVerts = 0;
+    float maxBoundaryError = 0.f;
+    float maxTranslationError = 0.f;
+    float maxRotationError = 0.f;
+
+    auto checkPose = [&](const FTransform& sent, const FTransform& got)
+    {
+        maxTranslationError = FMath::Max(maxTranslationError, FVector::Dist(got.GetTranslation(), sent.GetTranslation()));
+        maxRotationError = FMath::Max(maxRotationError, got.GetRotation().AngularDistance(sent.GetRotation()));
+    };
+
+    for (const FARTrackedGeoData& data : planes)
+    {
+        FARTrackedGeoData sent = data;
+        FBitWriter writer(0, true);
+        bool success = false;
+        sent.NetSerialize(writer, nullptr, success);
+
+        FBitReader reader(writer.GetData(), writer.GetNumBits());
+        FARTrackedGeoData received;
+        bool readSuccess = false;
+        received.NetSerialize(reader, nullptr, readSuccess);
+
+        if (!success || !readSuccess || reader.IsError())
+        {
+            decodeFailures++;
+            continue;
+        }
+
+        if (received.netId_ != data.netId_ || received.color_ != data.color_ ||
+            received.boundaryVerts_.Num() != data.boundaryVerts_.Num() ||
+            (data.netId_ == 0 && received.id_ != data.id_))
+        {
+            identityFailures++;
+            continue;
+        }
+
+        for (int32 v = 0; v < data.boundaryVerts_.Num(); ++v)
+        {
+            FVector error = (received.boundaryVerts_[v] - data.boundaryVerts_[v]).GetAbs();
+            maxBoundaryError = FMath::Max(maxBoundaryError, FMath::Max(error.X, error.Y));
+            nonPlanarVerts += received.boundaryVerts_[v].Z == 0.f ? 0 : 1;
+        }
+
+        checkPose(data.localToWorld_, received.localToWorld_);
+        checkPose(data.localToTracking_, received.localToTracking_);
+    }
+
+    TestTrue(TEXT("Every plane decodes"), decodeFailures == 0);
+    TestTrue(TEXT("Net id, identity, color and vertex count survive"), identityFailures == 0);
+    TestTrue(TEXT("Boundary vertices stay in the plane"), nonPlanarVerts == 0);
+    TestTrue(FString::Printf(TEXT("Boundary error %.3fcm within half a quantization step"), maxBoundaryError),
+             maxBoundaryError <= kBoundaryTolerance);
+    TestTrue(FString::Printf(TEXT("Translation error %.3fcm within 0.1cm"), maxTranslationError),
+             maxTranslationError <= kTranslationTolerance);
+    TestTrue(FString::Printf(TEXT("Rotation error %.5frad within 1e-3rad"), maxRotationError),
+             maxRotationError <= kRotationTolerance);
+
+    return true;
+}
+
+#endif
+
+#endif // !UE_BUILD_SHIPPING
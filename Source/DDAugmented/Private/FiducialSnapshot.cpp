@@ -0,0 +1,288 @@
+//
+// FiducialSnapshot.cpp
+//
+
+#include "FiducialSnapshot.h"
+#include "AugmentedDebugger.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "DDLog.h"
+
+namespace
+{
+    // legacy record is at least an empty FString and an FTransform
+    constexpr int64 kLegacyMinRecordSize = sizeof(int32) + 10 * sizeof(float);
+
+    void EncodeRecord(const FTrackedImageData& image, FiducialSnapshot::FRecord& record)
+    {
+        FMemory::Memzero(record);
+
+        const FQuat rotation = image.PawnToImage.GetRotation();
+        const FVector translation = image.PawnToImage.GetTranslation();
+        const FVector scale = image.PawnToImage.GetScale3D();
+
+        record.rotation_[0] = rotation.X;
+        record.rotation_[1] = rotation.Y;
+        record.rotation_[2] = rotation.Z;
+        record.rotation_[3] = rotation.W;
+        record.translation_[0] = translation.X;
+        record.translation_[1] = translation.Y;
+        record.translation_[2] = translation.Z;
+        record.scale_[0] = scale.X;
+        record.scale_[1] = scale.Y;
+        record.scale_[2] = scale.Z;
+        record.estimatedSize_[0] = image.EstimatedSize.X;
+        record.estimatedSize_[1] = image.EstimatedSize.Y;
+        record.id_[0] = image.id_.A;
+        record.id_[1] = image.id_.B;
+        record.id_[2] = image.id_.C;
+        record.id_[3] = image.id_.D;
+        record.trackingState_ = (uint8)image.TrackingState;
+        record.pickedForEstimation_ = image.PickedForEstimation ? 1 : 0;
+    }
+}
+
+void FiducialSnapshot::Write(const TArray<FTrackedImageData>& images, TArray<uint8>& outBytes)
+{
+    TArray<FRecord> records;
+    records.SetNumUninitialized(images.Num());
+
+    // strings table starts with an empty name, so zero offset is always valid
+    TArray<ANSICHAR> strings;
+    strings.Add('\0');
+    TMap<FString, uint32> nameOffsets;
+
+    for (int32 i = 0; i < images.Num(); ++i)
+    {
+        FRecord& record = records[i];
+        EncodeRecord(images[i], record);
+
+        if (images[i].ImageName.IsEmpty())
+            continue;
+
+        FTCHARToUTF8 utf8(*images[i].ImageName);
+        record.nameLength_ = utf8.Length();
+
+        if (const uint32* offset = nameOffsets.Find(images[i].ImageName))
+            record.nameOffset_ = *offset;
+        else
+        {
+            record.nameOffset_ = strings.Num();
+            nameOffsets.Add(images[i].ImageName, record.nameOffset_);
+            strings.Append(utf8.Get(), utf8.Length());
+            strings.Add('\0');
+        }
+    }
+
+    FHeader header;
+    FMemory::Memzero(header);
+    header.magic_ = kMagic;
+    header.version_ = kVersion;
+    header.headerSize_ = sizeof(FHeader);
+    header.recordCount_ = records.Num();
+    header.recordStride_ = sizeof(FRecord);
+    header.recordsOffset_ = sizeof(FHeader);
+    header.stringsOffset_ = header.recordsOffset_ + records.Num() * sizeof(FRecord);
+    header.stringsSize_ = strings.Num();
+
+    outBytes.SetNumUninitialized(header.stringsOffset_ + header.stringsSize_);
+    FMemory::Memcpy(outBytes.GetData(), &header, sizeof(FHeader));
+    FMemory::Memcpy(outBytes.GetData() + header.recordsOffset_, records.GetData(), records.Num() * sizeof(FRecord));
+    FMemory::Memcpy(outBytes.GetData() + header.stringsOffset_, strings.GetData(), strings.Num());
+}
+
+bool FiducialSnapshot::LoadLegacy(const FString& path, TArray<FTrackedImageData>& outImages)
+{
+    TArray<uint8> bytes;
+
+    if (!FFileHelper::LoadFileToArray(bytes, *path) || bytes.Num() < (int32)sizeof(int32))
+        return false;
+
+    // a snapshot that failed to open is damaged, not legacy
+    if (*reinterpret_cast<const uint32*>(bytes.GetData()) == kMagic)
+    {
+        DLOG_MODULE_ERROR(FiducialRelocalizer, "Fiducial snapshot {} is damaged or of unsupported version",
+                          TCHAR_TO_ANSI(*path));
+        return false;
+    }
+
+    FMemoryReader reader(bytes, true);
+
+    int32 nFiducials = 0;
+    reader << nFiducials;
+
+    if (nFiducials < 0 || nFiducials > (bytes.Num() - reader.Tell()) / kLegacyMinRecordSize)
+    {
+        DLOG_MODULE_ERROR(FiducialRelocalizer, "Fiducial file {} is not a fiducial snapshot", TCHAR_TO_ANSI(*path));
+        return false;
+    }
+
+    outImages.Reserve(outImages.Num() + nFiducials);
+
+    for (int32 i = 0; i < nFiducials; ++i)
+    {
+        // legacy files don't have anything but name and pose
+        FTrackedImageData fiducial;
+        fiducial.EstimatedSize = FVector2D::ZeroVector;
+        fiducial.TrackingState = EARTrackingState::Unknown;
+        fiducial.PickedForEstimation = false;
+
+        reader << fiducial.ImageName;
+        reader << fiducial.PawnToImage;
+
+        if (reader.IsError())
+        {
+            DLOG_MODULE_ERROR(FiducialRelocalizer, "Fiducial file {} is truncated at image {}", TCHAR_TO_ANSI(*path), i);
+            return false;
+        }
+
+        outImages.Add(fiducial);
+    }
+
+    return true;
+}
+
+FFiducialSnapshotView::FFiducialSnapshotView()
+    : Data(nullptr)
+    , Size(0)
+    , Header(nullptr)
+    , Records(nullptr)
+    , Strings(nullptr)
+{
+}
+
+FFiducialSnapshotView::~FFiducialSnapshotView()
+{
+    Close();
+}
+
+bool FFiducialSnapshotView::Open(const FString& path)
+{
+    Close();
+
+    IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+    MappedFile.Reset(platformFile.OpenMapped(*path));
+
+    if (MappedFile.IsValid() && MappedFile->GetFileSize() > 0)
+        MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+
+    if (MappedRegion.IsValid())
+    {
+        Data = MappedRegion->GetMappedPtr();
+        Size = MappedRegion->GetMappedSize();
+    }
+    else
+    {
+        // platform file can't map -- read it whole instead
+        MappedFile.Reset();
+
+        if (!FFileHelper::LoadFileToArray(Buffer, *path, FILEREAD_Silent))
+            return false;
+
+        Data = Buffer.GetData();
+        Size = Buffer.Num();
+    }
+
+    if (!ParseHeader())
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void FFiducialSnapshotView::Close()
+{
+    // region must go before the file it maps
+    MappedRegion.Reset();
+    MappedFile.Reset();
+    Buffer.Empty();
+
+    Data = nullptr;
+    Size = 0;
+    Header = nullptr;
+    Records = nullptr;
+    Strings = nullptr;
+}
+
+bool FFiducialSnapshotView::ParseHeader()
+{
+    using namespace FiducialSnapshot;
+
+    if (Size < (int64)sizeof(FHeader))
+        return false;
+
+    const FHeader* header = reinterpret_cast<const FHeader*>(Data);
+
+    if (header->magic_ != kMagic)
+        return false;
+
+    if (header->version_ > kVersion)
+    {
+        DLOG_MODULE_WARN(FiducialRelocalizer, "Fiducial snapshot version {} is newer than supported {}",
+                         header->version_, kVersion);
+        return false;
+    }
+
+    // records are read in place, so they must stay 4 byte aligned
+    bool valid = header->headerSize_ >= sizeof(FHeader) &&
+        header->recordCount_ <= kMaxRecords &&
+        header->recordStride_ >= sizeof(FRecord) && header->recordStride_ % 4 == 0 &&
+        header->recordsOffset_ >= header->headerSize_ && header->recordsOffset_ % 4 == 0 &&
+        (int64)header->recordsOffset_ + (int64)header->recordCount_ * header->recordStride_ <= Size &&
+        header->stringsSize_ > 0 &&
+        (int64)header->stringsOffset_ + header->stringsSize_ <= Size &&
+        Data[header->stringsOffset_ + header->stringsSize_ - 1] == '\0';
+
+    if (!valid)
+    {
+        DLOG_MODULE_ERROR(FiducialRelocalizer, "Fiducial snapshot header is damaged");
+        return false;
+    }
+
+    Header = header;
+    Records = Data + header->recordsOffset_;
+    Strings = reinterpret_cast<const ANSICHAR*>(Data + header->stringsOffset_);
+
+    return true;
+}
+
+const ANSICHAR* FFiducialSnapshotView::GetName(const FiducialSnapshot::FRecord& record) const
+{
+    // the strings table ends with zero, so a name in bounds is always terminated
+    // and the empty name at offset zero stands in for one that is not
+    if ((uint64)record.nameOffset_ + record.nameLength_ >= Header->stringsSize_)
+        return Strings;
+
+    return Strings + record.nameOffset_;
+}
+
+void FFiducialSnapshotView::GetImageData(int32 i, FTrackedImageData& outImage) const
+{
+    const FiducialSnapshot::FRecord& record = GetRecord(i);
+
+    outImage.PawnToImage = FTransform(FQuat(record.rotation_[0], record.rotation_[1], record.rotation_[2], record.rotation_[3]),
+                                      FVector(record.translation_[0], record.translation_[1], record.translation_[2]),
+                                      FVector(record.scale_[0], record.scale_[1], record.scale_[2]));
+    outImage.EstimatedSize = FVector2D(record.estimatedSize_[0], record.estimatedSize_[1]);
+    // state from a file written elsewhere, possibly by a newer engine
+    outImage.TrackingState = record.trackingState_ <= (uint8)EARTrackingState::StoppedTracking ?
+        (EARTrackingState)record.trackingState_ : EARTrackingState::Unknown;
+    const ANSICHAR* nameUtf8 = GetName(record);
+    FUTF8ToTCHAR name(nameUtf8, *nameUtf8 ? record.nameLength_ : 0);
+    outImage.ImageName = FString(name.Length(), name.Get());
+    outImage.id_ = FGuid(record.id_[0], record.id_[1], record.id_[2], record.id_[3]);
+    outImage.PickedForEstimation = record.pickedForEstimation_ != 0;
+}
+
+void FFiducialSnapshotView::GetImageData(TArray<FTrackedImageData>& outImages) const
+{
+    int32 first = outImages.Num();
+    outImages.SetNum(first + Num());
+
+    for (int32 i = 0; i < Num(); ++i)
+        GetImageData(i, outImages[first + i]);
+}
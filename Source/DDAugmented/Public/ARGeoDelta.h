@@ -0,0 +1,129 @@
+//
+// ARGeoDelta.h
+//
+// Compact plane update encoding used to send tracked plane changes from
+// AR clients to the server.
+//
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Class.h"
+#include "Misc/Guid.h"
+
+#include "ARGeoDelta.generated.h"
+
+struct FARTrackedGeoData;
+class UPackageMap;
+
+namespace ARGeoQuantize
+{
+    // boundary vertex quantization step, cm. int16 covers +/-163m around plane center
+    constexpr float kPositionStep = 0.5f;
+
+    // upper bound of boundary vertices accepted from the wire
+    constexpr int32 kMaxBoundaryVertices = 4096;
+
+    DDAUGMENTED_API int16 QuantizePosition(float v);
+    DDAUGMENTED_API float DequantizePosition(int16 q);
+
+    // smallest-three quaternion encoding: 2 bits + 3 x 15 bits
+    DDAUGMENTED_API void SerializeQuat(FArchive& Ar, FQuat& q);
+
+    // translation quantized to 0.1cm, rotation as above, scale sent only if non-unit
+    DDAUGMENTED_API void SerializeTransform(FArchive& Ar, FTransform& t);
+}
+
+// range of boundary vertices changed since the keyframe
+struct FARGeoVertexRange {
+    int32 start_;
+    int32 count_;
+};
+
+/**
+ * Plane update sent from AR client to the server.
+ * Keyframes carry full plane state. Deltas carry only vertex ranges (and
+ * poses) that differ from the last keyframe, so a lost delta never breaks
+ * the following ones -- receiver just needs the keyframe they refer to.
+ */
+USTRUCT()
+struct DDAUGMENTED_API FARGeoDelta
+{
+    GENERATED_BODY()
+
+    FGuid id_;
+
+    // update sequence number, used to drop reordered updates
+    uint16 sequence_ = 0;
+
+    // keyframe this update carries or is relative to
+    uint16 keyframeSeq_ = 0;
+
+    bool isKeyframe_ = false;
+
+    // total number of boundary vertices
+    int32 vertexCount_ = 0;
+
+    TArray<FARGeoVertexRange> ranges_;
+
+    // quantized local space xyz of vertices in ranges_, in order
+    TArray<int16> verts_;
+
+    // poses are always present in keyframes. in deltas -- only if they differ from the keyframe
+    bool hasPose_ = false;
+    FTransform localToWorld_;
+    FTransform localToTracking_;
+
+    bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FARGeoDelta> : public TStructOpsTypeTraitsBase2<FARGeoDelta>
+{
+    enum
+    {
+        WithNetSerializer = true
+    };
+};
+
+/**
+ * Sender side (AR client) per-plane delta state.
+ */
+class DDAUGMENTED_API FARGeoDeltaEncoder
+{
+public:
+    // builds next update for the plane. returns false if nothing needs to be sent.
+    // encoder state is not changed until the update is committed
+    bool Encode(const FARTrackedGeoData& data, float timeSeconds, float keyframeInterval, FARGeoDelta& outDelta);
+
+    // marks update produced by the last Encode call as sent
+    void Commit(const FARGeoDelta& delta, const FARTrackedGeoData& data, float timeSeconds);
+
+private:
+    TArray<int16> keyframeVerts_;
+    TArray<int16> currentVerts_;
+    FTransform keyframeLocalToWorld_, keyframeLocalToTracking_;
+    float keyframeTime_ = 0.f;
+    uint32 lastRevision_ = 0;
+    uint16 sequence_ = 0;
+    uint16 keyframeSeq_ = 0;
+    bool hasKeyframe_ = false;
+};
+
+/**
+ * Receiver side (server) per-plane delta state.
+ */
+class DDAUGMENTED_API FARGeoDeltaDecoder
+{
+public:
+    // applies update to the plane. returns false if update was dropped
+    // (reordered, or refers to a keyframe we don't have)
+    bool Apply(const FARGeoDelta& delta, FARTrackedGeoData& data);
+
+private:
+    TArray<FVector> keyframeVerts_;
+    FTransform keyframeLocalToWorld_, keyframeLocalToTracking_;
+    uint16 lastSequence_ = 0;
+    uint16 keyframeSeq_ = 0;
+    bool hasKeyframe_ = false;
+};
@@ -0,0 +1,53 @@
+//
+// ARPlaneChunk.h
+//
+// Replicated container for one AR client's planes within one grid cell.
+// Chunks let the net driver cull and prioritize plane data per viewer by
+// distance, instead of sending every plane to every connection.
+//
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "ARPlaneRenderer.h"
+
+#include "ARPlaneChunk.generated.h"
+
+UCLASS(NotBlueprintable, NotPlaceable)
+class DDAUGMENTED_API AARPlaneChunk : public AActor
+{
+    GENERATED_BODY()
+
+public:
+    AARPlaneChunk();
+
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+    // owning AR client has its own planes; everyone else gets chunks within NetCullDistanceSquared
+    virtual bool IsNetRelevantFor(const AActor* RealViewer, const AActor* ViewTarget, const FVector& SrcLocation) const override;
+
+    // nearer chunks first when bandwidth is saturated
+    virtual float GetNetPriority(const FVector& ViewPos, const FVector& ViewDir, AActor* Viewer, AActor* ViewTarget,
+                                 UActorChannel* InChannel, float Time, bool bLowBandwidth) override;
+
+    // renderer the planes belong to
+    UPROPERTY(ReplicatedUsing = OnRep_Renderer)
+    AARPlaneRenderer* Renderer;
+
+    UPROPERTY(Replicated)
+    FARTrackedGeoHeaderArray GeoHeaderArray;
+
+    UPROPERTY(Replicated)
+    FARTrackedGeoArray GeoDataArray;
+
+    // called from GeoDataArray replication callbacks on clients, forwarded to renderer
+    void OnGeoDataAdded(const FARTrackedGeoData& data);
+    void OnGeoDataChanged(const FARTrackedGeoData& data);
+    void OnGeoDataRemoved(const FARTrackedGeoData& data);
+
+private:
+    // items may arrive before the renderer reference resolves
+    UFUNCTION()
+    void OnRep_Renderer();
+};
@@ -0,0 +1,78 @@
+//
+// ARPlaneConsolidator.h
+//
+// Server side merge of planes tracked by several AR clients. Planes of
+// renderers with bConsolidatePlanes that agree in normal and height and
+// overlap are merged into one canonical plane, which is what other clients
+// receive and render.
+//
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ARPlaneRenderer.h"
+
+#include "ARPlaneConsolidator.generated.h"
+
+UCLASS()
+class DDAUGMENTED_API AARPlaneConsolidator : public AARPlaneRenderer
+{
+    GENERATED_BODY()
+
+public:
+    AARPlaneConsolidator();
+
+    virtual void Tick(float DeltaTime) override;
+
+    /** Seconds between merge passes. A pass is skipped if no source plane changed */
+    UPROPERTY(Category = ARPlaneConsolidator, EditAnywhere, BlueprintReadWrite)
+    float ConsolidationInterval;
+
+    /** Max angle (degrees) between normals of planes that get merged */
+    UPROPERTY(Category = ARPlaneConsolidator, EditAnywhere, BlueprintReadWrite)
+    float MergeMaxAngle;
+
+    /** Max distance (cm) of a plane's center from the other plane */
+    UPROPERTY(Category = ARPlaneConsolidator, EditAnywhere, BlueprintReadWrite)
+    float MergeMaxHeight;
+
+    /** Planes whose boundary bounds are closer than this (cm) in the plane count as overlapping */
+    UPROPERTY(Category = ARPlaneConsolidator, EditAnywhere, BlueprintReadWrite)
+    float MergeOverlapMargin;
+
+    /** Planes of all source renderers at last merge pass */
+    UPROPERTY(Category = "ARPlaneConsolidator|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 SourcePlaneCount;
+
+    /** Canonical planes produced by last merge pass */
+    UPROPERTY(Category = "ARPlaneConsolidator|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 ConsolidatedPlaneCount;
+
+private:
+    // source plane with world space data used by merge tests
+    struct FSourcePlane {
+        const FARTrackedGeoData* data_;
+        FVector normal_;
+        FVector center_;
+        FBox worldBox_;
+        FBox2D localBox_;
+        float area_;
+    };
+
+    void Consolidate();
+
+    // true if plane b lies in plane a within merge tolerances and overlaps it
+    bool CanMerge(const FSourcePlane& a, const FSourcePlane& b, float minNormalDot) const;
+
+    // builds canonical plane of a cluster in the frame of its largest plane
+    void MergeCluster(const TArray<const FSourcePlane*>& cluster, FARTrackedGeoData& outData) const;
+
+    // adds, updates and removes canonical planes to match the merge result
+    void ApplyCanonicalPlanes(TArray<FARTrackedGeoData>& canonical);
+
+    // canonical plane every source plane went into at last pass, keeps canonical ids stable
+    TMap<FGuid, FGuid> SourceToCanonical;
+
+    uint32 LastSourceSignature;
+    float LastConsolidationTime;
+};
@@ -0,0 +1,76 @@
+//
+// ARPlaneMeshComponent.h
+//
+// Primitive component that keeps one set of GPU buffers per tracked plane
+// and updates them in place, only for planes that changed.
+//
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/MeshComponent.h"
+#include "Misc/Guid.h"
+
+#include "ARPlaneMeshComponent.generated.h"
+
+// plane geometry in plane local space
+struct FARPlaneMeshData {
+    TArray<FVector> positions_;
+    TArray<FVector2D> uvs_;
+    // plane tint in RGB, edge feathering in alpha
+    TArray<FColor> colors_;
+    TArray<uint32> indices_;
+};
+
+UCLASS(ClassGroup=(DDAugmented))
+class DDAUGMENTED_API UARPlaneMeshComponent : public UMeshComponent
+{
+    GENERATED_BODY()
+
+public:
+    UARPlaneMeshComponent(const FObjectInitializer& ObjectInitializer);
+
+    // adds plane or replaces its geometry. GPU buffers are rewritten in place
+    // if vertex and index counts didn't change, reallocated otherwise
+    void UpdatePlane(const FGuid& id, const FTransform& localToComponent, FARPlaneMeshData&& data);
+
+    // moves plane without touching its GPU buffers
+    void UpdatePlaneTransform(const FGuid& id, const FTransform& localToComponent);
+
+    // hidden planes keep their GPU buffers, but are not drawn
+    void SetPlaneVisible(const FGuid& id, bool visible);
+
+    void RemovePlane(const FGuid& id);
+    void RemoveAllPlanes();
+
+    int32 GetNumPlanes() const { return Planes.Num(); }
+
+    //~ Begin UPrimitiveComponent Interface.
+    virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
+    //~ End UPrimitiveComponent Interface.
+
+    //~ Begin UMeshComponent Interface.
+    virtual int32 GetNumMaterials() const override { return 1; }
+    //~ End UMeshComponent Interface.
+
+private:
+    //~ Begin USceneComponent Interface.
+    virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+    //~ End USceneComponent Interface.
+
+    struct FPlaneEntry {
+        FARPlaneMeshData data_;
+        FTransform localToComponent_;
+        FBox localBox_;
+        bool visible_ = true;
+    };
+
+    void PlaneBoundsChanged();
+
+    // game thread copy of all planes, used to (re)create scene proxy
+    TMap<FGuid, FPlaneEntry> Planes;
+
+    FBox LocalBounds;
+
+    friend class FARPlaneSceneProxy;
+};
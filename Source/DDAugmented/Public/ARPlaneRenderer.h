@@ -18,16 +18,26 @@
 #include "GameFramework/Actor.h"
 #include "ARTrackable.h"
 #include "Misc/Guid.h"
+#include "Engine/NetSerialization.h"
+#include "ARGeoDelta.h"
+#include "ARPlaneSetTracker.h"
+#include "ARPlaneSpatialIndex.h"
+#include "ARPolygonUtils.h"
+#include "Async/Future.h"
 
 #include "ARPlaneRenderer.generated.h"
 
-UCLASS()
-class UARTrackedGeoData : public UObject {
+class AARPlaneRenderer;
+class AARPlaneChunk;
+class UARPlaneMeshComponent;
+
+USTRUCT()
+struct FARTrackedGeoData {
     GENERATED_BODY()
     
 public:
     
-    UARTrackedGeoData() : UObject() { id_ = FGuid::NewGuid(); }
+    FARTrackedGeoData() : color_(FColor::White), netId_(0), revision_(0), boundaryHash_(0), poseHash_(0), sourceBoundaryHash_(0) {}
     
     UPROPERTY()
     TArray<FVector> boundaryVerts_;
@@ -46,6 +56,205 @@ public:
     
     UPROPERTY()
     FGuid id_;
+    
+    // server assigned short id, replicated in place of id_ and debugName_, which
+    // go once per plane through FARTrackedGeoHeaderArray. 0 -- identity sent inline
+    UPROPERTY()
+    uint16 netId_;
+    
+    // local only (not replicated) -- every peer tracks revisions of its own copy
+    // bumped every time boundary or pose hash changes
+    uint32 revision_;
+    uint32 boundaryHash_;
+    uint32 poseHash_;
+    
+    // AR client: hash of the unsimplified boundary boundaryVerts_ was made from
+    uint32 sourceBoundaryHash_;
+    
+    // recomputes boundary and pose hashes from current data.
+    // returns true (and bumps revision_) if any of them changed
+    bool UpdateRevision();
+    
+    // boundary as 2D int16 (plane local z is 0), quantized poses, netId_ instead of id_ when mapped
+    bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FARTrackedGeoData> : public TStructOpsTypeTraitsBase2<FARTrackedGeoData> {
+    enum
+    {
+        WithNetSerializer = true,
+    };
+};
+
+USTRUCT()
+struct FARTrackedGeoHeader : public FFastArraySerializerItem {
+    GENERATED_BODY()
+    
+    UPROPERTY()
+    uint16 netId_ = 0;
+    
+    UPROPERTY()
+    FGuid id_;
+    
+    UPROPERTY()
+    FName debugName_;
+    
+    void PostReplicatedAdd(const struct FARTrackedGeoHeaderArray& InArraySerializer);
+};
+
+/**
+ * Identity of planes in an FARTrackedGeoArray, keyed by netId_. Headers change
+ * only when planes are added or removed, so each connection gets them once.
+ */
+USTRUCT()
+struct FARTrackedGeoHeaderArray : public FFastArraySerializer {
+    GENERATED_BODY()
+    
+    UPROPERTY()
+    TArray<FARTrackedGeoHeader> Items;
+    
+    // plane array whose items refer to these headers
+    struct FARTrackedGeoArray* Geo = nullptr;
+    
+    const FARTrackedGeoHeader* Find(uint16 netId) const;
+    
+    void Add(const FARTrackedGeoData& data);
+    void Remove(uint16 netId);
+    
+    void MarkIndexDirty() const { bIndexDirty = true; }
+    
+    bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+    {
+        return FFastArraySerializer::FastArrayDeltaSerialize<FARTrackedGeoHeader, FARTrackedGeoHeaderArray>(Items, DeltaParms, *this);
+    }
+    
+private:
+    void RebuildIndex() const;
+    
+    mutable TMap<uint16, int32> IndexByNetId;
+    mutable bool bIndexDirty = false;
+};
+
+template<>
+struct TStructOpsTypeTraits<FARTrackedGeoHeaderArray> : public TStructOpsTypeTraitsBase2<FARTrackedGeoHeaderArray> {
+    enum
+    {
+        WithNetDeltaSerializer = true,
+    };
+};
+
+USTRUCT()
+struct FARTrackedGeoItem : public FFastArraySerializerItem {
+    GENERATED_BODY()
+    
+    UPROPERTY()
+    FARTrackedGeoData data_;
+    
+    void PreReplicatedRemove(const struct FARTrackedGeoArray& InArraySerializer);
+    void PostReplicatedAdd(const struct FARTrackedGeoArray& InArraySerializer);
+    void PostReplicatedChange(const struct FARTrackedGeoArray& InArraySerializer);
+};
+
+/**
+ * Replicated set of tracked planes. Only items marked dirty are sent, and
+ * clients get per-item add/change/remove callbacks forwarded to the renderer.
+ */
+USTRUCT()
+struct FARTrackedGeoArray : public FFastArraySerializer {
+    GENERATED_BODY()
+    
+    UPROPERTY()
+    TArray<FARTrackedGeoItem> Items;
+    
+    // renderer receiving item callbacks
+    AARPlaneRenderer* Owner = nullptr;
+    
+    // or relevancy chunk, for arrays held by one
+    AARPlaneChunk* Chunk = nullptr;
+    
+    // identity of items with netId_; kept in sync by Add/Remove
+    FARTrackedGeoHeaderArray* Headers = nullptr;
+    
+    int32 Num() const { return Items.Num(); }
+    
+    // O(1) lookup through id index
+    FARTrackedGeoItem* Find(const FGuid& id);
+    
+    // add/remove mark array dirty and keep id index in sync;
+    // in-place changes must be followed by MarkItemDirty
+    FARTrackedGeoItem& Add(const FARTrackedGeoData& data);
+    bool Remove(const FGuid& id);
+    
+    // replication adds and removes items on clients -- index is rebuilt on next lookup
+    void MarkIndexDirty() const { bIndexDirty = true; }
+    
+    // receiver: fills id_ and debugName_ of a mapped item from its header.
+    // false if the header hasn't arrived yet -- item is announced once it does
+    bool ResolveHeader(FARTrackedGeoData& data) const;
+    void OnHeaderAdded(const FARTrackedGeoHeader& header);
+    
+    // items received before their header
+    mutable int32 NumUnresolved = 0;
+    
+    // forward replication callbacks to renderer or chunk
+    void NotifyAdded(const FARTrackedGeoData& data) const;
+    void NotifyChanged(const FARTrackedGeoData& data) const;
+    void NotifyRemoved(const FARTrackedGeoData& data) const;
+    
+    bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+    {
+        return FFastArraySerializer::FastArrayDeltaSerialize<FARTrackedGeoItem, FARTrackedGeoArray>(Items, DeltaParms, *this);
+    }
+    
+private:
+    void RebuildIndex();
+    
+    TMap<FGuid, int32> IndexById;
+    mutable bool bIndexDirty = false;
+
+};
+
+template<>
+struct TStructOpsTypeTraits<FARTrackedGeoArray> : public TStructOpsTypeTraitsBase2<FARTrackedGeoArray> {
+    enum
+    {
+        WithNetDeltaSerializer = true,
+    };
+};
+
+// AR plane as reported by the AR session in one frame -- everything ingestion
+// reads from UARPlaneGeometry, so recorded planes can be fed in where there is
+// no AR session (editor, headless builds)
+struct FARPlaneSample {
+    // UARTrackedGeometry unique id, stable for the plane's lifetime
+    FGuid sourceId_;
+    FName debugName_;
+    EARTrackingState trackingState_ = EARTrackingState::Unknown;
+    bool subsumed_ = false;
+    int32 lastUpdateFrame_ = 0;
+    FTransform localToWorld_;
+    FTransform localToTracking_;
+    FVector extent_ = FVector::ZeroVector;
+    // unsimplified boundary in plane local space
+    TArray<FVector> boundary_;
+    
+    void FromGeometry(const UARPlaneGeometry* geometry);
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnARPlaneSample, const FARPlaneSample&);
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnARPlaneEvent, FGuid, PlaneId);
+
+UENUM(BlueprintType)
+enum class EARPlaneRenderMode : uint8
+{
+    /** One procedural mesh component per plane, tinted through material instance */
+    PerPlaneComponent,
+    /** All planes baked into one component section, tint in vertex color. Constant draw calls */
+    Merged,
+    /** One custom primitive with per-plane GPU buffers updated in place, tint in vertex color. Pose changes don't touch buffers */
+    PlaneBuffers
 };
 
 UCLASS()
@@ -60,6 +269,10 @@ public:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+    
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    
+    virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
 
 public:	
 	// Called every frame
@@ -75,31 +288,474 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TArray<FColor> PlaneColors;
     
-    // replicated data
+    /** Rebuild plane mesh only when its boundary changes; pose-only changes just move the component */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    bool bSkipUnchangedGeometry;
+    
+    /** Number of full plane mesh rebuilds since last stats reset */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 MeshRebuildCount;
+    
+    /** Number of plane mesh rebuilds skipped because the boundary did not change */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 MeshRebuildSkippedCount;
+    
+    /** Number of skipped rebuilds where only component transform was updated */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 PoseOnlyUpdateCount;
+    
+    UFUNCTION(Category = ARPlaneRenderer, BlueprintCallable)
+    void ResetMeshStats();
+    
+    /** How often (seconds) AR client sends full plane keyframe to the server. Updates in between are deltas */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float GeoKeyframeInterval;
+    
+    /** How planes are turned into meshes */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    EARPlaneRenderMode PlaneRenderMode;
+    
+    /** Material for Merged and PlaneBuffers modes. Should take plane tint from vertex color RGB and edge feathering from vertex alpha. Falls back to PlaneMaterial */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    UMaterialInterface* MergedPlaneMaterial;
+    
+    /** Max number of hidden plane components kept for reuse. Components released beyond this are destroyed */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    int32 MaxPooledPlaneComponents;
+    
+    /** Number of plane components (with material instances) created on BeginPlay */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    int32 PrewarmPlaneComponents;
+    
+    /** Number of plane components taken from the pool since last stats reset */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 PlaneComponentPoolHits;
+    
+    /** Number of plane components created because the pool was empty since last stats reset */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 PlaneComponentPoolMisses;
+    
+    /** How often (seconds) plane meshes are fully reconciled against plane data, in case replication callbacks were missed. 0 disables */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float GeoReconcileInterval;
+    
+    /** Fired when a plane mesh is created */
+    UPROPERTY(Category = ARPlaneRenderer, BlueprintAssignable)
+    FOnARPlaneEvent OnPlaneAdded;
+    
+    /** Fired when a plane mesh is removed */
+    UPROPERTY(Category = ARPlaneRenderer, BlueprintAssignable)
+    FOnARPlaneEvent OnPlaneRemoved;
+    
+    /** Diffs plane meshes against current plane data: queues missing meshes and removes stale ones. Linear in plane count */
+    UFUNCTION(Category = ARPlaneRenderer, BlueprintCallable)
+    void ReconcileGeoMeshes();
+    
+    /** Max deviation (cm) of the simplified plane boundary from the one reported by AR. 0 disables simplification */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float BoundarySimplifyTolerance;
+    
+    /** Hard limit of plane boundary vertices kept for rendering and replication. 0 -- no limit */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    int32 MaxBoundaryVertices;
+    
+    /** Total boundary vertices of tracked planes as reported by AR, last update */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 BoundaryVerticesRaw;
+    
+    /** Total boundary vertices of tracked planes after simplification, last update */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 BoundaryVerticesSimplified;
+    
+    /** Take plane changes from AR system trackable events instead of polling all geometries. Falls back to polling if events are not available */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    bool bUseTrackableEvents;
+    
+    /** How often (seconds) AR client polls AR session for plane changes when trackable events are not used. 0 -- every tick */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlanePollInterval;
+    
+    /** Plane movement (cm) below which AR plane updates are ignored */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneUpdateMinTranslation;
+    
+    /** Plane rotation (degrees) below which AR plane updates are ignored */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneUpdateMinRotation;
+    
+    /** Plane extent change (cm) below which AR plane updates are ignored, unless boundary vertex count changes */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneUpdateMinExtentChange;
+    
+    /** Relative change of plane boundary area (0.05 -- 5%) below which AR plane updates are ignored */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneUpdateMinAreaChange;
+    
+    /** Number of polled AR plane updates ignored as unchanged or below thresholds since last stats reset */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 PlaneUpdatesSuppressed;
+    
+    /** Build plane meshes on worker threads. Finished meshes are applied on the following tick */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    bool bAsyncGeoMeshBuild;
+    
+    /** Number of plane mesh rebuilds served from the plane's cached triangulation since last stats reset */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 TriangulationCacheHits;
+    
+    /** Max number of plane update batches per second AR client sends to the server */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float MaxGeoUpdateRate;
+    
+    /** Max size (bytes) of one plane update batch. Planes that don't fit are sent with next batches */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    int32 GeoUpdateByteBudget;
+    
+    /** Number of plane update batches sent to the server since last stats reset */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 GeoUpdateBatchCount;
+    
+    /** Estimated payload bytes of plane updates sent to the server since last stats reset */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 GeoUpdateBytesSent;
+    
+    /** Cell size (cm) of the plane query grid */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneIndexCellSize;
+    
+    /** Closest plane hit by segment Start-End, within plane boundary. Plane index is updated on tick, along with meshes */
+    UFUNCTION(Category = ARPlaneRenderer, BlueprintCallable)
+    bool RaycastPlanes(FVector Start, FVector End, FARPlaneQueryHit& OutHit) const;
+    
+    /** Closest plane (boundary included) within MaxDistance of the point. MaxDistance 0 -- no limit */
+    UFUNCTION(Category = ARPlaneRenderer, BlueprintCallable)
+    bool FindNearestPlane(FVector Point, float MaxDistance, FARPlaneQueryHit& OutHit) const;
+    
+    /** Planes whose world bounds overlap the box */
+    UFUNCTION(Category = ARPlaneRenderer, BlueprintCallable)
+    TArray<FGuid> OverlapPlanes(FVector Center, FVector HalfExtent) const;
+    
+    /** True if the point is within MaxHeight of the plane and projects inside its boundary */
+    UFUNCTION(Category = ARPlaneRenderer, BlueprintCallable)
+    bool IsPointOnPlane(FGuid PlaneId, FVector Point, float MaxHeight) const;
+    
+    /** Planes farther than this (cm) from the local player camera are hidden. 0 -- no distance culling */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneCullDistance;
+    
+    /** Hide planes outside the local player camera's field of view */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    bool bFrustumCullPlanes;
+    
+    /** Planes farther than this (cm) get low detail meshes: no feather band, simplified boundary. 0 -- always full detail */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneLODDistance;
+    
+    /** Boundary simplification tolerance (cm) of low detail meshes */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneLODSimplifyTolerance;
+    
+    /** Seconds between plane culling and LOD updates */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneVisibilityUpdateInterval;
+    
+    /** Planes hidden by distance or frustum culling at last visibility update */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 CulledPlaneCount;
+    
+    /** Visible planes using low detail meshes at last visibility update */
+    UPROPERTY(Category = "ARPlaneRenderer|Stats", VisibleAnywhere, BlueprintReadOnly)
+    int32 LowDetailPlaneCount;
+    
+    /** Replicate planes to other clients only within PlaneRelevancyRadius of their view, through per-cell chunk actors. Read on BeginPlay */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    bool bUsePlaneRelevancy;
+    
+    /** Distance (cm) from a client's view within which it receives planes */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneRelevancyRadius;
+    
+    /** Size (cm) of the grid cells planes are grouped into for relevancy */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    float PlaneRelevancyCellSize;
+    
+    /** Server: don't replicate these planes to other clients; they get the merged set of an AARPlaneConsolidator instead. Read on BeginPlay */
+    UPROPERTY(Category = ARPlaneRenderer, EditAnywhere, BlueprintReadWrite)
+    bool bConsolidatePlanes;
+    
+    // server: planes are picked up by AARPlaneConsolidator
+    bool IsConsolidationSource() const { return bPlanesConsolidatedActive; }
+    
+    // AR client: ingests AR planes as the local AR session would, through the
+    // same thresholds, simplification and replication. Used by session replay
+    // where there is no AR session. false if this renderer doesn't take AR planes
+    bool FeedPlaneSamples(const TArray<FARPlaneSample>& samples);
+    
+    // every AR plane sample before ingestion, for session recording
+    FOnARPlaneSample OnPlaneSample;
+    
+    // plane identities, declared before GeoDataArray so headers arrive ahead of their planes
+    UPROPERTY(Replicated)
+    FARTrackedGeoHeaderArray GeoHeaderArray;
+    
+    // replicated data. with plane relevancy it is not replicated, clients fill it from chunks
     UPROPERTY(Replicated)
-    TArray<UARTrackedGeoData*> GeoDataArray;
+    FARTrackedGeoArray GeoDataArray;
+    
+    // called from GeoDataArray replication callbacks on clients, and on
+    // local changes on server and AR client. queue mesh work for next tick
+    void OnGeoDataAdded(const FARTrackedGeoData& data);
+    void OnGeoDataChanged(const FARTrackedGeoData& data);
+    void OnGeoDataRemoved(const FARTrackedGeoData& data);
+    
+    // client: plane received from or dropped by a relevancy chunk
+    void OnChunkGeoDataChanged(AARPlaneChunk* chunk, const FARTrackedGeoData& data);
+    void OnChunkGeoDataRemoved(AARPlaneChunk* chunk, const FGuid& id);
+
+protected:
+    // false for renderers that don't take planes from the local AR session
+    bool bTracksARPlanes;
+    
+    // server: short id for a new plane, unique among planes of this renderer
+    uint16 AllocateGeoNetId();
 
 private:
-    void UpdatePlaneData(UARPlaneGeometry* ARCorePlaneObject);
+    void UpdatePlaneData(const FARPlaneSample& sample);
+    
+    void AddNewGeoData(const FGuid& sourceId, const FARTrackedGeoData& data);
+    void RemoveGeoData(const FGuid& sourceId, FGuid id);
+    void UpdateGeoData(const FARPlaneSample& sample, FARTrackedGeoItem& item);
+    
+    // AR client: true if AR plane changed past update thresholds since last accepted update
+    bool PlaneChangedEnough(const FARPlaneSample& sample, const FGuid& id);
+    
+    // AR client: trackable events from AR system
+    void BindTrackableEvents();
+    void UnbindTrackableEvents();
+    void OnTrackableChanged(UARTrackedGeometry* Geometry);
+    void OnTrackableRemoved(UARTrackedGeometry* Geometry);
     
-    void AddNewGeoData(UARPlaneGeometry* ARCorePlaneObject, UARTrackedGeoData *data);
-    void RemoveGeoData(UARPlaneGeometry* ARCorePlaneObject, UARTrackedGeoData *data);
-    void UpdateGeoData(UARPlaneGeometry* ARCorePlaneObject, UARTrackedGeoData *data);
+    // recounts boundary vertices over tracked planes. Stats are otherwise
+    // kept up to date as planes are ingested and removed
+    void UpdateBoundaryStats();
     
     UFUNCTION(Server, reliable)
-    void RPC_GeoDataAddOrRemove(bool isAdd, UARTrackedGeoData *data);
+    void RPC_GeoDataAdd(const FARTrackedGeoData& data);
+    
+    UFUNCTION(Server, reliable)
+    void RPC_GeoDataRemove(const FGuid& id);
     
     UFUNCTION(Server, unreliable)
-    void RPC_GeoDataUpdate(UARTrackedGeoData *data);
+    void RPC_GeoDataDeltaBatch(const TArray<FARGeoDelta>& deltas);
+    
+    // AR client: sends changed planes in one batch, respecting rate and byte budget
+    void FlushGeoUpdates();
+    
+    void ApplyGeoDelta(const FARGeoDelta& delta);
+    
+    // per-plane mesh buffers, reused between rebuilds to avoid allocator churn
+    // working arrays of BuildGeoMeshBuffers, kept between builds so rebuilds don't allocate
+    struct FGeoMeshScratch {
+        TArray<FVector2D> Boundary2D;
+        TArray<FVector2D> Interior2D;
+        TArray<int32> InteriorTriangles;
+        TArray<int32> Triangulation;
+        // low detail boundary
+        TArray<FVector> SimplifiedBoundary;
+        ARPolygonUtils::FSimplifyScratch Simplify;
+    };
+    
+    struct FGeoMeshBuffers {
+        TArray<FVector> Vertices;
+        TArray<FLinearColor> Colors;
+        TArray<int> Indices;
+        TArray<FVector> Normals;
+        TArray<FVector2D> UVs;
+        // boundary hash and build parameters the buffers were built from
+        uint32 SourceKey = 0;
+        // false for low detail meshes: boundary vertices only, no feather band
+        bool Feathered = true;
+    };
     
-    void UpdateGeo(UARTrackedGeoData *geoData);
-    void UpdateGeoMesh(UARTrackedGeoData *geoData, UProceduralMeshComponent *PlanePolygonMeshComponent);
+    void UpdateGeo(FARTrackedGeoData& geoData);
+    void RemoveGeoMesh(const FGuid& id);
+    // drops all meshes and queues all planes for rebuild
+    void ResetGeoMeshes();
+    
+    // fills plane local space mesh buffers (ear-clipped interior, inset feather band).
+    // featheringDistance 0 skips the band, simplifyTolerance > 0 simplifies the boundary first.
+    // returns true if vertex count or indices changed.
+    // touches no renderer state, safe to call from worker threads with a scratch per build
+    static bool BuildGeoMeshBuffers(const TArray<FVector>& boundaryVerts, float featheringDistance, float simplifyTolerance, uint32 sourceKey,
+                                    FGeoMeshBuffers& buffers, FGeoMeshScratch& scratch);
+    void UpdateGeoMesh(const FTransform& localToWorld, UProceduralMeshComponent *PlanePolygonMeshComponent, const FGeoMeshBuffers& buffers, bool topologyChanged);
+    void UpdateMergedGeoMesh();
+    
+    UProceduralMeshComponent* CreatePlaneComponent();
+    UProceduralMeshComponent* AcquirePlaneComponent(const FColor& color);
+    void ReleasePlaneComponent(UProceduralMeshComponent* component);
 
+    // AR client: AR plane unique id to id of its geo data
+    TMap<FGuid, FGuid> PlanesDataMap;
+    
+    // reused by the device path, so polls don't reallocate boundaries
+    FARPlaneSample PlaneSample;
+    
+    // AR client: plane state at last accepted update, for change thresholds
+    struct FPlanePollState {
+        bool isValid_ = false;
+        int32 lastUpdateFrame_ = 0;
+        FTransform localToWorld_;
+        FVector extent_ = FVector::ZeroVector;
+        int32 boundaryVertexCount_ = 0;
+        float area_ = 0.f;
+    };
+    
+    TMap<FGuid, FPlanePollState> PlanePollStates;
+    float LastPlanePollTime;
+    
+    // planes reported added or updated by AR system since last tick
+    TSet<TWeakObjectPtr<UARPlaneGeometry>> ChangedPlanes;
+    
+    FDelegateHandle OnTrackableAddedHandle;
+    FDelegateHandle OnTrackableUpdatedHandle;
+    FDelegateHandle OnTrackableRemovedHandle;
+    bool bTrackableEventsBound;
+    bool bTrackableEventsUnavailable;
+    bool bFullPlanePollRequested;
+    
+    UPROPERTY()
+    TMap<FGuid, UProceduralMeshComponent*> GeoMeshMap;
+    
+    // Merged mode
     UPROPERTY()
-    TMap<UARPlaneGeometry*, UARTrackedGeoData*> PlanesDataMap;
+    UProceduralMeshComponent* MergedMeshComponent;
+    
+    FGeoMeshBuffers MergedMeshBuffers;
+    uint32 MergedIndicesHash;
+    bool bMergedMeshDirty;
+    
+    // PlaneBuffers mode
+    UPROPERTY()
+    UARPlaneMeshComponent* PlaneBuffersComponent;
+    
+    EARPlaneRenderMode ActiveRenderMode;
+    
+    // hidden plane components ready for reuse
+    UPROPERTY()
+    TArray<UProceduralMeshComponent*> PlaneComponentPool;
+    
+    // planes whose meshes need update or removal on next tick
+    TSet<FGuid> DirtyGeo;
+    TSet<FGuid> RemovedGeo;
     
+    // world space plane bounds for queries
+    FARPlaneSpatialIndex PlaneIndex;
+    
+    // planes that have a mesh
+    FARPlaneSetTracker GeoMeshTracker;
+    float LastGeoReconcileTime;
+    
+    // geo data hashes the mesh component was last built/placed with
+    struct FGeoMeshState {
+        uint32 boundaryHash_ = 0;
+        uint32 poseHash_ = 0;
+        float featheringDistance_ = 0.f;
+        float simplifyTolerance_ = 0.f;
+        bool isBuilt_ = false;
+        FGeoMeshBuffers buffers_;
+        // used by Merged mode to bake the plane in world space
+        FTransform localToWorld_;
+        FColor color_;
+        // latest async build requested for the plane, older results are dropped
+        uint32 buildSerial_ = 0;
+        // visibility pass results
+        bool culled_ = false;
+        bool lowDetail_ = false;
+        // geo data changed while culled, mesh is rebuilt when plane becomes visible
+        bool staleWhileCulled_ = false;
+    };
+    
+    TMap<FGuid, FGeoMeshState> GeoMeshStates;
+    
+    // pushes built (or moved) plane to the active render mode's components
+    void CommitGeoMesh(const FGuid& id, FGeoMeshState& meshState, bool rebuild, bool topologyChanged, bool poseChanged);
+    void UpdatePlaneBuffersGeoMesh(const FGuid& id, const FGeoMeshState& meshState, bool rebuild, bool poseChanged);
+    
+    // shows or hides built plane mesh in the active render mode
+    void SetGeoMeshVisible(const FGuid& id, const FGeoMeshState& meshState);
+    
+    // distance/frustum culling and LOD selection against local player camera
+    void UpdatePlaneVisibility();
+    float LastPlaneVisibilityTime;
+    
+    // async mesh builds. jobs carry their own copy of the boundary; job storage
+    // (boundary copy and output buffers) is recycled through GeoBuildJobPool
+    struct FGeoBuildJob {
+        FGuid id_;
+        uint32 serial_ = 0;
+        uint32 sourceKey_ = 0;
+        TArray<FVector> boundaryVerts_;
+        float featheringDistance_ = 0.f;
+        float simplifyTolerance_ = 0.f;
+        FGeoMeshBuffers buffers_;
+        FGeoMeshScratch scratch_;
+    };
+    
+    // applies finished builds, then starts next batch if none is running
+    void CommitGeoMeshBuilds();
+    void LaunchGeoMeshBuilds();
+    
+    // queued builds, coalesced per plane
+    TMap<FGuid, FGeoBuildJob> PendingGeoBuilds;
+    
+    // queues a build for the plane in a pooled job, drops a queued one
+    FGeoBuildJob& QueueGeoBuild(const FGuid& id);
+    void CancelGeoBuild(const FGuid& id);
+    
+    // finished jobs, holding the buffers swapped out of mesh states on commit
+    TArray<FGeoBuildJob> GeoBuildJobPool;
+    
+    // scratch of builds done on the game thread
+    FGeoMeshScratch GeoMeshScratch;
+    
+    // batch owned by GeoBuildTask until it completes
+    TArray<FGeoBuildJob> GeoBuildsInFlight;
+    TFuture<void> GeoBuildTask;
+    uint32 GeoBuildSerial;
+    
+    uint16 NextGeoNetId;
+    
+    // server: moves plane into the chunk of the cell its center is in
+    void UpdatePlaneChunk(const FARTrackedGeoData& data);
+    void RemovePlaneChunk(const FGuid& id);
+    
+    bool bPlaneRelevancyActive;
+    bool bPlanesConsolidatedActive;
+    float ActivePlaneRelevancyCellSize;
+    
+    // server: chunks by grid cell, and cell of every plane
     UPROPERTY()
-    TMap<UARTrackedGeoData*, UProceduralMeshComponent*> GeoMeshMap;
+    TMap<FIntVector, AARPlaneChunk*> PlaneChunks;
+    TMap<FGuid, FIntVector> PlaneChunkCells;
+    
+    // client: chunk that last delivered the plane. planes moving between cells may be
+    // added by the new chunk before the old one removes them
+    TMap<FGuid, TWeakObjectPtr<AARPlaneChunk>> PlaneChunkOwners;
+    
+    // AR client: delta state of planes sent to the server
+    TMap<FGuid, FARGeoDeltaEncoder> GeoDeltaEncoders;
+    
+    float LastGeoFlushTime;
+    
+    // round-robin start of next batch, so planes clipped by byte budget go first next time
+    int32 GeoSendCursor;
+    
+    // server: delta state of planes received from AR client
+    TMap<FGuid, FARGeoDeltaDecoder> GeoDeltaDecoders;
+    
+    // tangents are not used by plane material
+    TArray<FProcMeshTangent> EmptyTangents;
 
 	int NewPlaneIndex;
 };
@@ -0,0 +1,56 @@
+//
+// ARPlaneSetTracker.h
+//
+// Generation-stamped membership tracking for plane ids.
+//
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/Guid.h"
+
+/**
+ * Diffs a set of plane ids against the previous pass in linear time.
+ * Every pass bumps the generation; ids touched during the pass get the new
+ * stamp, ids left with an old stamp at the end of the pass are removed.
+ */
+class FARPlaneSetTracker
+{
+public:
+    void BeginPass() { ++generation_; }
+
+    // returns true if id was not tracked before
+    bool Touch(const FGuid& id)
+    {
+        uint32* stamp = stamps_.Find(id);
+
+        if (stamp)
+        {
+            *stamp = generation_;
+            return false;
+        }
+
+        stamps_.Add(id, generation_);
+        return true;
+    }
+
+    bool Remove(const FGuid& id) { return stamps_.Remove(id) > 0; }
+
+    // removes and returns ids not touched since BeginPass
+    void EndPass(TArray<FGuid>& outRemoved)
+    {
+        for (auto it = stamps_.CreateIterator(); it; ++it)
+            if (it.Value() != generation_)
+            {
+                outRemoved.Add(it.Key());
+                it.RemoveCurrent();
+            }
+    }
+
+    int32 Num() const { return stamps_.Num(); }
+    void Reset() { stamps_.Reset(); }
+
+private:
+    TMap<FGuid, uint32> stamps_;
+    uint32 generation_ = 0;
+};
@@ -0,0 +1,104 @@
+//
+// ARPlaneSpatialIndex.h
+//
+// Uniform grid over world space bounds of tracked planes, for raycast,
+// nearest plane and overlap queries.
+//
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/Guid.h"
+
+#include "ARPlaneSpatialIndex.generated.h"
+
+struct FARTrackedGeoData;
+
+USTRUCT(BlueprintType)
+struct DDAUGMENTED_API FARPlaneQueryHit {
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly)
+    FGuid PlaneId;
+
+    /** Hit point (raycast) or closest point on the plane (nearest), world space */
+    UPROPERTY(BlueprintReadOnly)
+    FVector Location = FVector::ZeroVector;
+
+    UPROPERTY(BlueprintReadOnly)
+    FVector Normal = FVector::UpVector;
+
+    /** Distance from ray start or query point */
+    UPROPERTY(BlueprintReadOnly)
+    float Distance = 0.f;
+};
+
+/**
+ * Planes are bucketed into cubic cells by their world bounds. Planes spanning
+ * too many cells (large floors) go into a separate list that every query checks.
+ * Exact tests use the plane boundary polygon in plane local space.
+ */
+class DDAUGMENTED_API FARPlaneSpatialIndex
+{
+public:
+    explicit FARPlaneSpatialIndex(float cellSize = 200.f);
+
+    // re-buckets all planes if cell size changed
+    void SetCellSize(float cellSize);
+    float GetCellSize() const { return cellSize_; }
+
+    // adds plane or updates its pose and boundary
+    void Update(const FARTrackedGeoData& data);
+    void Remove(const FGuid& id);
+    void Reset();
+
+    int32 Num() const { return entries_.Num(); }
+
+    // world bounds of the plane, null if plane is not indexed
+    const FBox* GetWorldBox(const FGuid& id) const;
+
+    // closest plane hit by segment start-end, inside plane boundary
+    bool Raycast(const FVector& start, const FVector& end, FARPlaneQueryHit& outHit) const;
+
+    // closest plane within maxDistance of the point (0 -- no limit)
+    bool FindNearest(const FVector& point, float maxDistance, FARPlaneQueryHit& outHit) const;
+
+    // planes whose world bounds intersect the box
+    void Overlap(const FBox& box, TArray<FGuid>& outIds) const;
+
+    // true if the point projects inside plane boundary and is within maxHeight of the plane
+    bool IsPointOnPlane(const FGuid& id, const FVector& point, float maxHeight) const;
+
+    // exact per-plane tests, shared with brute force benchmark
+    static bool RaycastPlane(const FTransform& localToWorld, const TArray<FVector2D>& boundary,
+                             const FVector& start, const FVector& end, FARPlaneQueryHit& outHit);
+    static float DistanceToPlane(const FTransform& localToWorld, const TArray<FVector2D>& boundary,
+                                 const FVector& point, FVector& outClosest);
+
+private:
+    struct FEntry {
+        FGuid id_;
+        FTransform localToWorld_;
+        TArray<FVector2D> boundary_;
+        FBox worldBox_;
+        FIntVector cellMin_;
+        FIntVector cellMax_;
+        bool oversized_ = false;
+        // last query that tested this entry, avoids testing planes spanning several cells twice
+        mutable uint32 queryStamp_ = 0;
+    };
+
+    FIntVector ToCell(const FVector& p) const;
+    void Insert(FEntry& entry);
+    void Unlink(const FEntry& entry);
+
+    // calls visitor once per entry in cells overlapping the box, plus oversized entries
+    template<typename Visitor>
+    void ForEachInBox(const FBox& box, Visitor&& visitor) const;
+
+    TMap<FGuid, FEntry> entries_;
+    TMap<FIntVector, TArray<FGuid>> cells_;
+    TArray<FGuid> oversized_;
+    float cellSize_;
+    mutable uint32 queryStamp_ = 0;
+};
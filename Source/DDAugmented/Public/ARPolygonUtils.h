@@ -0,0 +1,76 @@
+//
+// ARPolygonUtils.h
+//
+// 2D polygon helpers for tracked plane boundaries. Plane boundaries lie in
+// plane local XY, so polygons are handled in 2D.
+//
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+namespace ARPolygonUtils
+{
+    // working arrays of SimplifyClosed, for callers that simplify repeatedly
+    struct FSimplifyScratch {
+        // polygon chain between two kept vertices and its farthest vertex
+        struct FSpan {
+            int32 first_;
+            int32 last_;
+            int32 farthest_;
+            float distance_;
+
+            // max-heap on deviation
+            bool operator<(const FSpan& other) const { return distance_ > other.distance_; }
+        };
+
+        TArray<bool> keep_;
+        TArray<FSpan> heap_;
+    };
+
+    // positive for counter-clockwise polygons
+    DDAUGMENTED_API float SignedArea(const TArray<FVector2D>& polygon);
+    // same for a plane boundary in local space, Z is ignored
+    DDAUGMENTED_API float SignedArea(const TArray<FVector>& polygon);
+
+    // crossing number test, works for both windings
+    DDAUGMENTED_API bool IsPointInside(const TArray<FVector2D>& polygon, const FVector2D& point);
+
+    // closest point on polygon outline
+    DDAUGMENTED_API FVector2D ClosestPointOnBoundary(const TArray<FVector2D>& polygon, const FVector2D& point);
+
+    // true if no two non-adjacent edges intersect
+    DDAUGMENTED_API bool IsSimple(const TArray<FVector2D>& polygon);
+
+    /**
+     * Ear clipping triangulation of a simple (possibly concave) polygon.
+     * Triangles keep the polygon's winding. Always emits n-2 triangles;
+     * returns false if polygon had to be force-clipped (not simple or degenerate).
+     */
+    DDAUGMENTED_API bool Triangulate(const TArray<FVector2D>& polygon, TArray<int32>& outIndices);
+    // same, with the working vertex list in caller-owned scratch so repeated calls don't allocate
+    DDAUGMENTED_API bool Triangulate(const TArray<FVector2D>& polygon, TArray<int32>& outIndices, TArray<int32>& scratch);
+
+    // moves every edge inwards by distance (mitered corners, miter limited to 2x distance).
+    // result keeps vertex count and order; it may self-intersect if distance is too large
+    DDAUGMENTED_API void OffsetInwards(const TArray<FVector2D>& polygon, float distance, TArray<FVector2D>& outPolygon);
+
+    // counter-clockwise convex hull of the points (monotone chain)
+    DDAUGMENTED_API void ConvexHull(const TArray<FVector2D>& points, TArray<FVector2D>& outHull);
+
+    // offsets polygon inwards by up to distance, shrinking the offset until result
+    // is simple and keeps orientation. returns offset actually used (0 -- polygon copied as is).
+    // works in outPolygon only, so a reused outPolygon needs no allocation
+    DDAUGMENTED_API float SafeOffsetInwards(const TArray<FVector2D>& polygon, float distance, TArray<FVector2D>& outPolygon);
+
+    /**
+     * Douglas-Peucker simplification of a closed polygon. Vertices are added in
+     * order of their deviation from the simplified outline until the remaining
+     * deviation is within tolerance or maxVertices is reached (0 -- no limit).
+     * Keeps vertex order; result has at least 3 vertices if input does.
+     */
+    DDAUGMENTED_API void SimplifyClosed(const TArray<FVector>& polygon, float tolerance, int32 maxVertices, TArray<FVector>& outPolygon);
+    // same, reusing scratch and outPolygon allocations
+    DDAUGMENTED_API void SimplifyClosed(const TArray<FVector>& polygon, float tolerance, int32 maxVertices, TArray<FVector>& outPolygon,
+                                        FSimplifyScratch& scratch);
+}
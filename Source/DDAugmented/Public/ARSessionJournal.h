@@ -0,0 +1,285 @@
+//
+// ARSessionJournal.h
+//
+// Append-only journal of AR session state over time: tracking info, tracked
+// images and planes. Only changed items are recorded, buffered into chunks
+// that are written off the game thread, with periodic index blocks for
+// seeking. Raw AR plane samples can go along, so a device session can be
+// replayed through plane ingestion elsewhere.
+//
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Serialization/BitWriter.h"
+#include "Templates/UniquePtr.h"
+
+struct FTrackingInfo;
+struct FTrackedImageData;
+struct FARTrackedGeoData;
+struct FARPlaneSample;
+class IFileHandle;
+
+namespace ARSessionJournal
+{
+    // "DDSJ" in file byte order
+    constexpr uint32 kMagic = 0x4A534444;
+    constexpr uint16 kVersion = 1;
+
+    // block tags: "CHNK", "INDX", "FEND"
+    constexpr uint32 kChunkTag = 0x4B4E4843;
+    constexpr uint32 kIndexTag = 0x58444E49;
+    constexpr uint32 kFooterTag = 0x444E4546;
+
+    // chunk flag: chunk starts a keyframe segment. Item definitions start over
+    // and the chunk's first frame has full state
+    constexpr uint32 kKeyframe = 1;
+
+    // readers reject chunks larger than this as damaged
+    constexpr uint32 kMaxChunkSize = 16 * 1024 * 1024;
+
+    // images and planes are referred to by a short index after their definition record
+    constexpr uint32 kMaxDefinitions = MAX_uint16;
+
+    enum class ERecord : uint8
+    {
+        // session time of the records that follow, ms since chunk start
+        Frame,
+        TrackingInfo,
+        // journal index, id and name of an image or plane, once per keyframe segment
+        ImageDefine,
+        Image,
+        ImageRemove,
+        PlaneDefine,
+        Plane,
+        PlaneRemove,
+        // AR plane as the AR session reported it, before ingestion. Shares plane definitions
+        PlaneSample,
+        Count
+    };
+
+    // record types are written in a fixed number of bits, so new ones keep old records readable
+    constexpr uint32 kRecordTypes = 16;
+    static_assert((uint32)ERecord::Count <= kRecordTypes, "record type doesn't fit");
+
+    // all fields are little endian, offsets are from the start of the file
+    struct FFileHeader {
+        uint32 magic_;
+        uint16 version_;
+        uint16 reserved_;
+        // wall clock (UTC FDateTime ticks) of session time 0
+        int64 startTicks_;
+    };
+
+    // precedes every chunk and index block
+    struct FBlockHeader {
+        uint32 tag_;
+        // payload bytes following the header
+        uint32 size_;
+        // chunk: session time of its first record. index: time of its last entry
+        double time_;
+        // chunk: records. index: entries
+        uint32 count_;
+        uint32 flags_;
+    };
+
+    // index block payload: offset of the previous index block (0 -- none),
+    // then an entry per chunk written since that block
+    struct FIndexEntry {
+        double time_;
+        uint64 offset_;
+        uint32 flags_;
+        uint32 reserved_;
+    };
+
+    // last bytes of a cleanly closed journal
+    struct FFooter {
+        uint32 tag_;
+        uint32 reserved_;
+        uint64 lastIndexOffset_;
+    };
+
+    static_assert(sizeof(FFileHeader) == 16, "journal header layout changed");
+    static_assert(sizeof(FBlockHeader) == 24, "journal block header layout changed");
+    static_assert(sizeof(FIndexEntry) == 24, "journal index entry layout changed");
+    static_assert(sizeof(FFooter) == 16, "journal footer layout changed");
+}
+
+/**
+ * Records are bit packed (quantized poses, int16 plane boundaries) into an
+ * in-memory chunk. A chunk is queued for writing when it reaches ChunkSize
+ * or gets older than FlushInterval, and queued blocks are written by a
+ * thread pool task. If MaxPendingChunks or MaxPendingBytes are already
+ * waiting, the chunk is dropped and a new keyframe segment starts, so memory
+ * stays bounded whatever the write speed. Every IndexInterval chunks an index block is
+ * written and a keyframe segment starts too, so a reader can seek to any
+ * keyframe chunk and replay forward from there.
+ */
+class DDAUGMENTED_API FARSessionJournalWriter
+{
+public:
+    FARSessionJournalWriter();
+    ~FARSessionJournalWriter();
+
+    FARSessionJournalWriter(const FARSessionJournalWriter&) = delete;
+    FARSessionJournalWriter& operator=(const FARSessionJournalWriter&) = delete;
+
+    // chunk payload bytes that trigger a flush
+    int32 ChunkSize;
+    // seconds (session time) after which a chunk is flushed whatever its size
+    float FlushInterval;
+    // chunks waiting for the writer task before new ones are dropped
+    int32 MaxPendingChunks;
+    // bytes queued or being written before new chunks are dropped
+    int32 MaxPendingBytes;
+    // chunks between index blocks (and keyframes)
+    int32 IndexInterval;
+
+    bool Open(const FString& path);
+    // writes what's buffered, final index block and footer. Blocks until written
+    void Close();
+    bool IsOpen() const { return File.IsValid(); }
+
+    // session time (seconds) of records written after this call. Call at the
+    // start of every pass, new keyframe segments begin here
+    void SetTime(double time);
+
+    // true once after a keyframe segment starts -- the caller should write
+    // its full state in this frame (and forget what it wrote before)
+    bool ConsumeKeyframe();
+
+    void WriteTrackingInfo(const FTrackingInfo& info);
+    void WriteImage(const FTrackedImageData& image);
+    void RemoveImage(const FGuid& id);
+    void WritePlane(const FARTrackedGeoData& data);
+    void RemovePlane(const FGuid& id);
+    // samples are events rather than state: they aren't repeated at keyframes
+    void WritePlaneSample(const FARPlaneSample& sample);
+
+    // commits finished writes, flushes the chunk if it's older than FlushInterval
+    void Tick();
+
+    int64 GetBytesWritten() const { return BytesWritten; }
+    int32 GetDroppedChunks() const { return DroppedChunks; }
+
+private:
+    struct FDefinition {
+        uint32 index_;
+        uint32 nameHash_;
+    };
+
+    void StartSegment();
+    void FlushChunk(bool bAllowDrop);
+    void FlushIfFull();
+    void QueueIndexBlock();
+    void QueueBlock(const void* header, int32 headerSize, const void* payload, int32 payloadSize);
+
+    void BeginRecord(ARSessionJournal::ERecord type);
+
+    // writes a definition record if the item is new in this segment or was renamed
+    uint32 Define(TMap<FGuid, FDefinition>& definitions, uint32& nextIndex, ARSessionJournal::ERecord type,
+                  const FGuid& id, const FString& name);
+
+    void LaunchWrite();
+    void CommitWrite();
+
+    TUniquePtr<IFileHandle> File;
+
+    FBitWriter Payload;
+    uint32 PayloadRecords;
+    double ChunkTime;
+    double CurrentTime;
+    bool bFrameWritten;
+    bool bChunkKeyframe;
+    bool bKeyframeRequested;
+    // index interval reached or chunk dropped -- new segment starts with next frame
+    bool bSegmentPending;
+
+    TMap<FGuid, FDefinition> ImageDefinitions;
+    TMap<FGuid, FDefinition> PlaneDefinitions;
+    uint32 NextImageIndex;
+    uint32 NextPlaneIndex;
+
+    // file offset the next queued block goes to
+    uint64 NextOffset;
+    uint64 LastIndexOffset;
+    TArray<ARSessionJournal::FIndexEntry> IndexEntries;
+
+    // bytes in PendingBlocks and BlocksInFlight
+    uint64 QueuedBytes;
+
+    // game thread queues, writer task takes all of them at once
+    TArray<TArray<uint8>> PendingBlocks;
+    TArray<TArray<uint8>> BlocksInFlight;
+    TFuture<bool> WriteTask;
+
+    int64 BytesWritten;
+    int32 DroppedChunks;
+};
+
+/** Receives decoded journal records. Planes come with their GUID and name resolved and netId_ 0 */
+class IARSessionJournalVisitor
+{
+public:
+    virtual ~IARSessionJournalVisitor() {}
+
+    // keyframe chunk starts. Records up to OnKeyframeEnd (end of the keyframe's
+    // first frame) are full state -- items they don't mention are gone
+    virtual void OnKeyframe(double time) {}
+    virtual void OnKeyframeEnd(double time) {}
+    virtual void OnTrackingInfo(double time, const FTrackingInfo& info) {}
+    virtual void OnImage(double time, const FTrackedImageData& image) {}
+    virtual void OnImageRemoved(double time, const FGuid& id) {}
+    virtual void OnPlane(double time, const FARTrackedGeoData& data) {}
+    virtual void OnPlaneRemoved(double time, const FGuid& id) {}
+    virtual void OnPlaneSample(double time, const FARPlaneSample& sample) {}
+};
+
+/**
+ * Reads a journal chunk by chunk; only the current chunk is kept in memory.
+ * The chunk index comes from index blocks of a cleanly closed journal, or
+ * from a scan of block headers for one that was cut short.
+ */
+class DDAUGMENTED_API FARSessionJournalReader
+{
+public:
+    FARSessionJournalReader();
+    ~FARSessionJournalReader();
+
+    bool Open(const FString& path);
+    void Close();
+    bool IsOpen() const { return File.IsValid(); }
+
+    const TArray<ARSessionJournal::FIndexEntry>& GetIndex() const { return Index; }
+    FDateTime GetStartTime() const { return StartTime; }
+
+    // next ReadChunk starts at the last keyframe chunk at or before time
+    bool Seek(double time);
+
+    // decodes next chunk into visitor. false at the end of journal or on a damaged chunk
+    bool ReadChunk(IARSessionJournalVisitor& visitor);
+
+private:
+    bool ReadIndexBlocks();
+    void ScanIndex();
+
+    bool ReadAt(uint64 offset, void* dest, int64 size);
+
+    TUniquePtr<FArchive> File;
+    FDateTime StartTime;
+    TArray<ARSessionJournal::FIndexEntry> Index;
+    int32 NextChunk;
+
+    TArray<uint8> ChunkBytes;
+
+    // first frame of the last keyframe is still being read
+    bool bKeyframeOpen;
+    double KeyframeTime;
+
+    // definitions of the current segment, by journal index
+    TArray<FGuid> ImageIds;
+    TArray<FString> ImageNames;
+    TArray<FGuid> PlaneIds;
+    TArray<FName> PlaneNames;
+};
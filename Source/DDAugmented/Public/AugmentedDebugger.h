@@ -5,7 +5,9 @@
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
 #include "ARPlaneRenderer.h"
+#include "ARSessionJournal.h"
 #include "Misc/Guid.h"
+#include "Async/Future.h"
 
 #include "AugmentedDebugger.generated.h"
 
@@ -55,6 +57,138 @@ struct FTrackedImageData {
     bool PickedForEstimation;
 };
 
+class UAugmentedDebugger;
+
+// tracked image without its name, quantized on the wire. Identity is netId_,
+// or id_ sent inline while it is 0 (AR client updates for images whose net
+// id hasn't reached it yet)
+USTRUCT()
+struct FTrackedImagePose {
+    GENERATED_BODY()
+    
+    UPROPERTY()
+    uint16 netId_ = 0;
+    
+    UPROPERTY()
+    FGuid id_;
+    
+    UPROPERTY()
+    FTransform PawnToImage;
+    
+    UPROPERTY()
+    FVector2D EstimatedSize = FVector2D::ZeroVector;
+    
+    UPROPERTY()
+    EARTrackingState TrackingState = EARTrackingState::Unknown;
+    
+    UPROPERTY()
+    bool PickedForEstimation = false;
+    
+    // pose and state only, identity is left as is
+    void FromImageData(const FTrackedImageData& image);
+    void ToImageData(FTrackedImageData& image) const;
+    
+    // true if pose, size or state differ by more than wire quantization
+    bool Differs(const FTrackedImagePose& other) const;
+    
+    // quantized pose, size in mm, id_ only when netId_ is 0
+    bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FTrackedImagePose> : public TStructOpsTypeTraitsBase2<FTrackedImagePose> {
+    enum
+    {
+        WithNetSerializer = true,
+    };
+};
+
+USTRUCT()
+struct FTrackedImageHeader : public FFastArraySerializerItem {
+    GENERATED_BODY()
+    
+    UPROPERTY()
+    uint16 netId_ = 0;
+    
+    UPROPERTY()
+    FGuid id_;
+    
+    UPROPERTY()
+    FString ImageName;
+    
+    void PostReplicatedAdd(const struct FTrackedImageHeaderArray& InArraySerializer);
+    void PostReplicatedChange(const struct FTrackedImageHeaderArray& InArraySerializer);
+};
+
+/**
+ * Identity and name of tracked images, keyed by netId_. Headers change only
+ * when images are added, renamed or removed, so names go once per image.
+ */
+USTRUCT()
+struct FTrackedImageHeaderArray : public FFastArraySerializer {
+    GENERATED_BODY()
+    
+    UPROPERTY()
+    TArray<FTrackedImageHeader> Items;
+    
+    UAugmentedDebugger* Owner = nullptr;
+    
+    bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+    {
+        return FFastArraySerializer::FastArrayDeltaSerialize<FTrackedImageHeader, FTrackedImageHeaderArray>(Items, DeltaParms, *this);
+    }
+};
+
+template<>
+struct TStructOpsTypeTraits<FTrackedImageHeaderArray> : public TStructOpsTypeTraitsBase2<FTrackedImageHeaderArray> {
+    enum
+    {
+        WithNetDeltaSerializer = true,
+    };
+};
+
+USTRUCT()
+struct FTrackedImageItem : public FFastArraySerializerItem {
+    GENERATED_BODY()
+    
+    UPROPERTY()
+    FTrackedImagePose pose_;
+    
+    void PreReplicatedRemove(const struct FTrackedImageArray& InArraySerializer);
+    void PostReplicatedAdd(const struct FTrackedImageArray& InArraySerializer);
+    void PostReplicatedChange(const struct FTrackedImageArray& InArraySerializer);
+};
+
+/**
+ * Replicated poses of tracked images. Server keeps items at the same index
+ * as their headers; only items marked dirty are sent.
+ */
+USTRUCT()
+struct FTrackedImageArray : public FFastArraySerializer {
+    GENERATED_BODY()
+    
+    UPROPERTY()
+    TArray<FTrackedImageItem> Items;
+    
+    UAugmentedDebugger* Owner = nullptr;
+    
+    bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+    {
+        return FFastArraySerializer::FastArrayDeltaSerialize<FTrackedImageItem, FTrackedImageArray>(Items, DeltaParms, *this);
+    }
+};
+
+template<>
+struct TStructOpsTypeTraits<FTrackedImageArray> : public TStructOpsTypeTraitsBase2<FTrackedImageArray> {
+    enum
+    {
+        WithNetDeltaSerializer = true,
+    };
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnFiducialSnapshotSaved, const FString&, FilePath, bool, bSuccess);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnSessionReplayFinished);
+
 UCLASS(ClassGroup=(DDAugmentedUI),Blueprintable, meta=(BlueprintSpawnableComponent))
 class DDAUGMENTED_API UTrackedGeoListItem : public UObject {
     GENERATED_BODY()
@@ -77,6 +211,8 @@ public:
     
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+    
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
     UFUNCTION(Server, Reliable)
     void ServerSpawnPlaneRenderer();
@@ -107,9 +243,18 @@ public:
     UPROPERTY(BlueprintReadWrite)
     FTrackingInfo TrackingInfo;
     
-    UPROPERTY(BlueprintReadWrite, Replicated)
+    // server: authoritative, replicated through TrackedImageHeaders and
+    // TrackedImagePoses. clients: filled from them
+    UPROPERTY(BlueprintReadWrite)
     TArray<FTrackedImageData> TrackedImages;
     
+    // image names, declared before TrackedImagePoses so they arrive ahead of poses
+    UPROPERTY(Replicated)
+    FTrackedImageHeaderArray TrackedImageHeaders;
+    
+    UPROPERTY(Replicated)
+    FTrackedImageArray TrackedImagePoses;
+    
     UFUNCTION(Server, Reliable, BlueprintCallable)
     void ServerUpdateTrackingInfo(FTrackingInfo tInfo);
     
@@ -126,20 +271,45 @@ public:
     void ServerAddTrackedImage(FTrackedImageData tImage);
 
     UFUNCTION(Server, Reliable, BlueprintCallable)
-    void ServerRemoveTrackedImage(const TArray<FString>& imageIds);
+    void ServerRemoveTrackedImage(const TArray<FGuid>& imageIds);
     
-    UFUNCTION(Server, Unreliable, BlueprintCallable)
+    // sends the whole image every call -- UpdateTrackedImage batches and quantizes
+    UFUNCTION(Server, Unreliable, BlueprintCallable, meta=(DeprecatedFunction, DeprecationMessage="Use UpdateTrackedImage"))
     void ServerUpdateTrackedImage(FTrackedImageData tImage);
     
+    // queues a pose and state update of an image added with ServerAddTrackedImage.
+    // Changed images go to the server in one batch per tick; name isn't sent
+    UFUNCTION(BlueprintCallable)
+    void UpdateTrackedImage(const FTrackedImageData& tImage);
+    
+    UFUNCTION(Server, Unreliable)
+    void ServerUpdateTrackedImages(const TArray<FTrackedImagePose>& poses);
+    
+    // client: replication callbacks of TrackedImageHeaders and TrackedImagePoses
+    void OnImageHeaderReplicated(const FTrackedImageHeader& header);
+    void OnImagePoseReplicated(const FTrackedImagePose& pose);
+    void OnImagePoseRemoved(const FTrackedImagePose& pose);
+    
     UFUNCTION(BlueprintCallable)
     FTrackedImageData MakeNewTrackedImageData() const;
     
+    /** Snapshots waiting for the background writer. SnapFiducials calls beyond that are dropped */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int32 MaxQueuedSnapshots;
+    
+    /** Fired on game thread when a SnapFiducials file is written, failed or was dropped */
+    UPROPERTY(BlueprintAssignable)
+    FOnFiducialSnapshotSaved OnFiducialSnapshotSaved;
+    
+    // copies tracked images and hands them to a background writer
     UFUNCTION(BlueprintCallable)
     void SnapFiducials(const FString& fileName, bool onlyTracking = false) const;
     
     UFUNCTION(Server, Reliable, BlueprintCallable)
     void ServerSnapFiducials(const FString& fileName, bool onlyTracking = false) const;
     
+    // fiducial snapshot file, see FiducialSnapshot.h. Files of the older
+    // unversioned format are still loaded
     UFUNCTION(BlueprintCallable)
     static bool SaveFiducialImages(const FString& savePath,
                                    const TArray<FTrackedImageData>& imageData);
@@ -148,6 +318,62 @@ public:
     static bool LoadFiducialImages(const FString& loadPath,
                                    TArray<FTrackedImageData>& imageData);
     
+    /** Seconds between journal passes over tracking info, tracked images and planes. 0 -- every tick */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    float JournalInterval;
+    
+    /** Journal chunk size (KB) at which it is handed to the writer */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int32 JournalChunkSizeKB;
+    
+    /** Seconds after which a journal chunk is written whatever its size */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    float JournalFlushInterval;
+    
+    /** Journal chunks waiting for the writer before new ones are dropped (and a keyframe follows) */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int32 MaxPendingJournalChunks;
+    
+    /** How often (seconds) the server fully reconciles replicated images against TrackedImages, for direct Blueprint edits. 0 disables */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    float ImageReconcileInterval;
+    
+    /** Journal AR planes as the plane renderer ingests them, every frame, so the session can be replayed */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bJournalPlaneSamples;
+    
+    /** Replay speed relative to recorded time. 0 -- one recorded frame per tick, as fast as the game runs */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    float ReplayRate;
+    
+    /** Fired when a replay reaches the end of its journal */
+    UPROPERTY(BlueprintAssignable)
+    FOnSessionReplayFinished OnSessionReplayFinished;
+    
+    // starts appending changes of tracking info, tracked images and planes to
+    // a session journal (see ARSessionJournal.h) in the writeable folder
+    UFUNCTION(BlueprintCallable)
+    bool StartJournal(const FString& fileName);
+    
+    UFUNCTION(BlueprintCallable)
+    void StopJournal();
+    
+    UFUNCTION(BlueprintCallable)
+    bool IsJournaling() const { return Journal.IsOpen(); }
+    
+    // plays a journal recorded with plane samples back as if it was the local
+    // AR session: plane samples go through the plane renderer's ingestion,
+    // tracking info and tracked images through the same calls an AR client
+    // makes. Works without an AR session, e.g. in editor or headless builds
+    UFUNCTION(BlueprintCallable)
+    bool StartReplay(const FString& fileName);
+    
+    UFUNCTION(BlueprintCallable)
+    void StopReplay();
+    
+    UFUNCTION(BlueprintCallable)
+    bool IsReplaying() const { return Replay.IsOpen(); }
+    
     UFUNCTION(BlueprintCallable)
     FTransform GetPawnAdjustment() const { return pawnAdjustment_; }
     
@@ -165,6 +391,120 @@ private:
     UFUNCTION()
     void OnRep_PlaneRenderer();
     
-    static void SaveLoadTrackedImage(FArchive& Ar, FTrackedImageData& imageData);
+    // TrackedImages index by image id, maintained by Server*TrackedImage calls on
+    // the server and by replication callbacks on clients
+    TMap<FGuid, int32> TrackedImageIndex;
+    // frame the index was last rebuilt in
+    uint64 TrackedImageIndexFrame;
+    
+    FTrackedImageData* FindTrackedImage(const FGuid& id);
+    // drops images with a duplicate id
+    void RebuildTrackedImageIndex();
+    // overwrites the image with the same id, if there is one
+    FTrackedImageData& AddTrackedImage(const FTrackedImageData& image);
+    void RemoveTrackedImage(const FGuid& id);
+    
+    // identity of images by net id: assigned here on the server, from headers on clients
+    struct FImageIdentity {
+        FGuid id_;
+        FString name_;
+    };
+    
+    TMap<uint16, FImageIdentity> ImageIdentities;
+    TMap<FGuid, uint16> ImageNetIds;
+    uint16 NextImageNetId;
+    
+    // server: index of images in TrackedImageHeaders and TrackedImagePoses
+    TMap<FGuid, int32> ReplicatedImageIndex;
+    
+    // server: pushes images changed through Server*TrackedImage calls to the
+    // replicated arrays, and every ImageReconcileInterval diffs all of TrackedImages
+    void ReplicateTrackedImages();
+    void ReconcileTrackedImages();
+    void ReplicateTrackedImage(const FTrackedImageData& image);
+    void RemoveReplicatedImage(int32 idx);
+    uint16 AllocateImageNetId();
+    
+    // server: ids added, changed or removed since last replication
+    void MarkImageDirty(const FGuid& id);
+    TSet<FGuid> DirtyImages;
+    
+    // server: ids seen by the reconcile pass, kept to reuse its allocation
+    TSet<FGuid> ReconciledImages;
+    float LastImageReconcileTime;
+    
+    // client: poses received ahead of their header
+    TMap<uint16, FTrackedImagePose> UnresolvedImagePoses;
+    
+    // AR client: updates queued since last tick, latest per image
+    TMap<FGuid, FTrackedImagePose> PendingImageUpdates;
+    
+    void FlushImageUpdates();
+    
+    struct FSnapshotJob {
+        FString filePath_;
+        TArray<FTrackedImageData> images_;
+    };
+    
+    // SnapFiducials is const for blueprints; writer state isn't part of what it reads
+    mutable TArray<FSnapshotJob> QueuedSnapshots;
+    mutable FSnapshotJob SnapshotInFlight;
+    mutable TFuture<bool> SnapshotTask;
+    
+    void LaunchSnapshotWrite() const;
+    void CommitSnapshotWrite();
+    
+    FARSessionJournalWriter Journal;
+    double JournalStartTime;
+    double LastJournalTime;
+    
+    // state as of last journal pass, changes against it are journaled
+    bool bJournaledTrackingInfo;
+    FTrackingInfo JournaledTrackingInfo;
+    TMap<FGuid, FTrackedImageData> JournaledImages;
+    TMap<FGuid, uint32> JournaledPlaneRevisions;
+    
+    // renderer plane samples are journaled from
+    TWeakObjectPtr<AARPlaneRenderer> SampledPlaneRenderer;
+    FDelegateHandle PlaneSampleHandle;
+    
+    void UpdateJournal();
+    // sets journal time to now. true if a keyframe segment started and full state went in
+    bool BeginJournalFrame();
+    // journals what changed since last pass
+    void JournalChanges();
+    void JournalPlaneSample(const FARPlaneSample& sample);
+    void UnbindPlaneSamples();
+    
+    // journal records of the replayed chunk, in recorded order
+    struct FReplayRecord {
+        enum class EType : uint8 { KeyframeStart, KeyframeEnd, TrackingInfo, Image, ImageRemove, PlaneSample };
+        
+        EType type_;
+        double time_;
+        FTrackingInfo trackingInfo_;
+        FTrackedImageData image_;
+        FARPlaneSample planeSample_;
+    };
+    
+    FARSessionJournalReader Replay;
+    TArray<FReplayRecord> ReplayRecords;
+    int32 NextReplayRecord;
+    double ReplayTime;
+    double ReplayStartTime;
+    // images replayed so far; on AR clients decides between add and update calls
+    TSet<FGuid> ReplayedImages;
+    // images seen in the current keyframe's full state
+    TSet<FGuid> ReplayKeyframeImages;
+    bool bReplayKeyframe;
+    TArray<FARPlaneSample> ReplayPlaneSamples;
+    
+    void UpdateReplay(float DeltaTime);
+    // next record to replay, reads the next chunk when needed. nullptr at the end of the journal
+    const FReplayRecord* PeekReplayRecord();
+    void ReplayRecord(const FReplayRecord& record);
+    
+    // planes of PlaneRenderer, or of the first renderer in the world if it is not set
+    AARPlaneRenderer* FindPlaneRenderer() const;
     
 };
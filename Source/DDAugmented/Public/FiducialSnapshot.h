@@ -0,0 +1,120 @@
+//
+// FiducialSnapshot.h
+//
+// Binary file format for fiducial (tracked image) snapshots. A fixed size
+// header is followed by a table of fixed stride records and a table of
+// UTF-8 image names, so a snapshot can be memory-mapped and read in place.
+//
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/UniquePtr.h"
+
+struct FTrackedImageData;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+namespace FiducialSnapshot
+{
+    // "DDFS" in file byte order
+    constexpr uint32 kMagic = 0x53464444;
+
+    // bumped on layout changes old readers can't handle. Fields appended to
+    // the record don't need a bump -- readers step over records by recordStride_
+    constexpr uint16 kVersion = 1;
+
+    // snapshots with more records are rejected as damaged
+    constexpr uint32 kMaxRecords = 1 << 20;
+
+    // all fields are little endian, offsets are from the start of the file
+    struct FHeader {
+        uint32 magic_;
+        uint16 version_;
+        uint16 headerSize_;
+        uint32 recordCount_;
+        uint32 recordStride_;
+        uint32 recordsOffset_;
+        uint32 stringsOffset_;
+        uint32 stringsSize_;
+        uint32 reserved_;
+    };
+
+    struct FRecord {
+        // PawnToImage
+        float rotation_[4];
+        float translation_[3];
+        float scale_[3];
+        float estimatedSize_[2];
+        uint32 id_[4];
+        // image name: offset into strings table, length in bytes without the terminating zero
+        uint32 nameOffset_;
+        uint32 nameLength_;
+        uint8 trackingState_;
+        uint8 pickedForEstimation_;
+        uint8 reserved_[2];
+    };
+
+    static_assert(sizeof(FHeader) == 32, "snapshot header layout changed");
+    static_assert(sizeof(FRecord) == 76, "snapshot record layout changed");
+
+    // serializes images into a snapshot file image. Equal names are stored once
+    DDAUGMENTED_API void Write(const TArray<FTrackedImageData>& images, TArray<uint8>& outBytes);
+
+    // reads files written by SaveFiducialImages before snapshots were versioned:
+    // int count, then ImageName and PawnToImage per image
+    DDAUGMENTED_API bool LoadLegacy(const FString& path, TArray<FTrackedImageData>& outImages);
+}
+
+/**
+ * Read-only view of a snapshot file. The file is memory-mapped where the
+ * platform supports it (read into memory otherwise) and records are
+ * accessed in place; only header and table bounds are checked on open.
+ */
+class DDAUGMENTED_API FFiducialSnapshotView
+{
+public:
+    FFiducialSnapshotView();
+    ~FFiducialSnapshotView();
+
+    FFiducialSnapshotView(const FFiducialSnapshotView&) = delete;
+    FFiducialSnapshotView& operator=(const FFiducialSnapshotView&) = delete;
+
+    // false if file is missing, is not a snapshot (e.g. legacy format) or is damaged
+    bool Open(const FString& path);
+    void Close();
+
+    bool IsOpen() const { return Header != nullptr; }
+    bool IsMapped() const { return MappedRegion.IsValid(); }
+
+    int32 Num() const { return Header ? (int32)Header->recordCount_ : 0; }
+    uint16 GetVersion() const { return Header ? Header->version_ : 0; }
+
+    const FiducialSnapshot::FRecord& GetRecord(int32 i) const
+    {
+        check(i >= 0 && i < Num());
+        return *reinterpret_cast<const FiducialSnapshot::FRecord*>(Records + (SIZE_T)i * Header->recordStride_);
+    }
+
+    // UTF-8 name inside the mapped file, zero terminated. Empty if record's name is out of bounds
+    const ANSICHAR* GetName(const FiducialSnapshot::FRecord& record) const;
+
+    // decodes one record
+    void GetImageData(int32 i, FTrackedImageData& outImage) const;
+
+    // decodes all records
+    void GetImageData(TArray<FTrackedImageData>& outImages) const;
+
+private:
+    bool ParseHeader();
+
+    TUniquePtr<IMappedFileHandle> MappedFile;
+    TUniquePtr<IMappedFileRegion> MappedRegion;
+    TArray<uint8> Buffer;
+
+    const uint8* Data;
+    int64 Size;
+    const FiducialSnapshot::FHeader* Header;
+    const uint8* Records;
+    const ANSICHAR* Strings;
+};